@@ -0,0 +1,289 @@
+#include "AssetPack.hpp"
+#include "Name.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+AssetPack::AssetPack(std::string const &filename) : file(filename, false) {
+	ChunkReader chunks(file.data(), file.size(), filename);
+	entries = chunks.read< Entry >("pke0");
+	slots = chunks.read< uint32_t >("pkh0");
+	names = chunks.read< char >("str0");
+	//(pack-assets lays chunks out so they can be used in place; copies would go away with 'chunks')
+	if (!chunks.copies.empty()) {
+		throw std::runtime_error("Asset pack '" + filename + "' has misaligned chunks.");
+	}
+
+	if (slots.size() < entries.size()) {
+		throw std::runtime_error("Asset pack '" + filename + "' has a hash table that is too small.");
+	}
+	for (auto const &entry : entries) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= names.size())) {
+			throw std::runtime_error("Asset pack '" + filename + "' has an entry with an out-of-range name.");
+		}
+		if (!(entry.offset <= file.size() && entry.size <= file.size() - entry.offset)) {
+			throw std::runtime_error("Asset pack '" + filename + "' has an entry with out-of-range data.");
+		}
+		if (!(entry.compression == Stored || entry.compression == LZ4)) {
+			throw std::runtime_error("Asset pack '" + filename + "' has an entry with unknown compression.");
+		}
+		if (entry.compression == Stored && entry.size != entry.content_size) {
+			throw std::runtime_error("Asset pack '" + filename + "' has a stored entry with mismatched sizes.");
+		}
+		//(each LZ4 length byte can stand for at most 255 output bytes, so a bigger claimed size is corrupt -- and mustn't be allocated by open())
+		if (entry.compression == LZ4 && entry.content_size > entry.size * 255) {
+			throw std::runtime_error("Asset pack '" + filename + "' has a compressed entry with an impossible decompressed size.");
+		}
+		if (entry.name_hash != hash_name(name(entry))) {
+			throw std::runtime_error("Asset pack '" + filename + "' has an entry with the wrong name hash.");
+		}
+	}
+	for (auto const &slot : slots) {
+		if (slot > entries.size()) {
+			throw std::runtime_error("Asset pack '" + filename + "' has an out-of-range hash table slot.");
+		}
+	}
+
+	checked.reset(new std::atomic< bool >[entries.size()]);
+	for (size_t i = 0; i < entries.size(); ++i) {
+		checked[i] = false;
+	}
+}
+
+AssetPack::Entry const *AssetPack::find(std::string_view name_) const {
+	if (slots.empty()) return nullptr;
+	uint64_t hash = hash_name(name_);
+	//linear probing, so look from the name's slot to the first empty one:
+	for (size_t i = 0, slot = size_t(hash % slots.size()); i < slots.size(); ++i, slot = (slot + 1 == slots.size() ? 0 : slot + 1)) {
+		if (slots[slot] == 0) break;
+		Entry const &entry = entries[slots[slot] - 1];
+		if (entry.name_hash == hash && name(entry) == name_) return &entry;
+	}
+	return nullptr;
+}
+
+namespace {
+	//decompressed contents, by content hash + size (so opening something twice shares it):
+	std::mutex cache_mutex;
+	std::map< std::pair< uint64_t, uint64_t >, std::weak_ptr< void const > > cache;
+}
+
+std::string_view AssetPack::open(Entry const &entry, std::shared_ptr< void const > *holder) const {
+	assert(&entry >= entries.begin() && &entry < entries.end());
+	assert(holder);
+
+	auto corrupt = [&]() {
+		return std::runtime_error("Asset pack entry '" + std::string(name(entry)) + "' in '" + file.filename + "' is corrupt.");
+	};
+
+	char const *stored = file.data() + entry.offset;
+
+	if (entry.compression == Stored) {
+		holder->reset(); //(points into the mapping, which is around as long as the pack is)
+		std::atomic< bool > &entry_checked = checked[&entry - entries.begin()];
+		if (!entry_checked) {
+			if (hash_content(stored, entry.size) != entry.content_hash) throw corrupt();
+			entry_checked = true;
+		}
+		return std::string_view(stored, entry.size);
+	}
+
+	auto key = std::make_pair(entry.content_hash, entry.content_size);
+	{ //decompressed already?
+		std::unique_lock< std::mutex > lock(cache_mutex);
+		auto f = cache.find(key);
+		if (f != cache.end()) {
+			if ((*holder = f->second.lock())) {
+				return std::string_view(reinterpret_cast< char const * >(holder->get()), entry.content_size);
+			}
+			cache.erase(f);
+		}
+	}
+
+	std::shared_ptr< char > contents(new char[entry.content_size], std::default_delete< char[] >());
+	if (!decompress_lz4(stored, entry.size, contents.get(), entry.content_size)
+	 || hash_content(contents.get(), entry.content_size) != entry.content_hash) {
+		throw corrupt();
+	}
+	*holder = contents;
+
+	{ //(if another thread got here first, this copy is just dropped when its holder is)
+		std::unique_lock< std::mutex > lock(cache_mutex);
+		std::weak_ptr< void const > &cached = cache[key];
+		if (cached.expired()) cached = contents;
+	}
+
+	return std::string_view(contents.get(), entry.content_size);
+}
+
+uint64_t AssetPack::hash_name(std::string_view name) {
+	return Name::hash_of(name); //(constexpr, so tools that link AssetPack don't need Name.cpp)
+}
+
+//XXH64, from the description at https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+uint64_t AssetPack::hash_content(char const *data, size_t size) {
+	constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+	constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+	constexpr uint64_t Prime3 = 0x165667B19E3779F9ULL;
+	constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+	constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+	auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+	auto read64 = [](uint8_t const *p) { uint64_t x; std::memcpy(&x, p, 8); return x; }; //(assumes little-endian)
+	auto read32 = [](uint8_t const *p) { uint32_t x; std::memcpy(&x, p, 4); return x; };
+	auto mix = [&rotl](uint64_t acc, uint64_t lane) { return rotl(acc + lane * Prime2, 31) * Prime1; };
+	auto merge = [&mix](uint64_t acc, uint64_t value) { return (acc ^ mix(0, value)) * Prime1 + Prime4; };
+
+	uint8_t const *p = reinterpret_cast< uint8_t const * >(data);
+	uint8_t const *end = p + size;
+
+	uint64_t hash;
+	if (size >= 32) {
+		uint64_t acc[4] = { Prime1 + Prime2, Prime2, 0, 0 - Prime1 };
+		for (; end - p >= 32; p += 32) {
+			acc[0] = mix(acc[0], read64(p));
+			acc[1] = mix(acc[1], read64(p + 8));
+			acc[2] = mix(acc[2], read64(p + 16));
+			acc[3] = mix(acc[3], read64(p + 24));
+		}
+		hash = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+		for (uint32_t i = 0; i < 4; ++i) {
+			hash = merge(hash, acc[i]);
+		}
+	} else {
+		hash = Prime5;
+	}
+	hash += size;
+
+	for (; end - p >= 8; p += 8) {
+		hash = rotl(hash ^ mix(0, read64(p)), 27) * Prime1 + Prime4;
+	}
+	if (end - p >= 4) {
+		hash = rotl(hash ^ (read32(p) * Prime1), 23) * Prime2 + Prime3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		hash = rotl(hash ^ (*p * Prime5), 11) * Prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= Prime2;
+	hash ^= hash >> 29;
+	hash *= Prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+//LZ4 block format, as in https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+// (a sequence of: token, literal length, literals, match offset, match length)
+bool AssetPack::decompress_lz4(char const *from, size_t from_size, char *to, size_t to_size) {
+	uint8_t const *in = reinterpret_cast< uint8_t const * >(from);
+	uint8_t const *in_end = in + from_size;
+	uint8_t *out = reinterpret_cast< uint8_t * >(to);
+	uint8_t *out_end = out + to_size;
+
+	//lengths of 15 continue in following bytes (each adding up to 255):
+	auto length = [&in, in_end](size_t *len) {
+		if (*len != 15) return true;
+		uint8_t more;
+		do {
+			if (in == in_end) return false;
+			more = *in++;
+			*len += more;
+		} while (more == 255);
+		return true;
+	};
+
+	while (true) {
+		if (in == in_end) return false;
+		uint8_t token = *in++;
+
+		size_t literals = token >> 4;
+		if (!length(&literals)) return false;
+		if (literals > size_t(in_end - in) || literals > size_t(out_end - out)) return false;
+		if (size_t(in_end - in) >= literals + 16 && size_t(out_end - out) >= literals + 16) {
+			//(copying in 16-byte pieces -- past the end, when there's room -- is faster than an exact memcpy)
+			for (size_t i = 0; i < literals; i += 16) {
+				std::memcpy(out + i, in + i, 16);
+			}
+		} else if (literals) {
+			std::memcpy(out, in, literals);
+		}
+		in += literals;
+		out += literals;
+
+		if (in == in_end) break; //(the last sequence is just literals)
+
+		if (in_end - in < 2) return false;
+		size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+		in += 2;
+		if (offset == 0 || offset > size_t(out - reinterpret_cast< uint8_t * >(to))) return false;
+
+		size_t match = token & 0xf;
+		if (!length(&match)) return false;
+		match += 4;
+		if (match > size_t(out_end - out)) return false;
+
+		uint8_t const *copy = out - offset;
+		if (offset >= 8 && size_t(out_end - out) >= match + 8) {
+			//(as above; 8 bytes at a time is fine as long as each piece was written before it is read)
+			for (size_t i = 0; i < match; i += 8) {
+				std::memcpy(out + i, copy + i, 8);
+			}
+		} else if (offset >= match) {
+			std::memcpy(out, copy, match);
+		} else { //(overlapping copies repeat the last 'offset' bytes)
+			for (size_t i = 0; i < match; ++i) {
+				out[i] = copy[i];
+			}
+		}
+		out += match;
+	}
+
+	return out == out_end;
+}
+
+namespace {
+	struct Mount {
+		std::string prefix;
+		std::unique_ptr< AssetPack > pack;
+	};
+	std::vector< Mount > &get_mounts() {
+		static std::vector< Mount > mounts;
+		return mounts;
+	}
+}
+
+bool mount_asset_pack(std::string const &filename, std::string const &prefix_) {
+	if (!std::ifstream(filename, std::ios::binary)) return false;
+
+	std::string prefix = prefix_;
+	if (prefix.empty()) {
+		size_t slash = filename.find_last_of("/\\");
+		if (slash != std::string::npos) prefix = filename.substr(0, slash + 1);
+	}
+
+	Mount mount;
+	mount.prefix = prefix;
+	mount.pack.reset(new AssetPack(filename));
+	get_mounts().emplace_back(std::move(mount));
+	return true;
+}
+
+bool find_in_asset_packs(std::string const &filename, std::string_view *data, std::shared_ptr< void const > *holder) {
+	assert(data);
+	auto const &mounts = get_mounts();
+	for (auto m = mounts.rbegin(); m != mounts.rend(); ++m) {
+		if (filename.compare(0, m->prefix.size(), m->prefix) != 0) continue;
+		AssetPack::Entry const *entry = m->pack->find(std::string_view(filename).substr(m->prefix.size()));
+		if (entry) {
+			*data = m->pack->open(*entry, holder);
+			return true;
+		}
+	}
+	return false;
+}
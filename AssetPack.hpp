@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+ * An AssetPack bundles many data files into one (written by pack-assets),
+ * so that loading them takes one open() + mmap() instead of one per file:
+ *
+ * //in main(), before call_load_functions():
+ * mount_asset_pack(data_path("assets.pack")); //(returns false if there is no such file)
+ *
+ * Once a pack is mounted, MappedFile -- and so MeshBuffer, Scene::load,
+ * Sound::Sample, and load_png -- looks for files there before going to disk.
+ * Names in a pack are paths relative to the directory the pack is in, so
+ * data_path("phone-bank.pnct") finds "phone-bank.pnct" in data_path("assets.pack").
+ * (paths are matched exactly -- no "..", "./", or "//" in names)
+ *
+ * Mount packs before anything is loaded: lookups (which may happen on
+ * loader threads) don't lock the list of packs.
+ *
+ * Pack file layout -- chunks, as in read_write_chunk.hpp:
+ *  "pke0" -- AssetPack::Entry[] (one per file)
+ *  "pkh0" -- uint32_t[] hash table of names: slot (name_hash % size) -- or the
+ *            next one that isn't empty, and so on -- holds entry index + 1 (0 = empty)
+ *  "str0" -- names
+ * ...followed by each entry's data, starting at a multiple of Alignment bytes
+ * from the start of the file (so stored data is as aligned as a mapped file).
+ *
+ * Entries are stored as-is or LZ4-compressed (block format). Compressed entries
+ * are decompressed when opened; identical contents are shared while open.
+ * Each entry's content hash (XXH64 of its uncompressed bytes) is checked the first
+ * time it is opened.
+ */
+
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct AssetPack {
+	//map a pack file (throws if it fails to read or is malformed):
+	AssetPack(std::string const &filename);
+	AssetPack(AssetPack const &) = delete;
+	AssetPack &operator=(AssetPack const &) = delete;
+
+	enum : uint32_t { Alignment = 64 };
+
+	enum Compression : uint32_t {
+		Stored = 0,
+		LZ4 = 1,
+	};
+
+	struct Entry {
+		uint64_t name_hash; //hash_name(name)
+		uint32_t name_begin, name_end; //in "str0"
+		uint64_t offset; //from the start of the pack
+		uint64_t size; //bytes stored
+		uint64_t content_size; //bytes once decompressed (== size if stored as-is)
+		uint64_t content_hash; //hash_content(contents)
+		Compression compression;
+		uint32_t padding;
+	};
+	static_assert(sizeof(Entry) == 56, "Entry is packed.");
+
+	//find a file in the pack (nullptr if not present):
+	Entry const *find(std::string_view name) const;
+
+	//the contents of an entry:
+	// (points into the mapping, or to decompressed data held by 'holder'; throws if the data is corrupt)
+	std::string_view open(Entry const &entry, std::shared_ptr< void const > *holder) const;
+
+	std::string_view name(Entry const &entry) const { return std::string_view(names.data() + entry.name_begin, entry.name_end - entry.name_begin); }
+
+	//hashes used in packs:
+	static uint64_t hash_name(std::string_view name); //FNV-1a
+	static uint64_t hash_content(char const *data, size_t size); //XXH64, seed 0
+
+	//LZ4 block decompression ('to' must be exactly the decompressed size; returns false if 'from' is malformed):
+	static bool decompress_lz4(char const *from, size_t from_size, char *to, size_t to_size);
+
+	//-- internals --
+	MappedFile file;
+	ChunkSpan< Entry > entries;
+	ChunkSpan< uint32_t > slots;
+	ChunkSpan< char > names;
+	std::unique_ptr< std::atomic< bool >[] > checked; //per entry: content hash checked?
+};
+
+//Mount a pack, so MappedFile looks for files under 'prefix' (by default, the pack's directory) in it:
+// (later mounts are searched first; returns false -- and mounts nothing -- if 'filename' doesn't exist)
+bool mount_asset_pack(std::string const &filename, std::string const &prefix = "");
+
+//Look up a file in the mounted packs (used by MappedFile):
+// (returns false if not found; otherwise sets 'data' -- held alive by 'holder' -- to the contents)
+bool find_in_asset_packs(std::string const &filename, std::string_view *data, std::shared_ptr< void const > *holder);
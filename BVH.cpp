@@ -0,0 +1,278 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <future>
+
+namespace {
+
+//Item being sorted into the tree; build() shuffles these around directly (rather than indices into the
+// caller's boxes) so that each pass over a node's items reads memory in order:
+struct Ref {
+	BVH::Box box;
+	glm::vec3 centroid;
+	uint32_t item;
+};
+
+//Builds the nodes for one subtree; 'refs' ranges belonging to different subtrees never overlap,
+// so subtrees can be built on separate threads.
+struct Builder {
+	std::vector< Ref > &refs;
+
+	enum : uint32_t { Bins = 16 };
+
+	//append nodes for refs[first, first+count) to 'out' (depth-first):
+	void build(std::vector< BVH::Node > &out, uint32_t first, uint32_t count, uint32_t depth) const {
+		BVH::Box bounds, centroid_bounds;
+		for (uint32_t i = first; i < first + count; ++i) {
+			bounds.expand(refs[i].box);
+			centroid_bounds.expand(refs[i].centroid);
+		}
+
+		uint32_t index = uint32_t(out.size());
+		out.emplace_back();
+		out[index].min = bounds.min;
+		out[index].max = bounds.max;
+
+		auto make_leaf = [&]() {
+			out[index].index = first;
+			out[index].count = count;
+		};
+
+		if (count <= BVH::LeafSize) {
+			make_leaf();
+			return;
+		}
+
+		uint32_t mid = split(bounds, centroid_bounds, first, count, depth);
+		if (mid == first) {
+			make_leaf();
+			return;
+		}
+
+		//internal node:
+		out[index].count = 0;
+		uint32_t left_count = mid - first;
+		uint32_t right_count = count - left_count;
+		if (count >= BVH::ParallelThreshold && depth < 4) {
+			//build the right subtree on another thread, then append it:
+			std::vector< BVH::Node > right;
+			std::future< void > right_built = std::async(std::launch::async, [&]() {
+				build(right, mid, right_count, depth + 1);
+			});
+			build(out, first, left_count, depth + 1);
+			right_built.get();
+
+			uint32_t offset = uint32_t(out.size());
+			out[index].index = offset;
+			for (BVH::Node &node : right) {
+				if (node.count == 0) node.index += offset;
+				out.emplace_back(node);
+			}
+		} else {
+			build(out, first, left_count, depth + 1);
+			out[index].index = uint32_t(out.size());
+			build(out, mid, right_count, depth + 1);
+		}
+	}
+
+	//partition refs[first, first+count) and return the start of the right half, or 'first' to make a leaf:
+	uint32_t split(BVH::Box const &bounds, BVH::Box const &centroid_bounds, uint32_t first, uint32_t count, uint32_t depth) const {
+		glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+
+		//near the depth limit (or if the SAH can't find anything), split at the median of the longest axis:
+		auto median_split = [&]() {
+			uint32_t axis = 0;
+			if (extent[1] > extent[axis]) axis = 1;
+			if (extent[2] > extent[axis]) axis = 2;
+			uint32_t mid = first + count / 2;
+			std::nth_element(refs.begin() + first, refs.begin() + mid, refs.begin() + first + count,
+				[axis](Ref const &a, Ref const &b) { return a.centroid[axis] < b.centroid[axis]; });
+			return mid;
+		};
+		if (depth + 32 >= BVH::MaxDepth) return median_split();
+
+		//binned surface area heuristic:
+		// cost of a split ~= 1 (for the node) + sum over children of (area / parent area) * items
+		//(only along the longest axis of the centroids' bounds -- binning is most of the build time, and that's
+		// almost always where the best split is anyway; bins are plain float arrays to keep the loop tight)
+		uint32_t axis = 0;
+		if (extent[1] > extent[axis]) axis = 1;
+		if (extent[2] > extent[axis]) axis = 2;
+		if (!(extent[axis] > 0.0f)) {
+			//all centroids in the same place:
+			if (count <= BVH::MaxLeafSize) return first;
+			return median_split();
+		}
+		float min = centroid_bounds.min[axis];
+		float scale = Bins / extent[axis];
+
+		struct Bin {
+			float min[3] = { std::numeric_limits< float >::infinity(), std::numeric_limits< float >::infinity(), std::numeric_limits< float >::infinity() };
+			float max[3] = { -std::numeric_limits< float >::infinity(), -std::numeric_limits< float >::infinity(), -std::numeric_limits< float >::infinity() };
+			uint32_t count = 0;
+		};
+		Bin bins[Bins];
+		for (uint32_t i = first; i < first + count; ++i) {
+			Ref const &ref = refs[i];
+			Bin &bin = bins[bin_of(ref.centroid[axis], min, scale)];
+			for (uint32_t c = 0; c < 3; ++c) {
+				bin.min[c] = std::min(bin.min[c], ref.box.min[c]);
+				bin.max[c] = std::max(bin.max[c], ref.box.max[c]);
+			}
+			bin.count += 1;
+		}
+		auto expand = [](BVH::Box &box, Bin const &bin) {
+			box.expand(BVH::Box{glm::vec3(bin.min[0], bin.min[1], bin.min[2]), glm::vec3(bin.max[0], bin.max[1], bin.max[2])});
+		};
+
+		//sweep from the right to get the area/count of everything right of each split:
+		float right_area[Bins];
+		uint32_t right_count[Bins];
+		BVH::Box acc;
+		uint32_t acc_count = 0;
+		for (uint32_t b = Bins - 1; b > 0; --b) {
+			expand(acc, bins[b]);
+			acc_count += bins[b].count;
+			right_area[b] = (acc_count ? acc.half_area() : 0.0f);
+			right_count[b] = acc_count;
+		}
+		//...then from the left, evaluating the split before each bin b:
+		float best_cost = std::numeric_limits< float >::infinity();
+		uint32_t best_bin = 0;
+		acc = BVH::Box();
+		acc_count = 0;
+		for (uint32_t b = 1; b < Bins; ++b) {
+			expand(acc, bins[b - 1]);
+			acc_count += bins[b - 1].count;
+			if (acc_count == 0 || right_count[b] == 0) continue;
+			float cost = acc.half_area() * acc_count + right_area[b] * right_count[b];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_bin = b;
+			}
+		}
+
+		float area = bounds.half_area();
+		float split_cost = 1.0f + (area > 0.0f ? best_cost / area : std::numeric_limits< float >::infinity());
+		if (!(split_cost < float(count))) {
+			//splitting doesn't look worth it:
+			if (count <= BVH::MaxLeafSize) return first;
+			if (best_cost == std::numeric_limits< float >::infinity()) return median_split();
+		}
+
+		auto mid = std::partition(refs.begin() + first, refs.begin() + first + count, [&](Ref const &ref) {
+			return bin_of(ref.centroid[axis], min, scale) < best_bin;
+		});
+		return uint32_t(mid - refs.begin());
+	}
+
+	static uint32_t bin_of(float c, float min, float scale) {
+		int32_t bin = int32_t((c - min) * scale);
+		return uint32_t(std::min(std::max(bin, 0), int32_t(Bins) - 1));
+	}
+};
+
+} //namespace
+
+void BVH::build(std::vector< Box > const &boxes) {
+	clear();
+
+	std::vector< Ref > refs;
+	refs.reserve(boxes.size());
+	for (uint32_t i = 0; i < boxes.size(); ++i) {
+		if (boxes[i].empty()) continue;
+		refs.emplace_back(Ref{boxes[i], boxes[i].center(), i});
+	}
+	if (refs.empty()) return;
+
+	nodes.reserve(2 * (refs.size() / LeafSize) + 1);
+	Builder builder{refs};
+	builder.build(nodes, 0, uint32_t(refs.size()), 0);
+
+	//leaves refer to ranges of refs, which are now in leaf order:
+	items.resize(refs.size());
+	item_boxes.resize(refs.size());
+	for (uint32_t i = 0; i < refs.size(); ++i) {
+		items[i] = refs[i].item;
+		item_boxes[i] = refs[i].box;
+	}
+}
+
+void BVH::refit(std::vector< Box > const &boxes) {
+	if (nodes.empty()) return;
+
+	//children are always stored after their parents, so a backward sweep visits children first;
+	// the subtree rooted at 'root' is stored in nodes[root, end):
+	auto refit_subtree = [this,&boxes](uint32_t root) {
+		uint32_t end = root;
+		while (nodes[end].count == 0) end = nodes[end].index; //(last node is the rightmost leaf)
+		end += 1;
+		for (uint32_t i = end; i-- > root; ) {
+			Node &node = nodes[i];
+			Box box;
+			if (node.count) {
+				for (uint32_t j = node.index; j < node.index + node.count; ++j) {
+					item_boxes[j] = boxes[items[j]];
+					box.expand(item_boxes[j]);
+				}
+			} else {
+				Node const &a = nodes[i + 1];
+				Node const &b = nodes[node.index];
+				box.min = glm::min(a.min, b.min);
+				box.max = glm::max(a.max, b.max);
+			}
+			node.min = box.min;
+			node.max = box.max;
+		}
+	};
+
+	if (items.size() < ParallelThreshold) {
+		refit_subtree(0);
+		return;
+	}
+
+	//refit the subtrees a few levels down on separate threads, then fix up the nodes above them:
+	constexpr uint32_t SplitDepth = 3;
+	std::vector< uint32_t > roots;
+	std::function< void(uint32_t, uint32_t) > collect = [&](uint32_t i, uint32_t depth) {
+		if (nodes[i].count || depth == SplitDepth) {
+			roots.emplace_back(i);
+		} else {
+			collect(i + 1, depth + 1);
+			collect(nodes[i].index, depth + 1);
+		}
+	};
+	collect(0, 0);
+
+	std::vector< std::future< void > > refits;
+	refits.reserve(roots.size());
+	for (uint32_t root : roots) {
+		refits.emplace_back(std::async(std::launch::async, refit_subtree, root));
+	}
+	for (auto &refit : refits) {
+		refit.get();
+	}
+
+	std::function< void(uint32_t, uint32_t) > fix = [&](uint32_t i, uint32_t depth) {
+		Node &node = nodes[i];
+		if (node.count || depth == SplitDepth) return;
+		fix(i + 1, depth + 1);
+		fix(node.index, depth + 1);
+		node.min = glm::min(nodes[i + 1].min, nodes[node.index].min);
+		node.max = glm::max(nodes[i + 1].max, nodes[node.index].max);
+	};
+	fix(0, 0);
+}
+
+float BVH::ray_box(glm::vec3 const &origin, glm::vec3 const &inv_direction, glm::vec3 const &min, glm::vec3 const &max, float max_t) {
+	//slab test:
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 t_enter = glm::min(t0, t1);
+	glm::vec3 t_exit = glm::max(t0, t1);
+	float enter = std::max(std::max(t_enter.x, t_enter.y), std::max(t_enter.z, 0.0f));
+	float exit = std::min(std::min(t_exit.x, t_exit.y), std::min(t_exit.z, max_t));
+	if (enter <= exit) return enter;
+	else return std::numeric_limits< float >::infinity();
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+/*
+ * BVH is a bounding volume hierarchy over a list of axis-aligned boxes,
+ * built with the surface area heuristic and stored as a flat array of nodes
+ * in depth-first order (a node's left child is the node right after it):
+ *
+ * std::vector< BVH::Box > boxes = ...;
+ * BVH bvh;
+ * bvh.build(boxes);
+ * bvh.query_frustum(frustum, [&](uint32_t item){ ... boxes[item] is (at least partly) visible ... });
+ *
+ * //later, after some boxes move:
+ * bvh.refit(boxes);
+ *
+ * Items are identified by their index in the 'boxes' passed to build();
+ * empty boxes (min > max) are left out of the hierarchy.
+ *
+ * Refitting keeps the tree structure and only recomputes node bounds, so it's
+ * cheap, but the tree gets less efficient the further things move from where
+ * they were at build time; rebuild in that case.
+ *
+ * build() and refit() split large jobs over several threads.
+ */
+
+#include "Frustum.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+struct BVH {
+	struct Box {
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		bool empty() const { return !(min.x <= max.x && min.y <= max.y && min.z <= max.z); }
+		void expand(Box const &o) {
+			min.x = std::min(min.x, o.min.x); min.y = std::min(min.y, o.min.y); min.z = std::min(min.z, o.min.z);
+			max.x = std::max(max.x, o.max.x); max.y = std::max(max.y, o.max.y); max.z = std::max(max.z, o.max.z);
+		}
+		void expand(glm::vec3 const &p) {
+			min.x = std::min(min.x, p.x); min.y = std::min(min.y, p.y); min.z = std::min(min.z, p.z);
+			max.x = std::max(max.x, p.x); max.y = std::max(max.y, p.y); max.z = std::max(max.z, p.z);
+		}
+		glm::vec3 center() const { return 0.5f * (max + min); }
+		glm::vec3 half() const { return 0.5f * (max - min); }
+		float half_area() const {
+			glm::vec3 d = max - min;
+			return d.x * d.y + d.y * d.z + d.z * d.x;
+		}
+	};
+
+	struct Node {
+		glm::vec3 min;
+		uint32_t index; //leaf: first entry in 'items'; internal: right child (left child is this node + 1)
+		glm::vec3 max;
+		uint32_t count; //leaf: number of items; internal: 0
+	};
+	static_assert(sizeof(Node) == 32, "Nodes should pack into 32 bytes");
+
+	std::vector< Node > nodes; //nodes[0] is the root (if there are any items)
+	std::vector< uint32_t > items; //item ids, grouped by leaf
+	std::vector< Box > item_boxes; //boxes of 'items' (same order), so queries can test items without going back to the caller's list
+
+	//build the hierarchy over all non-empty boxes:
+	void build(std::vector< Box > const &boxes);
+	//recompute node bounds after boxes have changed (boxes must be indexed as they were for build()):
+	void refit(std::vector< Box > const &boxes);
+
+	void clear() { nodes.clear(); items.clear(); item_boxes.clear(); }
+	bool empty() const { return nodes.empty(); }
+
+	//tuning:
+	static constexpr uint32_t LeafSize = 4; //try to split leaves bigger than this
+	static constexpr uint32_t MaxLeafSize = 16; //always split leaves bigger than this
+	static constexpr uint32_t MaxDepth = 96; //(build switches to median splits as it approaches this)
+	static constexpr uint32_t ParallelThreshold = 8192; //subtrees with at least this many items are built / refit on separate threads
+
+	//---- queries ----
+	//each calls 'on_item(item)' for matching items (in no particular order)
+
+	//items whose boxes are at least partly inside a frustum:
+	template< typename F >
+	void query_frustum(Frustum const &frustum, F &&on_item) const;
+
+	//items whose boxes overlap a box:
+	template< typename F >
+	void query_box(Box const &box, F &&on_item) const;
+
+	//items whose boxes overlap a sphere:
+	template< typename F >
+	void query_sphere(glm::vec3 const &center, float radius, F &&on_item) const;
+
+	//closest item along a ray:
+	// 'hit(item, enter)' is called for items whose boxes the ray passes through ('enter' is where it enters the box);
+	// it should return the distance (in units of 'direction') to where the ray actually hits 'item', or infinity if it misses
+	// (for box-only tests, just return 'enter')
+	// returns the item hit (or -1U) and sets 't' to the distance; 't' starts as the maximum distance
+	template< typename F >
+	uint32_t raycast(glm::vec3 const &origin, glm::vec3 const &direction, float &t, F &&hit) const;
+
+	//distance along the ray to where it enters 'box' (0 if it starts inside), or infinity if it misses before max_t:
+	static float ray_box(glm::vec3 const &origin, glm::vec3 const &inv_direction, glm::vec3 const &min, glm::vec3 const &max, float max_t);
+};
+
+//----------------------------------------------
+
+template< typename F >
+void BVH::query_frustum(Frustum const &frustum, F &&on_item) const {
+	if (nodes.empty()) return;
+
+	//test a box against the planes in 'planes', removing any planes it is entirely inside:
+	// (a node entirely inside a plane has children entirely inside it as well)
+	auto test = [&frustum](glm::vec3 const &min, glm::vec3 const &max, uint32_t &planes) {
+		glm::vec3 center = 0.5f * (max + min);
+		glm::vec3 half = 0.5f * (max - min);
+		for (uint32_t p = 0; p < 6; ++p) {
+			if (!(planes & (1 << p))) continue;
+			float d = Frustum::distance(frustum.planes[p], center);
+			float r = Frustum::radius(frustum.planes[p], half);
+			if (d + r < 0.0f) return false;
+			if (d - r >= 0.0f) planes &= ~(1 << p);
+		}
+		return true;
+	};
+
+	struct Entry {
+		uint32_t node;
+		uint32_t planes; //planes still to test against
+	};
+	Entry stack[MaxDepth + 2];
+	uint32_t top = 0;
+	stack[top++] = Entry{0, (1 << 6) - 1};
+	while (top) {
+		Entry entry = stack[--top];
+		Node const &node = nodes[entry.node];
+		if (entry.planes && !test(node.min, node.max, entry.planes)) continue;
+		if (node.count) {
+			for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+				uint32_t planes = entry.planes;
+				if (planes == 0 || test(item_boxes[i].min, item_boxes[i].max, planes)) on_item(items[i]);
+			}
+		} else {
+			stack[top++] = Entry{node.index, entry.planes};
+			stack[top++] = Entry{entry.node + 1, entry.planes};
+		}
+	}
+}
+
+//shared traversal for box / sphere queries:
+// 'overlaps(min, max)' says whether a node or item box should be visited / reported
+template< typename Overlaps, typename F >
+void bvh_query(BVH const &bvh, Overlaps &&overlaps, F &&on_item) {
+	if (bvh.nodes.empty()) return;
+	uint32_t stack[BVH::MaxDepth + 2];
+	uint32_t top = 0;
+	stack[top++] = 0;
+	while (top) {
+		uint32_t index = stack[--top];
+		BVH::Node const &node = bvh.nodes[index];
+		if (!overlaps(node.min, node.max)) continue;
+		if (node.count) {
+			for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+				if (overlaps(bvh.item_boxes[i].min, bvh.item_boxes[i].max)) on_item(bvh.items[i]);
+			}
+		} else {
+			stack[top++] = node.index;
+			stack[top++] = index + 1;
+		}
+	}
+}
+
+template< typename F >
+void BVH::query_box(Box const &box, F &&on_item) const {
+	bvh_query(*this, [&box](glm::vec3 const &min, glm::vec3 const &max) {
+		return !(max.x < box.min.x || min.x > box.max.x
+		      || max.y < box.min.y || min.y > box.max.y
+		      || max.z < box.min.z || min.z > box.max.z);
+	}, on_item);
+}
+
+template< typename F >
+void BVH::query_sphere(glm::vec3 const &center, float radius, F &&on_item) const {
+	float radius2 = radius * radius;
+	bvh_query(*this, [&center, radius2](glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 d = glm::max(min - center, glm::max(glm::vec3(0.0f), center - max));
+		return glm::dot(d, d) <= radius2;
+	}, on_item);
+}
+
+template< typename F >
+uint32_t BVH::raycast(glm::vec3 const &origin, glm::vec3 const &direction, float &t, F &&hit) const {
+	if (nodes.empty()) return -1U;
+	constexpr float Miss = std::numeric_limits< float >::infinity();
+	glm::vec3 inv_direction = 1.0f / direction;
+	uint32_t best = -1U;
+
+	struct Entry {
+		uint32_t node;
+		float enter; //where the ray enters the node
+	};
+	Entry stack[MaxDepth + 2];
+	uint32_t top = 0;
+	float root_enter = ray_box(origin, inv_direction, nodes[0].min, nodes[0].max, t);
+	if (root_enter == Miss) return -1U;
+	stack[top++] = Entry{0, root_enter};
+	while (top) {
+		Entry entry = stack[--top];
+		if (entry.enter > t) continue; //(something closer was hit since this was pushed)
+		Node const &node = nodes[entry.node];
+		if (node.count) {
+			for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+				float enter = ray_box(origin, inv_direction, item_boxes[i].min, item_boxes[i].max, t);
+				if (enter == Miss) continue;
+				float item_t = hit(items[i], enter);
+				if (item_t < t) {
+					t = item_t;
+					best = items[i];
+				}
+			}
+		} else {
+			//push the farther child first, so the nearer one is visited first:
+			uint32_t a = entry.node + 1;
+			uint32_t b = node.index;
+			float ta = ray_box(origin, inv_direction, nodes[a].min, nodes[a].max, t);
+			float tb = ray_box(origin, inv_direction, nodes[b].min, nodes[b].max, t);
+			if (ta > tb) {
+				std::swap(a, b);
+				std::swap(ta, tb);
+			}
+			if (tb != Miss) stack[top++] = Entry{b, tb};
+			if (ta != Miss) stack[top++] = Entry{a, ta};
+		}
+	}
+	return best;
+}
@@ -19,4 +19,4 @@ struct ColorTextureProgram {
 	//TEXTURE0 - texture that is accessed by TexCoord
 };
 
-extern Load< ColorTextureProgram > color_texture_program;
+extern Load< ColorTextureProgram > color_texture_program; //(LoadTagLazy -- only built if used)
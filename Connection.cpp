@@ -143,6 +143,7 @@ void poll_connections(
 			if (on_event) on_event(&c, Connection::OnClose);
 		} else { //ret > 0
 			c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
+			c.bytes_received += ret;
 			if (on_event) on_event(&c, Connection::OnRecv);
 		}
 	}
@@ -170,6 +171,7 @@ void poll_connections(
 			if (on_event) on_event(&c, Connection::OnClose);
 		} else { //ret seems reasonable
 			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
+			c.bytes_sent += ret;
 		}
 	}
 
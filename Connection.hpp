@@ -60,6 +60,7 @@ int main(int argc, char **argv) {
 #endif
 //--------- ---------------------------------- ---------
 
+#include <cstdint>
 #include <vector>
 #include <list>
 #include <string>
@@ -88,6 +89,10 @@ struct Connection {
 	//When the connection receives data, it is appended to recv_buffer:
 	std::vector< char > recv_buffer;
 
+	//Running totals of bytes actually received / sent on the socket (e.g., for metrics):
+	uint64_t bytes_received = 0;
+	uint64_t bytes_sent = 0;
+
 	//internals:
 	Socket socket = InvalidSocket;
 
@@ -3,23 +3,24 @@
 #include "ColorProgram.hpp"
 
 #include "gl_errors.hpp"
+#include "StreamBuffer.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-//All DrawLines instances share a vertex array object and vertex buffer, initialized at load time:
+#include <cstring>
+
+//All DrawLines instances share a vertex array object, initialized at load time;
+// vertices are streamed through the shared stream_vertex_buffer() ring:
 
 //n.b. declared static so they don't conflict with similarly named global variables elsewhere:
-static GLuint vertex_buffer = 0;
 static GLuint vertex_buffer_for_color_program = 0;
 
+//vertex lists are recycled between DrawLines instances, so drawing doesn't allocate once they've grown large enough:
+static std::vector< std::vector< DrawLines::Vertex > > spare_attribs;
+
 static Load< void > setup_buffers(LoadTagDefault, [](){
 	//you may recognize this init code from DrawSprites.cpp:
 
-	{ //set up vertex buffer:
-		glGenBuffers(1, &vertex_buffer);
-		//for now, buffer will be un-filled.
-	}
-
 	{ //vertex array mapping buffer for color_program:
 		//ask OpenGL to fill vertex_buffer_for_color_program with the name of an unused vertex array object:
 		glGenVertexArrays(1, &vertex_buffer_for_color_program);
@@ -27,8 +28,8 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 		//set vertex_buffer_for_color_program as the current vertex array object:
 		glBindVertexArray(vertex_buffer_for_color_program);
 
-		//set vertex_buffer as the source of glVertexAttribPointer() commands:
-		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+		//set the stream buffer as the source of glVertexAttribPointer() commands:
+		glBindBuffer(GL_ARRAY_BUFFER, stream_vertex_buffer().get_buffer());
 
 		//set up the vertex array object to describe arrays of PongMode::Vertex:
 		glVertexAttribPointer(
@@ -52,7 +53,7 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 		);
 		glEnableVertexAttribArray(color_program->Color_vec4);
 
-		//done referring to vertex_buffer, so unbind it:
+		//done referring to the stream buffer, so unbind it:
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 		//done setting up vertex array object, so unbind it:
@@ -60,10 +61,14 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 	}
 
 	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
-});
+}, "DrawLines buffers");
 
 
 DrawLines::DrawLines(glm::mat4 const &world_to_clip_) : world_to_clip(world_to_clip_) {
+	if (!spare_attribs.empty()) {
+		attribs.swap(spare_attribs.back());
+		spare_attribs.pop_back();
+	}
 }
 
 void DrawLines::draw(glm::vec3 const &a, glm::vec3 const &b, glm::u8vec4 const &color) {
@@ -133,14 +138,22 @@ void DrawLines::draw_text(std::string const &text, glm::vec3 const &anchor_in, g
 }
 
 DrawLines::~DrawLines() {
-	if (attribs.empty()) return;
+	if (!attribs.empty()) submit();
+
+	//hand the vertex list on to the next DrawLines:
+	attribs.clear();
+	spare_attribs.emplace_back(std::move(attribs));
+}
 
+void DrawLines::submit() {
 	//based on DrawSprites.cpp :
 
-	//upload vertices to vertex_buffer:
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
-	glBufferData(GL_ARRAY_BUFFER, attribs.size() * sizeof(attribs[0]), attribs.data(), GL_STREAM_DRAW); //upload attribs array
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//copy vertices into the stream buffer:
+	// (aligned to the vertex size, so the offset is a whole number of vertices)
+	StreamBuffer &stream = stream_vertex_buffer();
+	StreamBuffer::Span span = stream.map(attribs.size() * sizeof(attribs[0]), sizeof(attribs[0]));
+	std::memcpy(span.data, attribs.data(), span.size);
+	stream.unmap();
 
 	//set color_program as current program:
 	glUseProgram(color_program->program);
@@ -152,7 +165,7 @@ DrawLines::~DrawLines() {
 	glBindVertexArray(vertex_buffer_for_color_program);
 
 	//run the OpenGL pipeline:
-	glDrawArrays(GL_LINES, 0, GLsizei(attribs.size()));
+	glDrawArrays(GL_LINES, GLint(span.offset / sizeof(attribs[0])), GLsizei(attribs.size()));
 
 	//reset vertex array to none:
 	glBindVertexArray(0);
@@ -45,4 +45,7 @@ struct DrawLines {
 	};
 	std::vector< Vertex > attribs;
 
+	//upload + draw attribs (called by the destructor):
+	void submit();
+
 };
@@ -0,0 +1,750 @@
+#include "DrawList.hpp"
+#include "StreamBuffer.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DRAWLIST_SSE 1
+#else
+#define DRAWLIST_SSE 0
+#endif
+
+//-------------------------
+
+namespace {
+struct GLDrawBackend : DrawBackend {
+	virtual void use_program(GLuint program) override { glUseProgram(program); }
+	virtual void bind_vertex_array(GLuint vao) override { glBindVertexArray(vao); }
+	virtual void active_texture(uint32_t unit) override { glActiveTexture(GL_TEXTURE0 + unit); }
+	virtual void bind_texture(GLenum target, GLuint texture) override { glBindTexture(target, texture); }
+	virtual void uniform_mat4(GLuint location, glm::mat4 const &value) override {
+		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+	virtual void uniform_mat4x3(GLuint location, glm::mat4x3 const &value) override {
+		glUniformMatrix4x3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+	virtual void uniform_mat3(GLuint location, glm::mat3 const &value) override {
+		glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+	virtual void draw_arrays(GLenum type, GLuint start, GLuint count) override { glDrawArrays(type, start, count); }
+	virtual void draw_elements(GLenum type, GLenum index_type, GLuint start, GLuint count, GLint base_vertex) override {
+		glDrawElementsBaseVertex(type, count, index_type, index_offset(index_type, start), base_vertex);
+	}
+	static void const *index_offset(GLenum index_type, GLuint start) {
+		return (GLbyte *)0 + size_t(start) * (index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+	}
+
+	typedef Scene::Drawable::Pipeline::Instanced Instanced;
+
+	//per-frame data goes through rings of buffer space:
+	// (instances share the vertex ring with other streamed geometry; the uniform ring -- and the
+	//  frame block's buffer -- are never freed: this backend lives until exit, which is after the GL context is gone)
+	GLintptr instance_offset = 0; //where the last upload_instances() put its data
+	StreamBuffer *uniform_stream = nullptr;
+	GLintptr draw_blocks_offset = 0; //where the last upload_draw_blocks() put draws[0]
+	GLsizeiptr block_stride = 0; //sizeof(DrawBlock), rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	//the frame block has a buffer of its own, since it usually stays put across many submits
+	// (spans of the ring are only good until the next map):
+	GLuint frame_buffer = 0;
+
+	virtual void upload_instances(Instanced::InstanceData const *data, size_t count) override {
+		StreamBuffer &instance_stream = stream_vertex_buffer();
+		GLsizeiptr size = GLsizeiptr(count * sizeof(Instanced::InstanceData));
+		StreamBuffer::Span span = instance_stream.map(size, sizeof(float));
+		std::memcpy(span.data, data, size);
+		instance_stream.unmap();
+		instance_offset = span.offset;
+	}
+
+	virtual void upload_frame_block(Scene::FrameBlock const &frame) override {
+		if (!frame_buffer) glGenBuffers(1, &frame_buffer);
+		//(re-specifying the whole buffer lets the driver hand out fresh storage instead of waiting on draws that use the old block)
+		glBindBuffer(GL_UNIFORM_BUFFER, frame_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(frame), &frame, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, Scene::FrameBlockBinding, frame_buffer);
+	}
+
+	virtual void upload_draw_blocks(Scene::DrawBlock const *draws, size_t count) override {
+		if (!uniform_stream) {
+			uniform_stream = new StreamBuffer(GL_UNIFORM_BUFFER, 4 << 20);
+			GLint alignment = 0;
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+			alignment = std::max(alignment, GLint(16));
+			block_stride = (GLsizeiptr(sizeof(Scene::DrawBlock)) + alignment - 1) / alignment * alignment;
+		}
+
+		//one draw block per stride:
+		StreamBuffer::Span span = uniform_stream->map(block_stride * GLsizeiptr(count), block_stride);
+		for (size_t i = 0; i < count; ++i) {
+			std::memcpy(reinterpret_cast< char * >(span.data) + block_stride * i, &draws[i], sizeof(Scene::DrawBlock));
+		}
+		uniform_stream->unmap();
+		draw_blocks_offset = span.offset;
+	}
+
+	virtual void bind_draw_block(uint32_t index) override {
+		glBindBufferRange(GL_UNIFORM_BUFFER, Scene::DrawBlockBinding, uniform_stream->buffer, draw_blocks_offset + block_stride * index, sizeof(Scene::DrawBlock));
+	}
+
+	virtual void draw_arrays_instanced(GLenum type, GLuint start, GLuint count, uint32_t first_instance, uint32_t instances) override {
+		bind_instances(first_instance);
+		glDrawArraysInstanced(type, start, count, instances);
+		unbind_instances();
+	}
+
+	virtual void draw_elements_instanced(GLenum type, GLenum index_type, GLuint start, GLuint count, GLint base_vertex, uint32_t first_instance, uint32_t instances) override {
+		bind_instances(first_instance);
+		glDrawElementsInstancedBaseVertex(type, count, index_type, index_offset(index_type, start), instances, base_vertex);
+		unbind_instances();
+	}
+
+	void bind_instances(uint32_t first_instance) {
+		//point the per-instance attributes of the currently bound vertex array at this batch's data:
+		// (GL 3.3 has no base-instance draws, so the offset goes into the pointers)
+		GLsizei stride = GLsizei(sizeof(Instanced::InstanceData));
+		size_t base = size_t(instance_offset) + size_t(first_instance) * sizeof(Instanced::InstanceData);
+		auto attrib = [&](GLuint location, size_t offset) {
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (GLbyte *)0 + base + offset);
+			glVertexAttribDivisor(location, 1);
+			glEnableVertexAttribArray(location);
+		};
+		glBindBuffer(GL_ARRAY_BUFFER, stream_vertex_buffer().buffer);
+		for (GLuint c = 0; c < 4; ++c) {
+			attrib(Instanced::AttribLocation + c, offsetof(Instanced::InstanceData, object_to_world) + c * sizeof(glm::vec3));
+		}
+		for (GLuint c = 0; c < 3; ++c) {
+			attrib(Instanced::AttribLocation + 4 + c, offsetof(Instanced::InstanceData, normal_to_world) + c * sizeof(glm::vec3));
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void unbind_instances() {
+		//the vertex array belongs to the mesh, which also gets drawn without instancing, so leave it as it was:
+		for (GLuint l = 0; l < 7; ++l) {
+			glDisableVertexAttribArray(Instanced::AttribLocation + l);
+			glVertexAttribDivisor(Instanced::AttribLocation + l, 0);
+		}
+	}
+};
+}
+
+DrawBackend &gl_draw_backend() {
+	static GLDrawBackend backend;
+	return backend;
+}
+
+void DrawBackend::set_frame_block(Scene::FrameBlock const &frame_) {
+	//(compared bit-for-bit, so this errs on the side of uploading)
+	if (has_frame && std::memcmp(&frame, &frame_, sizeof(frame)) == 0) return;
+	upload_frame_block(frame_);
+	frame = frame_;
+	has_frame = true;
+}
+
+//-------------------------
+
+DrawStateCache::DrawStateCache(DrawBackend &backend_) : backend(backend_) {
+}
+
+void DrawStateCache::use_program(GLuint program_) {
+	if (program == program_) {
+		stats.skipped += 1;
+		return;
+	}
+	program = program_;
+	backend.use_program(program);
+	stats.program_changes += 1;
+}
+
+void DrawStateCache::bind_vertex_array(GLuint vao_) {
+	if (vao == vao_) {
+		stats.skipped += 1;
+		return;
+	}
+	vao = vao_;
+	backend.bind_vertex_array(vao);
+	stats.vao_changes += 1;
+}
+
+void DrawStateCache::set_active_unit(uint32_t unit) {
+	if (active_unit == unit) return;
+	active_unit = unit;
+	backend.active_texture(unit);
+}
+
+void DrawStateCache::bind_textures(Scene::Drawable::Pipeline::TextureInfo const (&want)[Scene::Drawable::Pipeline::TextureCount]) {
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		auto &have = textures[i];
+		if (want[i].texture == 0) {
+			//(Scene::draw used to unbind after every draw, so empty units shouldn't see leftovers)
+			if (have.texture != 0) {
+				set_active_unit(i);
+				backend.bind_texture(have.target, 0);
+				have.texture = 0;
+				stats.texture_changes += 1;
+			}
+			continue;
+		}
+		if (have.texture == want[i].texture && have.target == want[i].target) {
+			stats.skipped += 1;
+			continue;
+		}
+		set_active_unit(i);
+		if (have.texture != 0 && have.target != want[i].target) {
+			//binding to a different target wouldn't replace the old binding:
+			backend.bind_texture(have.target, 0);
+		}
+		backend.bind_texture(want[i].target, want[i].texture);
+		have = want[i];
+		stats.texture_changes += 1;
+	}
+}
+
+void DrawStateCache::reset() {
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		if (textures[i].texture != 0) {
+			set_active_unit(i);
+			backend.bind_texture(textures[i].target, 0);
+			textures[i].texture = 0;
+		}
+	}
+	if (active_unit != 0) {
+		backend.active_texture(0);
+		active_unit = 0;
+	}
+	if (program != 0) {
+		backend.use_program(0);
+		program = 0;
+	}
+	if (vao != 0) {
+		backend.bind_vertex_array(0);
+		vao = 0;
+	}
+}
+
+//-------------------------
+
+namespace {
+
+//Culls four drawables at a time; everything is laid out one-array-per-component so that
+// each step works on all four lanes at once:
+struct CullBatch {
+	enum : uint32_t { Lanes = 4 };
+	Scene::Drawable const *drawables[Lanes];
+	uint32_t size = 0;
+
+	//object-space box center / half-extent:
+	alignas(16) float center[3][Lanes];
+	alignas(16) float half[3][Lanes];
+	//object-to-world matrix (column, row):
+	alignas(16) float xf[4][3][Lanes];
+	uint32_t unbounded = 0; //lanes that are visible regardless
+
+	void push(Scene::Drawable const &drawable) {
+		assert(size < Lanes);
+		uint32_t l = size++;
+		drawables[l] = &drawable;
+		glm::vec3 c(0.0f), h(0.0f);
+		if (drawable.bounds_min.x <= drawable.bounds_max.x
+		 && drawable.bounds_min.y <= drawable.bounds_max.y
+		 && drawable.bounds_min.z <= drawable.bounds_max.z) {
+			c = 0.5f * (drawable.bounds_max + drawable.bounds_min);
+			h = 0.5f * (drawable.bounds_max - drawable.bounds_min);
+		} else {
+			unbounded |= (1 << l);
+		}
+		glm::mat4x3 const &m = drawable.transform->cache.local_to_world;
+		for (uint32_t i = 0; i < 3; ++i) {
+			center[i][l] = c[i];
+			half[i][l] = h[i];
+			for (uint32_t col = 0; col < 4; ++col) {
+				xf[col][i][l] = m[col][i];
+			}
+		}
+	}
+
+	//returns bitmask of lanes at least partly inside the frustum:
+	uint32_t test(Frustum const &frustum) {
+		//pad unused lanes with copies of lane 0:
+		for (uint32_t l = size; l < Lanes; ++l) {
+			for (uint32_t i = 0; i < 3; ++i) {
+				center[i][l] = center[i][0];
+				half[i][l] = half[i][0];
+				for (uint32_t col = 0; col < 4; ++col) xf[col][i][l] = xf[col][i][0];
+			}
+		}
+
+		uint32_t inside;
+#if DRAWLIST_SSE
+		//world-space center = xf * (center, 1); half-extent = |xf3x3| * half:
+		__m128 const sign = _mm_set1_ps(-0.0f);
+		__m128 wc[3], wh[3];
+		for (uint32_t row = 0; row < 3; ++row) {
+			wc[row] = _mm_load_ps(xf[3][row]);
+			wh[row] = _mm_setzero_ps();
+			for (uint32_t col = 0; col < 3; ++col) {
+				__m128 m = _mm_load_ps(xf[col][row]);
+				wc[row] = _mm_add_ps(wc[row], _mm_mul_ps(m, _mm_load_ps(center[col])));
+				wh[row] = _mm_add_ps(wh[row], _mm_mul_ps(_mm_andnot_ps(sign, m), _mm_load_ps(half[col])));
+			}
+		}
+		//box is outside if it is entirely behind any plane:
+		__m128 outside = _mm_setzero_ps();
+		for (auto const &plane : frustum.planes) {
+			__m128 d = _mm_set1_ps(plane.w);
+			__m128 r = _mm_setzero_ps();
+			for (uint32_t i = 0; i < 3; ++i) {
+				d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane[i]), wc[i]));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(std::abs(plane[i])), wh[i]));
+			}
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+		}
+		inside = ~uint32_t(_mm_movemask_ps(outside)) & 0xf;
+#else
+		inside = 0;
+		for (uint32_t l = 0; l < Lanes; ++l) {
+			glm::vec3 wc, wh;
+			for (uint32_t row = 0; row < 3; ++row) {
+				wc[row] = xf[3][row][l];
+				wh[row] = 0.0f;
+				for (uint32_t col = 0; col < 3; ++col) {
+					wc[row] += xf[col][row][l] * center[col][l];
+					wh[row] += std::abs(xf[col][row][l]) * half[col][l];
+				}
+			}
+			if (frustum.overlaps(wc, wh)) inside |= (1 << l);
+		}
+#endif
+		return (inside | unbounded) & ((1 << size) - 1);
+	}
+};
+
+//object matrix * the pipeline's position dequantization (see Pipeline::position_scale / position_offset):
+template< typename Matrix >
+Matrix dequantized(Matrix m, Scene::Drawable::Pipeline const &pipeline) {
+	if (pipeline.position_scale == glm::vec3(1.0f) && pipeline.position_offset == glm::vec3(0.0f)) return m;
+	m[3] += m[0] * pipeline.position_offset.x + m[1] * pipeline.position_offset.y + m[2] * pipeline.position_offset.z;
+	m[0] *= pipeline.position_scale.x;
+	m[1] *= pipeline.position_scale.y;
+	m[2] *= pipeline.position_scale.z;
+	return m;
+}
+
+} //namespace
+
+void normal_matrices(glm::mat4x3 const *in, glm::mat3 *out, size_t count) {
+	//for a matrix with columns a, b, c the inverse transpose has columns (b x c, c x a, a x b) / det,
+	// with det = a . (b x c) -- only cross products and one divide, which vectorize nicely:
+	size_t i = 0;
+#if DRAWLIST_SSE
+	for (; i + 4 <= count; i += 4) {
+		//load four matrices one-array-per-component:
+		alignas(16) float m[3][3][4]; //column, row, lane
+		for (uint32_t l = 0; l < 4; ++l) {
+			for (uint32_t col = 0; col < 3; ++col) {
+				for (uint32_t row = 0; row < 3; ++row) m[col][row][l] = in[i + l][col][row];
+			}
+		}
+		__m128 a[3], b[3], c[3];
+		for (uint32_t row = 0; row < 3; ++row) {
+			a[row] = _mm_load_ps(m[0][row]);
+			b[row] = _mm_load_ps(m[1][row]);
+			c[row] = _mm_load_ps(m[2][row]);
+		}
+		auto cross = [](__m128 const (&x)[3], __m128 const (&y)[3], __m128 (&r)[3]) {
+			r[0] = _mm_sub_ps(_mm_mul_ps(x[1], y[2]), _mm_mul_ps(x[2], y[1]));
+			r[1] = _mm_sub_ps(_mm_mul_ps(x[2], y[0]), _mm_mul_ps(x[0], y[2]));
+			r[2] = _mm_sub_ps(_mm_mul_ps(x[0], y[1]), _mm_mul_ps(x[1], y[0]));
+		};
+		__m128 r[3][3];
+		cross(b, c, r[0]);
+		cross(c, a, r[1]);
+		cross(a, b, r[2]);
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], r[0][0]), _mm_mul_ps(a[1], r[0][1])), _mm_mul_ps(a[2], r[0][2]));
+		__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+		for (uint32_t col = 0; col < 3; ++col) {
+			for (uint32_t row = 0; row < 3; ++row) _mm_store_ps(m[col][row], _mm_mul_ps(r[col][row], inv_det));
+		}
+		for (uint32_t l = 0; l < 4; ++l) {
+			for (uint32_t col = 0; col < 3; ++col) {
+				out[i + l][col] = glm::vec3(m[col][0][l], m[col][1][l], m[col][2][l]);
+			}
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		glm::vec3 a = in[i][0], b = in[i][1], c = in[i][2];
+		glm::vec3 bc = glm::cross(b, c);
+		float inv_det = 1.0f / glm::dot(a, bc);
+		out[i] = glm::mat3(bc * inv_det, glm::cross(c, a) * inv_det, glm::cross(a, b) * inv_det);
+	}
+}
+
+uint64_t DrawList::make_key(Scene::Drawable const &drawable, float depth) {
+	Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+	//GL names are usually small integers, so the low bits of each are enough to group by;
+	// (an occasional collision just makes the order a bit less ideal -- the state cache still checks the real values)
+	uint64_t program = pipeline.program & 0xfff;
+	uint64_t vao = pipeline.vao & 0xfff;
+	uint64_t texture = 0;
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		texture ^= uint64_t(pipeline.textures[i].texture) << (3 * i);
+	}
+	texture &= 0xfff;
+	//mesh ranges aren't small, so hash them down:
+	uint64_t mesh = (uint32_t(drawable.lod_start() * 0x9e3779b1u) ^ uint32_t(drawable.lod_count() * 0x85ebca6bu)) >> 20;
+
+	//for non-negative floats, the bit pattern sorts in the same order as the value:
+	if (!(depth > 0.0f)) depth = 0.0f; //(also catches NaN)
+	uint32_t depth_bits;
+	std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+	return (program << 52) | (vao << 40) | (texture << 28) | (mesh << 16) | uint64_t(depth_bits >> 16);
+}
+
+bool DrawList::same_instance_batch(Scene::Drawable const &a_drawable, Scene::Drawable const &b_drawable) {
+	if (a_drawable.lod_start() != b_drawable.lod_start() || a_drawable.lod_count() != b_drawable.lod_count()) return false;
+	Scene::Drawable::Pipeline const &a = a_drawable.pipeline;
+	Scene::Drawable::Pipeline const &b = b_drawable.pipeline;
+	if (a.program != b.program || a.vao != b.vao) return false;
+	if (a.type != b.type) return false;
+	if (a.index_type != b.index_type || a.base_vertex != b.base_vertex) return false;
+	if (a.position_scale != b.position_scale || a.position_offset != b.position_offset) return false;
+	if (a.instanced.program != b.instanced.program) return false;
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		if (a.textures[i].texture != b.textures[i].texture) return false;
+		if (a.textures[i].texture != 0 && a.textures[i].target != b.textures[i].target) return false;
+	}
+	return true;
+}
+
+void DrawList::clear() {
+	items.clear();
+	stats = Scene::DrawStats();
+}
+
+void DrawList::add(Scene::Drawable const &drawable, float depth) {
+	items.emplace_back(Item{make_key(drawable, depth), &drawable});
+}
+
+void DrawList::add(Scene const &scene, glm::mat4 const &world_to_clip, uint64_t pass, bool cull) {
+	Frustum frustum(world_to_clip);
+
+	//depth of a drawable's origin (clip w is view depth for a perspective projection):
+	auto depth = [&world_to_clip](Scene::Drawable const &drawable) {
+		glm::vec3 const &origin = drawable.transform->cache.local_to_world[3];
+		return world_to_clip[0][3] * origin.x + world_to_clip[1][3] * origin.y + world_to_clip[2][3] * origin.z + world_to_clip[3][3];
+	};
+
+	//level of detail: the simplest level whose error, projected to the screen, is small enough (see Scene::LODPolicy)
+	Scene::LODPolicy const &policy = scene.lod_policy;
+	//(for a projection * rigid view matrix, the length of the clip y row is the projection's y scale)
+	float y_scale = glm::length(glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]));
+	auto select_lod = [&](Scene::Drawable const &drawable) {
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+		if (pipeline.lod_levels == 0 || !policy.enabled) {
+			drawable.lod = 0;
+			return;
+		}
+		glm::mat4x3 const &xf = drawable.transform->cache.local_to_world;
+		glm::vec3 center = glm::vec3(0.0f);
+		if (drawable.bounds_min.x <= drawable.bounds_max.x) center = 0.5f * (drawable.bounds_min + drawable.bounds_max);
+		glm::vec3 world = xf * glm::vec4(center, 1.0f);
+		float w = world_to_clip[0][3] * world.x + world_to_clip[1][3] * world.y + world_to_clip[2][3] * world.z + world_to_clip[3][3];
+		if (!(w > 0.0f)) {
+			//(at or behind the camera plane)
+			drawable.lod = 0;
+			return;
+		}
+		float scale = std::max(glm::length(xf[0]), std::max(glm::length(xf[1]), glm::length(xf[2])));
+		//fraction of the screen's height covered by one object-space unit (the clip y range is two screen heights):
+		float per_unit = 0.5f * y_scale * scale / w;
+		auto screen_error = [&](uint32_t level) {
+			return level == 0 ? 0.0f : pipeline.lods[level - 1].error * per_unit;
+		};
+		uint32_t lod = std::min(drawable.lod, pipeline.lod_levels);
+		while (lod < pipeline.lod_levels && screen_error(lod + 1) <= policy.max_error * (1.0f - policy.hysteresis)) ++lod;
+		while (lod > 0 && screen_error(lod) > policy.max_error * (1.0f + policy.hysteresis)) --lod;
+		drawable.lod = lod;
+	};
+	auto add_visible = [&](Scene::Drawable const &drawable) {
+		select_lod(drawable);
+		if (drawable.lod != 0) stats.simplified += 1;
+		add(drawable, depth(drawable));
+	};
+
+	CullBatch batch;
+	auto flush = [&]() {
+		uint32_t inside = batch.test(frustum);
+		for (uint32_t l = 0; l < batch.size; ++l) {
+			if (inside & (1 << l)) add_visible(*batch.drawables[l]);
+			else stats.culled += 1;
+		}
+		batch.size = 0;
+		batch.unbounded = 0;
+	};
+
+	//drawables with something to draw:
+	auto drawable_ready = [pass](Scene::Drawable const &drawable) {
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+		//skip any drawables without a shader program set:
+		if (pipeline.program == 0) return false;
+		//skip any drawables that don't reference any vertex array:
+		if (pipeline.vao == 0) return false;
+		//skip any drawables that don't contain any vertices:
+		if (pipeline.count == 0) return false;
+
+		assert(drawable.transform); //drawables *must* have a transform
+		drawable.transform->refresh(pass); //(no-op unless the transform belongs to some other scene)
+		return true;
+	};
+
+	//check drawables one (well, four) at a time:
+	auto add_linear = [&](Scene::Drawable const &drawable) {
+		if (!drawable_ready(drawable)) return;
+		stats.drawables += 1;
+		if (!cull) {
+			add_visible(drawable);
+			return;
+		}
+		batch.push(drawable);
+		if (batch.size == CullBatch::Lanes) flush();
+	};
+
+	items.reserve(items.size() + scene.drawables.size());
+
+	Scene::DrawableBVH const &bvh = scene.drawable_bvh;
+	if (!cull || bvh.boxes.empty()) {
+		for (auto const &drawable : scene.drawables) {
+			add_linear(drawable);
+		}
+		if (batch.size) flush();
+		return;
+	}
+
+	//if the scene has a BVH, use it for the drawables it covers:
+	scene.update_bvh(pass);
+	uint32_t reported = 0;
+	bvh.bvh.query_frustum(frustum, [&](uint32_t index) {
+		reported += 1;
+		Scene::Drawable const &drawable = scene.drawables[index];
+		if (!drawable_ready(drawable)) return;
+		stats.drawables += 1;
+		add_visible(drawable);
+	});
+	//(items the BVH didn't report are counted as culled whether or not they had anything to draw)
+	stats.culled += uint32_t(bvh.bvh.items.size()) - reported;
+	stats.drawables += uint32_t(bvh.bvh.items.size()) - reported;
+
+	//...and check the rest one-by-one:
+	for (uint32_t index : bvh.unbounded) {
+		add_linear(scene.drawables[index]);
+	}
+	for (uint32_t index = uint32_t(bvh.boxes.size()); index < scene.drawables.size(); ++index) {
+		add_linear(scene.drawables[index]);
+	}
+	if (batch.size) flush();
+}
+
+void DrawList::sort() {
+	if (items.size() < 2) return;
+	scratch.resize(items.size());
+
+	//count all eight bytes of the key in one pass:
+	uint32_t counts[8][256];
+	std::memset(counts, 0, sizeof(counts));
+	for (auto const &item : items) {
+		for (uint32_t b = 0; b < 8; ++b) {
+			counts[b][(item.key >> (8 * b)) & 0xff] += 1;
+		}
+	}
+
+	//one counting-sort pass per byte, least significant first:
+	for (uint32_t b = 0; b < 8; ++b) {
+		//all keys share this byte? (common for the upper bytes) then this pass wouldn't change anything:
+		if (counts[b][(items[0].key >> (8 * b)) & 0xff] == items.size()) continue;
+
+		uint32_t offsets[256];
+		uint32_t total = 0;
+		for (uint32_t i = 0; i < 256; ++i) {
+			offsets[i] = total;
+			total += counts[b][i];
+		}
+		for (auto const &item : items) {
+			scratch[offsets[(item.key >> (8 * b)) & 0xff]++] = item;
+		}
+		items.swap(scratch);
+	}
+}
+
+void DrawList::submit(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, DrawStateCache &state) const {
+	//find runs of items that can be drawn with one instanced draw:
+	runs.clear();
+	auto can_instance = [](Scene::Drawable::Pipeline const &pipeline) {
+		return pipeline.instanced.program != 0 && pipeline.instanced.base == pipeline.program && !pipeline.set_uniforms;
+	};
+	uint32_t instance_count = 0;
+	for (uint32_t begin = 0; begin < items.size(); ) {
+		Scene::Drawable const &drawable = *items[begin].drawable;
+		uint32_t end = begin + 1;
+		if (can_instance(drawable.pipeline)) {
+			while (end < items.size() && same_instance_batch(drawable, *items[end].drawable)
+				&& !items[end].drawable->pipeline.set_uniforms) ++end;
+		}
+		if (end - begin >= MinInstances) {
+			runs.emplace_back(Run{begin, end, instance_count});
+			instance_count += end - begin;
+		} else {
+			//(merge with a preceding one-by-one run)
+			if (!runs.empty() && runs.back().first_instance == -1U && runs.back().end == begin) runs.back().end = end;
+			else runs.emplace_back(Run{begin, end, -1U});
+		}
+		begin = end;
+	}
+
+	//gather every item's matrix -- object-to-world for instances (the shader applies world-to-light),
+	// object-to-light otherwise -- and compute all of the normal matrices in one batch:
+	matrices.resize(items.size());
+	normals.resize(items.size());
+	for (Run const &run : runs) {
+		for (uint32_t i = run.begin; i < run.end; ++i) {
+			glm::mat4x3 const &object_to_world = items[i].drawable->transform->cache.local_to_world;
+			if (run.first_instance != -1U) matrices[i] = object_to_world;
+			else matrices[i] = world_to_light * glm::mat4(object_to_world);
+		}
+	}
+	normal_matrices(matrices.data(), normals.data(), items.size());
+	//(compact meshes' positions need dequantizing -- but their normals don't, so this comes after the normal matrices)
+	for (uint32_t i = 0; i < items.size(); ++i) {
+		matrices[i] = dequantized(matrices[i], items[i].drawable->pipeline);
+	}
+
+	//...and pack them up for upload:
+	//(std140 pads matrix columns to vec4s)
+	auto columns = [](auto const &m, glm::vec4 (&out)[sizeof(m) / sizeof(glm::vec3)]) {
+		for (uint32_t c = 0; c < sizeof(m) / sizeof(glm::vec3); ++c) out[c] = glm::vec4(m[c], 0.0f);
+	};
+	instances.clear();
+	draw_blocks.clear();
+	for (Run const &run : runs) {
+		for (uint32_t i = run.begin; i < run.end; ++i) {
+			if (run.first_instance != -1U) {
+				instances.emplace_back(Scene::Drawable::Pipeline::Instanced::InstanceData{matrices[i], normals[i]});
+			} else if (items[i].drawable->pipeline.uses_draw_block) {
+				draw_blocks.emplace_back();
+				Scene::DrawBlock &block = draw_blocks.back();
+				block.OBJECT_TO_CLIP = world_to_clip * glm::mat4(dequantized(items[i].drawable->transform->cache.local_to_world, items[i].drawable->pipeline));
+				columns(matrices[i], block.OBJECT_TO_LIGHT);
+				columns(normals[i], block.NORMAL_TO_LIGHT);
+			}
+		}
+	}
+
+	//(the same for every instanced draw)
+	glm::mat3 normal_world_to_light;
+	normal_matrices(&world_to_light, &normal_world_to_light, 1);
+
+	Scene::FrameBlock frame;
+	frame.WORLD_TO_CLIP = world_to_clip;
+	columns(world_to_light, frame.WORLD_TO_LIGHT);
+	columns(normal_world_to_light, frame.NORMAL_WORLD_TO_LIGHT);
+	state.backend.set_frame_block(frame);
+	if (!draw_blocks.empty()) state.backend.upload_draw_blocks(draw_blocks.data(), draw_blocks.size());
+	if (!instances.empty()) state.backend.upload_instances(instances.data(), instances.size());
+
+	uint32_t next_draw_block = 0;
+	for (Run const &run : runs) {
+		if (run.first_instance != -1U) {
+			//draw the whole run at once:
+			Scene::Drawable const &drawable = *items[run.begin].drawable;
+			Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+			Scene::Drawable::Pipeline::Instanced const &instanced = pipeline.instanced;
+
+			state.use_program(instanced.program);
+			state.bind_vertex_array(pipeline.vao);
+
+			if (instanced.WORLD_TO_CLIP_mat4 != -1U) {
+				state.backend.uniform_mat4(instanced.WORLD_TO_CLIP_mat4, world_to_clip);
+			}
+			if (instanced.WORLD_TO_LIGHT_mat4x3 != -1U) {
+				state.backend.uniform_mat4x3(instanced.WORLD_TO_LIGHT_mat4x3, world_to_light);
+			}
+			if (instanced.NORMAL_WORLD_TO_LIGHT_mat3 != -1U) {
+				state.backend.uniform_mat3(instanced.NORMAL_WORLD_TO_LIGHT_mat3, normal_world_to_light);
+			}
+
+			state.bind_textures(pipeline.textures);
+
+			uint32_t count = run.end - run.begin;
+			if (pipeline.index_type != GL_NONE) {
+				state.backend.draw_elements_instanced(pipeline.type, pipeline.index_type, drawable.lod_start(), drawable.lod_count(), pipeline.base_vertex, run.first_instance, count);
+			} else {
+				state.backend.draw_arrays_instanced(pipeline.type, drawable.lod_start(), drawable.lod_count(), run.first_instance, count);
+			}
+			stats.elements += uint64_t(drawable.lod_count()) * count;
+			stats.drawn += count;
+			stats.instanced += count;
+			stats.draw_calls += 1;
+			continue;
+		}
+
+		for (uint32_t i = run.begin; i < run.end; ++i) {
+			Scene::Drawable const &drawable = *items[i].drawable;
+			//Reference to drawable's pipeline for convenience:
+			Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+			//Set shader program:
+			state.use_program(pipeline.program);
+
+			//Set attribute sources:
+			state.bind_vertex_array(pipeline.vao);
+
+			//Configure program uniforms:
+			if (pipeline.uses_draw_block) {
+				//all three matrices are already in this drawable's block:
+				state.backend.bind_draw_block(next_draw_block++);
+			} else {
+				//OBJECT_TO_CLIP takes vertices from object space to clip space:
+				if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+					glm::mat4 object_to_clip = world_to_clip * glm::mat4(dequantized(drawable.transform->cache.local_to_world, pipeline));
+					state.backend.uniform_mat4(pipeline.OBJECT_TO_CLIP_mat4, object_to_clip);
+				}
+
+				//OBJECT_TO_LIGHT takes vertices from object space to light space:
+				if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+					state.backend.uniform_mat4x3(pipeline.OBJECT_TO_LIGHT_mat4x3, matrices[i]);
+				}
+
+				//NORMAL_TO_LIGHT takes normals from object space to light space:
+				if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+					state.backend.uniform_mat3(pipeline.NORMAL_TO_LIGHT_mat3, normals[i]);
+				}
+			}
+
+			//set any requested custom uniforms:
+			// (these shouldn't change program / vertex array / texture bindings, or the state cache will be wrong)
+			if (pipeline.set_uniforms) pipeline.set_uniforms();
+
+			//set up textures:
+			state.bind_textures(pipeline.textures);
+
+			//draw the object (at its level of detail):
+			if (pipeline.index_type != GL_NONE) {
+				state.backend.draw_elements(pipeline.type, pipeline.index_type, drawable.lod_start(), drawable.lod_count(), pipeline.base_vertex);
+			} else {
+				state.backend.draw_arrays(pipeline.type, drawable.lod_start(), drawable.lod_count());
+			}
+			stats.elements += drawable.lod_count();
+			stats.drawn += 1;
+			stats.draw_calls += 1;
+		}
+	}
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+/*
+ * DrawList collects the drawables for a frame, sorts them by render state
+ * (program, then vertex array, then textures, then mesh, then front-to-back depth),
+ * and submits them through a DrawStateCache that skips redundant binds.
+ *
+ * Runs of drawables that differ only in their transform are submitted as one
+ * instanced draw when their pipeline has an instanced program.
+ *
+ * Scene::draw uses this internally; it's exposed so that the sorting and
+ * state-change logic can also be driven with a different DrawBackend
+ * (e.g., one that just counts calls, without an OpenGL context).
+ */
+
+#include "Scene.hpp"
+#include "Frustum.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//The GL calls needed to submit drawables:
+struct DrawBackend {
+	virtual ~DrawBackend() { }
+	virtual void use_program(GLuint program) = 0;
+	virtual void bind_vertex_array(GLuint vao) = 0;
+	virtual void active_texture(uint32_t unit) = 0; //unit is relative to GL_TEXTURE0
+	virtual void bind_texture(GLenum target, GLuint texture) = 0;
+	virtual void uniform_mat4(GLuint location, glm::mat4 const &value) = 0;
+	virtual void uniform_mat4x3(GLuint location, glm::mat4x3 const &value) = 0;
+	virtual void uniform_mat3(GLuint location, glm::mat3 const &value) = 0;
+	virtual void draw_arrays(GLenum type, GLuint start, GLuint count) = 0;
+	virtual void draw_elements(GLenum type, GLenum index_type, GLuint start, GLuint count, GLint base_vertex) = 0; //'start' is in indices
+
+	//instancing (see Scene::Drawable::Pipeline::Instanced):
+	// replace the contents of the per-instance attribute buffer:
+	virtual void upload_instances(Scene::Drawable::Pipeline::Instanced::InstanceData const *data, size_t count) = 0;
+	// draw 'instances' copies, taking per-instance attributes from the uploaded data starting at 'first_instance':
+	virtual void draw_arrays_instanced(GLenum type, GLuint start, GLuint count, uint32_t first_instance, uint32_t instances) = 0;
+	virtual void draw_elements_instanced(GLenum type, GLenum index_type, GLuint start, GLuint count, GLint base_vertex, uint32_t first_instance, uint32_t instances) = 0;
+
+	//uniform blocks (see Scene::FrameBlock / Scene::DrawBlock):
+	// make 'frame' the block bound at Scene::FrameBlockBinding -- only uploaded if it differs from the last one:
+	void set_frame_block(Scene::FrameBlock const &frame);
+	// upload 'frame' and bind it at Scene::FrameBlockBinding (called by set_frame_block):
+	virtual void upload_frame_block(Scene::FrameBlock const &frame) = 0;
+	// upload the draw blocks for one submit (not called if there are none):
+	virtual void upload_draw_blocks(Scene::DrawBlock const *draws, size_t count) = 0;
+	// bind draws[index] from the last upload at Scene::DrawBlockBinding:
+	virtual void bind_draw_block(uint32_t index) = 0;
+
+	//the frame block last uploaded (valid once has_frame is set):
+	Scene::FrameBlock frame;
+	bool has_frame = false;
+};
+
+//DrawBackend that calls OpenGL:
+DrawBackend &gl_draw_backend();
+
+//DrawBackend that just counts calls (and remembers the bound program / vertex array), for checking
+// the sort and state cache without an OpenGL context (see show-scene --selftest):
+struct CountingDrawBackend : DrawBackend {
+	struct Counts {
+		uint32_t use_program = 0;
+		uint32_t bind_vertex_array = 0;
+		uint32_t active_texture = 0;
+		uint32_t bind_texture = 0; //(including unbinds)
+		uint32_t uniforms = 0; //uniform_mat4 / uniform_mat4x3 / uniform_mat3
+		uint32_t draws = 0; //draw_arrays / draw_elements
+		uint32_t instanced_draws = 0; //draw_arrays_instanced / draw_elements_instanced
+		uint32_t instances = 0; //instances drawn by those
+		uint32_t upload_instances = 0;
+		uint32_t upload_frame_block = 0;
+		uint32_t upload_draw_blocks = 0;
+		uint32_t bind_draw_block = 0;
+	} counts;
+	GLuint program = 0;
+	GLuint vao = 0;
+
+	virtual void use_program(GLuint program_) override { program = program_; counts.use_program += 1; }
+	virtual void bind_vertex_array(GLuint vao_) override { vao = vao_; counts.bind_vertex_array += 1; }
+	virtual void active_texture(uint32_t unit) override { counts.active_texture += 1; }
+	virtual void bind_texture(GLenum target, GLuint texture) override { counts.bind_texture += 1; }
+	virtual void uniform_mat4(GLuint location, glm::mat4 const &value) override { counts.uniforms += 1; }
+	virtual void uniform_mat4x3(GLuint location, glm::mat4x3 const &value) override { counts.uniforms += 1; }
+	virtual void uniform_mat3(GLuint location, glm::mat3 const &value) override { counts.uniforms += 1; }
+	virtual void draw_arrays(GLenum type, GLuint start, GLuint count) override { counts.draws += 1; }
+	virtual void draw_elements(GLenum type, GLenum index_type, GLuint start, GLuint count, GLint base_vertex) override { counts.draws += 1; }
+	virtual void upload_instances(Scene::Drawable::Pipeline::Instanced::InstanceData const *data, size_t count) override { counts.upload_instances += 1; }
+	virtual void draw_arrays_instanced(GLenum type, GLuint start, GLuint count, uint32_t first_instance, uint32_t instances) override {
+		counts.instanced_draws += 1;
+		counts.instances += instances;
+	}
+	virtual void draw_elements_instanced(GLenum type, GLenum index_type, GLuint start, GLuint count, GLint base_vertex, uint32_t first_instance, uint32_t instances) override {
+		counts.instanced_draws += 1;
+		counts.instances += instances;
+	}
+	virtual void upload_frame_block(Scene::FrameBlock const &frame) override { counts.upload_frame_block += 1; }
+	virtual void upload_draw_blocks(Scene::DrawBlock const *draws, size_t count) override { counts.upload_draw_blocks += 1; }
+	virtual void bind_draw_block(uint32_t index) override { counts.bind_draw_block += 1; }
+};
+
+//Tracks bound program / vertex array / textures and only forwards changes:
+struct DrawStateCache {
+	DrawStateCache(DrawBackend &backend);
+
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint vao);
+	//bind the textures a drawable asks for; units it leaves empty are unbound if this cache bound something there:
+	void bind_textures(Scene::Drawable::Pipeline::TextureInfo const (&textures)[Scene::Drawable::Pipeline::TextureCount]);
+
+	//return to the default state (program 0, vertex array 0, no textures bound by this cache, GL_TEXTURE0 active):
+	void reset();
+
+	struct Stats {
+		uint32_t program_changes = 0;
+		uint32_t vao_changes = 0;
+		uint32_t texture_changes = 0;
+		uint32_t skipped = 0; //binds that were already current
+	} stats;
+
+	//internals:
+	DrawBackend &backend;
+	static constexpr GLuint Unknown = -1U;
+	GLuint program = Unknown;
+	GLuint vao = Unknown;
+	uint32_t active_unit = Unknown;
+	Scene::Drawable::Pipeline::TextureInfo textures[Scene::Drawable::Pipeline::TextureCount]; //(texture 0 == nothing bound by us)
+
+	void set_active_unit(uint32_t unit);
+};
+
+//inverse transpose of the upper 3x3 of each matrix (i.e., the matrix for transforming normals):
+// (one pass over the whole batch, four matrices at a time where SSE is available)
+void normal_matrices(glm::mat4x3 const *in, glm::mat3 *out, size_t count);
+
+struct DrawList {
+	struct Item {
+		uint64_t key;
+		Scene::Drawable const *drawable;
+	};
+
+	//remove all items (keeps allocated memory for reuse):
+	void clear();
+
+	//add all drawables with something to draw that are (at least partly) in the view frustum:
+	// 'world_to_clip' is used to find each drawable's depth, to cull, and to pick levels of detail (see Scene::lod_policy)
+	// (culling goes through the scene's BVH, if it has one -- see Scene::build_bvh)
+	// 'pass' is the value returned by scene.update_transforms() this frame
+	void add(Scene const &scene, glm::mat4 const &world_to_clip, uint64_t pass, bool cull = true);
+	void add(Scene::Drawable const &drawable, float depth);
+
+	//order items by key (a stable LSD radix sort):
+	void sort();
+
+	//issue the draws (state changes are counted in 'state.stats'):
+	void submit(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, DrawStateCache &state) const;
+
+	//sort key: program, vertex array, textures, mesh range, depth -- most to least expensive to change:
+	// (mesh range -- at the drawable's current level of detail -- comes before depth so that copies of
+	//  the same mesh end up next to each other, ready for instancing)
+	static uint64_t make_key(Scene::Drawable const &drawable, float depth);
+
+	//can 'a' and 'b' be drawn by the same instanced draw?
+	static bool same_instance_batch(Scene::Drawable const &a, Scene::Drawable const &b);
+	static constexpr uint32_t MinInstances = 2; //shorter runs are drawn one-by-one
+
+	std::vector< Item > items;
+	std::vector< Item > scratch; //(used by sort)
+
+	//used by submit:
+	mutable std::vector< glm::mat4x3 > matrices; //per item: object-to-world (instanced) or object-to-light
+	mutable std::vector< glm::mat3 > normals; //per item: normal matrix for 'matrices'
+	mutable std::vector< Scene::DrawBlock > draw_blocks;
+	struct Run {
+		uint32_t begin, end; //items[begin, end)
+		uint32_t first_instance; //index in 'instances', or -1U to draw the items one-by-one
+	};
+	mutable std::vector< Run > runs;
+	mutable std::vector< Scene::Drawable::Pipeline::Instanced::InstanceData > instances;
+
+	//counts since clear(); add() fills in drawables + culled, submit() the rest:
+	mutable Scene::DrawStats stats;
+};
@@ -0,0 +1,89 @@
+#include "DrawSprites.hpp"
+#include "SpriteProgram.hpp"
+
+#include "gl_errors.hpp"
+#include "StreamBuffer.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstddef>
+#include <cstring>
+
+//All DrawSprites instances share a vertex array object, initialized at load time;
+// sprites are streamed through the shared stream_vertex_buffer() ring:
+
+//n.b. declared static so they don't conflict with similarly named global variables elsewhere:
+static GLuint vertex_buffer_for_sprite_program = 0;
+
+//sprite lists are recycled between DrawSprites instances, so drawing doesn't allocate once they've grown large enough:
+static std::vector< std::vector< DrawSprites::Sprite > > spare_sprites;
+
+static Load< void > setup_buffers(LoadTagDefault, [](){
+	//ask OpenGL to fill vertex_buffer_for_sprite_program with the name of an unused vertex array object:
+	glGenVertexArrays(1, &vertex_buffer_for_sprite_program);
+
+	//set vertex_buffer_for_sprite_program as the current vertex array object:
+	glBindVertexArray(vertex_buffer_for_sprite_program);
+
+	//every attribute advances once per instance (i.e., per sprite) rather than once per vertex:
+	// (the attribute pointers themselves depend on where each batch lands in the stream buffer, so submit() sets them)
+	for (GLuint attribute : { sprite_program->Center_vec2, sprite_program->Radius_vec2, sprite_program->Color_vec4 }) {
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribDivisor(attribute, 1);
+	}
+
+	//done setting up vertex array object, so unbind it:
+	glBindVertexArray(0);
+
+	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
+}, "DrawSprites buffers");
+
+
+DrawSprites::DrawSprites(glm::mat4 const &world_to_clip_) : world_to_clip(world_to_clip_) {
+	if (!spare_sprites.empty()) {
+		sprites.swap(spare_sprites.back());
+		spare_sprites.pop_back();
+	}
+}
+
+DrawSprites::~DrawSprites() {
+	if (!sprites.empty()) submit();
+
+	//hand the sprite list on to the next DrawSprites:
+	spare_sprites.emplace_back(std::move(sprites));
+}
+
+void DrawSprites::submit() {
+	//copy sprites into the stream buffer:
+	StreamBuffer &stream = stream_vertex_buffer();
+	StreamBuffer::Span span = stream.map(sprites.size() * sizeof(Sprite), alignof(Sprite));
+	std::memcpy(span.data, sprites.data(), span.size);
+
+	//point the (per-instance) attributes at this batch:
+	// (GL 3.3 has no "base instance" parameter for draws, so the offset goes into the pointers instead)
+	glBindVertexArray(vertex_buffer_for_sprite_program);
+	auto pointer = [&](GLuint attribute, GLint size, GLenum type, GLboolean normalized, size_t offset) {
+		glVertexAttribPointer(attribute, size, type, normalized, sizeof(Sprite), (GLbyte *)0 + span.offset + offset);
+	};
+	pointer(sprite_program->Center_vec2, 2, GL_FLOAT, GL_FALSE, offsetof(Sprite, Center));
+	pointer(sprite_program->Radius_vec2, 2, GL_FLOAT, GL_FALSE, offsetof(Sprite, Radius));
+	pointer(sprite_program->Color_vec4, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(Sprite, Color));
+	stream.unmap();
+
+	//set sprite_program as current program:
+	glUseProgram(sprite_program->program);
+
+	//upload OBJECT_TO_CLIP to the proper uniform location:
+	glUniformMatrix4fv(sprite_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+
+	//run the OpenGL pipeline -- four strip vertices per sprite:
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(sprites.size()));
+
+	//reset vertex array to none:
+	glBindVertexArray(0);
+
+	//reset current program to none:
+	glUseProgram(0);
+
+	sprites.clear();
+}
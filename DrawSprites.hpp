@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+ * Helper class for immediate-mode drawing of solid-colored, axis-aligned
+ * rectangles ("sprites") -- e.g., the court, players, and ball in PlayMode.
+ *
+ * Similar usage pattern to DrawLines:
+ *
+ * {
+ *     DrawSprites sprites(world_to_clip);
+ *     sprites.draw(center, radius, color);
+ *     ...
+ * } //<-- everything is drawn (in one draw call) here
+ *
+ * Each rectangle is a single 20-byte instance record; the vertex shader
+ * expands it into a quad, so even tens of thousands of sprites are cheap
+ * to upload.
+ */
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct DrawSprites {
+	//Start drawing; will remember world_to_clip matrix:
+	DrawSprites(glm::mat4 const &world_to_clip);
+
+	//draw a rectangle covering center - radius to center + radius (in world space, at z = 0):
+	void draw(glm::vec2 const &center, glm::vec2 const &radius, glm::u8vec4 const &color = glm::u8vec4(0xff)) {
+		sprites.emplace_back(Sprite{center, radius, color});
+	}
+
+	//Finish drawing (push sprites to GPU):
+	~DrawSprites();
+
+	glm::mat4 world_to_clip;
+	struct Sprite {
+		glm::vec2 Center;
+		glm::vec2 Radius;
+		glm::u8vec4 Color;
+	};
+	static_assert(sizeof(Sprite) == 4*2 + 4*2 + 1*4, "DrawSprites::Sprite should be packed");
+	std::vector< Sprite > sprites;
+
+	//upload + draw sprites (called by the destructor; clears 'sprites'):
+	void submit();
+};
@@ -0,0 +1,192 @@
+#include "FrameCapture.hpp"
+
+#include "load_save_png.hpp"
+#include "gl_errors.hpp"
+#include "Trace.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+FrameCapture::FrameCapture() {
+	worker = std::thread(&FrameCapture::work, this);
+}
+
+FrameCapture::~FrameCapture() {
+	//(readbacks that weren't finish()'d are dropped -- the OpenGL context may already be gone -- but queued encodes are still written)
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	cv.notify_all();
+	worker.join();
+}
+
+void FrameCapture::request(std::string const &filename) {
+	requested.emplace_back(filename);
+}
+
+void FrameCapture::start_recording(std::string const &prefix) {
+	record_prefix = prefix;
+	record_frame = 0;
+}
+
+void FrameCapture::stop_recording() {
+	record_prefix.clear();
+}
+
+void FrameCapture::frame_drawn(glm::uvec2 const &size) {
+	if (readbacks.empty() && requested.empty() && !recording()) return;
+	TRACE_SCOPE("FrameCapture::frame_drawn");
+
+	//pass along any earlier frames that have finished reading back:
+	collect(false);
+
+	for (auto const &filename : requested) {
+		start_readback(size, filename);
+	}
+	requested.clear();
+
+	if (recording()) {
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), "-%06u.png", record_frame);
+		record_frame += 1;
+		start_readback(size, record_prefix + suffix);
+	}
+}
+
+void FrameCapture::start_readback(glm::uvec2 const &size, std::string const &filename) {
+	if (size.x == 0 || size.y == 0) return;
+
+	bool behind = (readbacks.size() >= MaxReadbacks);
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		behind = behind || (encodes.size() >= MaxEncodes);
+	}
+	if (behind) {
+		dropped += 1;
+		return;
+	}
+
+	Readback readback;
+	if (!spare.empty()) {
+		readback = std::move(spare.back());
+		spare.pop_back();
+	} else {
+		glGenBuffers(1, &readback.buffer);
+	}
+	readback.size = size;
+	readback.filename = filename;
+
+	GLsizeiptr bytes = GLsizeiptr(size.x) * size.y * sizeof(glm::u8vec4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	if (readback.capacity < bytes) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		readback.capacity = bytes;
+	}
+
+	//with a pixel-pack buffer bound, glReadPixels just queues a copy (the pointer is an offset into the buffer):
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, (GLbyte *)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readbacks.emplace_back(std::move(readback));
+
+	GL_ERRORS();
+}
+
+void FrameCapture::collect(bool wait) {
+	while (!readbacks.empty()) {
+		Readback &readback = readbacks.front();
+
+		GLenum result = glClientWaitSync(readback.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 100000000 : 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			if (wait) continue;
+			break; //(later readbacks finish after this one, so no point checking them)
+		}
+		//(on GL_WAIT_FAILED, mapping below will still wait for the copy)
+		glDeleteSync(readback.fence);
+		readback.fence = 0;
+
+		Encode encode;
+		encode.size = readback.size;
+		encode.filename = std::move(readback.filename);
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			if (!spare_pixels.empty()) {
+				encode.pixels = std::move(spare_pixels.back());
+				spare_pixels.pop_back();
+			}
+		}
+		encode.pixels.resize(size_t(encode.size.x) * encode.size.y);
+
+		GLsizeiptr bytes = GLsizeiptr(encode.pixels.size() * sizeof(glm::u8vec4));
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+		void const *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+		if (data) {
+			std::memcpy(encode.pixels.data(), data, bytes);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		} else {
+			std::cerr << "WARNING: failed to map readback for '" << encode.filename << "'; not saving it." << std::endl;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		spare.emplace_back(std::move(readback));
+		readbacks.pop_front();
+
+		if (data) {
+			std::unique_lock< std::mutex > lock(mutex);
+			encodes.emplace_back(std::move(encode));
+			cv.notify_all();
+		}
+	}
+}
+
+void FrameCapture::finish() {
+	collect(true);
+
+	{ //wait for the worker to write everything:
+		std::unique_lock< std::mutex > lock(mutex);
+		cv.wait(lock, [this](){ return encodes.empty() && encoding == 0; });
+	}
+
+	for (auto &readback : spare) {
+		glDeleteBuffers(1, &readback.buffer);
+	}
+	spare.clear();
+
+	if (dropped) {
+		std::cout << "NOTE: " << dropped << " frame capture(s) were dropped because saving fell behind." << std::endl;
+	}
+}
+
+void FrameCapture::work() {
+	Trace::set_thread_name("frame capture");
+
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		cv.wait(lock, [this](){ return quit || !encodes.empty(); });
+		if (encodes.empty()) break; //(quit, and nothing left to write)
+
+		Encode encode = std::move(encodes.front());
+		encodes.pop_front();
+		encoding += 1;
+		lock.unlock();
+
+		{
+			TRACE_SCOPE("encode png");
+			//the back buffer's alpha channel isn't meaningful, so make the image opaque:
+			for (auto &px : encode.pixels) {
+				px.a = 0xff;
+			}
+			save_png(encode.filename, encode.size, encode.pixels.data(), LowerLeftOrigin);
+		}
+
+		lock.lock();
+		encoding -= 1;
+		if (spare_pixels.size() < MaxEncodes) spare_pixels.emplace_back(std::move(encode.pixels));
+		cv.notify_all();
+	}
+}
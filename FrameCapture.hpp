@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+ * FrameCapture saves drawn frames as PNG files without stalling rendering:
+ *
+ * FrameCapture capture;
+ * capture.request("screenshot.png"); //e.g., on a key press
+ * ...
+ * //every frame, after drawing and before swapping:
+ * capture.frame_drawn(drawable_size);
+ * ...
+ * capture.finish(); //before the OpenGL context goes away
+ *
+ * A captured frame is copied into a pixel-pack buffer by the GPU, fenced, and
+ * only mapped once the fence has passed (usually a frame or two later); the
+ * PNG is then compressed and written on a worker thread.
+ *
+ * With 'recording' on, every frame is captured (as <prefix>-000000.png,
+ * <prefix>-000001.png, ...). If readback or encoding falls behind, frames are
+ * dropped (and counted) rather than queued without limit.
+ */
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FrameCapture {
+	FrameCapture();
+	~FrameCapture();
+
+	FrameCapture(FrameCapture const &) = delete;
+	FrameCapture &operator=(FrameCapture const &) = delete;
+
+	//save the next drawn frame to 'filename':
+	void request(std::string const &filename);
+
+	//save every drawn frame:
+	void start_recording(std::string const &prefix);
+	void stop_recording();
+	bool recording() const { return !record_prefix.empty(); }
+
+	//call after drawing each frame (reads from the back buffer, so call before swapping):
+	void frame_drawn(glm::uvec2 const &size);
+
+	//wait for all captures to be written (needs the OpenGL context):
+	void finish();
+
+	//tuning:
+	static constexpr size_t MaxReadbacks = 4; //frames waiting on the GPU
+	static constexpr size_t MaxEncodes = 4; //frames waiting on the worker
+
+	uint32_t dropped = 0; //captures skipped because readback / encoding was behind
+
+	//internals:
+	std::vector< std::string > requested;
+	std::string record_prefix;
+	uint32_t record_frame = 0;
+
+	struct Readback {
+		GLuint buffer = 0;
+		GLsizeiptr capacity = 0;
+		GLsync fence = 0;
+		glm::uvec2 size = glm::uvec2(0);
+		std::string filename;
+	};
+	std::deque< Readback > readbacks; //in flight, oldest first
+	std::vector< Readback > spare; //pixel-pack buffers that are free for reuse
+
+	//start reading the back buffer into a pixel-pack buffer:
+	void start_readback(glm::uvec2 const &size, std::string const &filename);
+	//hand finished readbacks to the worker ('wait' blocks until all of them finish):
+	void collect(bool wait);
+
+	struct Encode {
+		glm::uvec2 size;
+		std::vector< glm::u8vec4 > pixels;
+		std::string filename;
+	};
+	std::mutex mutex; //guards everything below:
+	std::condition_variable cv;
+	std::deque< Encode > encodes; //waiting for the worker, oldest first
+	size_t encoding = 0; //encodes taken by the worker but not written yet
+	std::vector< std::vector< glm::u8vec4 > > spare_pixels; //pixel arrays returned by the worker
+	bool quit = false;
+
+	std::thread worker;
+	void work();
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+ * Frustum holds the six planes of a view volume, extracted from a
+ * world-to-clip matrix (e.g., camera.make_projection() * world_to_camera):
+ *
+ * Frustum frustum(world_to_clip);
+ * if (frustum.overlaps(center, half_extent)) { ... }
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+
+struct Frustum {
+	//points with dot(plane.xyz, p) + plane.w >= 0 are inside a plane;
+	// (planes may be degenerate, e.g., the far plane of an infinite projection, which everything is inside)
+	glm::vec4 planes[6];
+
+	Frustum(glm::mat4 const &world_to_clip) {
+		//each clip-space bound (-w <= x <= w, etc.) gives a plane in world space:
+		glm::vec4 row[4];
+		for (uint32_t r = 0; r < 4; ++r) {
+			row[r] = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+		}
+		planes[0] = row[3] + row[0]; //left
+		planes[1] = row[3] - row[0]; //right
+		planes[2] = row[3] + row[1]; //bottom
+		planes[3] = row[3] - row[1]; //top
+		planes[4] = row[3] + row[2]; //near
+		planes[5] = row[3] - row[2]; //far
+	}
+
+	//is the (world-space) axis-aligned box with this center / half-extent at least partly inside?
+	bool overlaps(glm::vec3 const &center, glm::vec3 const &half) const {
+		for (auto const &plane : planes) {
+			if (distance(plane, center) + radius(plane, half) < 0.0f) return false;
+		}
+		return true;
+	}
+
+	//signed distance (scaled by the plane normal's length) from a plane to a point:
+	static float distance(glm::vec4 const &plane, glm::vec3 const &point) {
+		return plane.x * point.x + plane.y * point.y + plane.z * point.z + plane.w;
+	}
+	//how far a box with this half-extent reaches along a plane's normal:
+	static float radius(glm::vec4 const &plane, glm::vec3 const &half) {
+		return std::abs(plane.x) * half.x + std::abs(plane.y) * half.y + std::abs(plane.z) * half.z;
+	}
+};
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <glm/glm.hpp>
 
 // Size of the playing field
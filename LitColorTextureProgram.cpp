@@ -4,27 +4,13 @@
 #include "gl_errors.hpp"
 
 Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
+static Scene::Drawable::Pipeline compact_program_pipeline; //(see lit_color_texture_compact_program_pipeline())
 
-Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
-	LitColorTextureProgram *ret = new LitColorTextureProgram();
-
-	//----- build the pipeline template -----
-	lit_color_texture_program_pipeline.program = ret->program;
+//make a 1-pixel white texture to bind by default (shared by both pipeline templates):
+static GLuint white_texture() {
+	static GLuint tex = 0;
+	if (tex != 0) return tex;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
-
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
-
-	//make a 1-pixel white texture to bind by default:
-	GLuint tex;
 	glGenTextures(1, &tex);
 
 	glBindTexture(GL_TEXTURE_2D, tex);
@@ -36,25 +22,115 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
+	return tex;
+}
+
+//----- build a pipeline template -----
+static void build_pipeline(Scene::Drawable::Pipeline *pipeline, LitColorTextureProgram const &program) {
+	pipeline->program = program.program;
+
+	pipeline->uses_draw_block = true; //(object matrices come from the "Draw" block)
+
+	pipeline->instanced.program = program.instanced_program;
+	pipeline->instanced.base = program.program;
 
-	lit_color_texture_program_pipeline.textures[0].texture = tex;
-	lit_color_texture_program_pipeline.textures[0].target = GL_TEXTURE_2D;
+	/* This will be used later if/when we build a light loop into the Scene:
+	pipeline->LIGHT_TYPE_int = program.LIGHT_TYPE_int;
+	pipeline->LIGHT_LOCATION_vec3 = program.LIGHT_LOCATION_vec3;
+	pipeline->LIGHT_DIRECTION_vec3 = program.LIGHT_DIRECTION_vec3;
+	pipeline->LIGHT_ENERGY_vec3 = program.LIGHT_ENERGY_vec3;
+	pipeline->LIGHT_CUTOFF_float = program.LIGHT_CUTOFF_float;
+	*/
+
+	pipeline->textures[0].texture = white_texture();
+	pipeline->textures[0].target = GL_TEXTURE_2D;
+}
 
+Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram();
+	build_pipeline(&lit_color_texture_program_pipeline, *ret);
 	return ret;
-});
+}, "lit_color_texture_program");
 
-LitColorTextureProgram::LitColorTextureProgram() {
+Load< LitColorTextureProgram > lit_color_texture_compact_program(LoadTagLazy, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram(true);
+	build_pipeline(&compact_program_pipeline, *ret);
+	return ret;
+}, "lit_color_texture_compact_program");
+
+Scene::Drawable::Pipeline const &lit_color_texture_compact_program_pipeline() {
+	lit_color_texture_compact_program.get(); //(fills in compact_program_pipeline when it loads)
+	return compact_program_pipeline;
+}
+
+//Vertex normals: plain vec3s, or -- for the compact layout -- octahedral-encoded vec2s
+// (the unit octahedron folded out onto the [-1,1]^2 square; see to_octahedral in Mesh.cpp):
+static std::string normal_glsl(bool compact) {
+	if (!compact) {
+		return
+		"layout(location = 1) in vec3 Normal;\n"
+		"vec3 object_normal() { return Normal; }\n";
+	}
+	return
+		"layout(location = 1) in vec2 Normal;\n"
+		"vec3 object_normal() {\n"
+		"	vec3 n = vec3(Normal, 1.0 - abs(Normal.x) - abs(Normal.y));\n"
+		"	float t = max(-n.z, 0.0);\n" //(unfold the lower hemisphere)
+		"	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);\n"
+		"	return normalize(n);\n"
+		"}\n";
+}
+
+//(the instanced variant below uses the same fragment shader)
+static char const *fragment_shader =
+	"#version 330\n"
+	"uniform sampler2D TEX;\n"
+	"uniform int LIGHT_TYPE;\n"
+	"uniform vec3 LIGHT_LOCATION;\n"
+	"uniform vec3 LIGHT_DIRECTION;\n"
+	"uniform vec3 LIGHT_ENERGY;\n"
+	"uniform float LIGHT_CUTOFF;\n"
+	"in vec3 position;\n"
+	"in vec3 normal;\n"
+	"in vec4 color;\n"
+	"in vec2 texCoord;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	vec3 n = normalize(normal);\n"
+	"	vec3 e;\n"
+	"	if (LIGHT_TYPE == 0) { //point light \n"
+	"		vec3 l = (LIGHT_LOCATION - position);\n"
+	"		float dis2 = dot(l,l);\n"
+	"		l = normalize(l);\n"
+	"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+	"		e = nl * LIGHT_ENERGY;\n"
+	"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
+	"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
+	"	} else if (LIGHT_TYPE == 2) { //spot light \n"
+	"		vec3 l = (LIGHT_LOCATION - position);\n"
+	"		float dis2 = dot(l,l);\n"
+	"		l = normalize(l);\n"
+	"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+	"		float c = dot(l,-LIGHT_DIRECTION);\n"
+	"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
+	"		e = nl * LIGHT_ENERGY;\n"
+	"	} else { //(LIGHT_TYPE == 3) //directional light \n"
+	"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+	"	}\n"
+	"	vec4 albedo = texture(TEX, texCoord) * color;\n"
+	"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
+	"}\n";
+
+LitColorTextureProgram::LitColorTextureProgram(bool compact_) : compact(compact_) {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
+		std::string("#version 330\n")
+		+ Scene::DrawBlockGLSL +
+		"layout(location = 0) in vec4 Position;\n"
+		+ normal_glsl(compact) +
+		"layout(location = 2) in vec4 Color;\n"
+		"layout(location = 3) in vec2 TexCoord;\n"
 		"out vec3 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
@@ -62,49 +138,13 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"void main() {\n"
 		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
 		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	normal = NORMAL_TO_LIGHT * object_normal();\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
 	,
 		//fragment shader:
-		"#version 330\n"
-		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
-		"in vec3 position;\n"
-		"in vec3 normal;\n"
-		"in vec4 color;\n"
-		"in vec2 texCoord;\n"
-		"out vec4 fragColor;\n"
-		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
-		"	}\n"
-		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
-		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
-		"}\n"
+		fragment_shader
 	);
 	//As you can see above, adjacent strings in C/C++ are concatenated.
 	// this is very useful for writing long shader programs inline.
@@ -115,11 +155,10 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
-	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	//the object matrices are in the "Draw" uniform block, which Scene::draw fills in:
+	Scene::bind_uniform_blocks(program);
 
+	//look up the locations of uniforms:
 	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
 	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
 	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
@@ -135,9 +174,54 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
+
+	//Instanced variant -- the same, but with the object's matrices as per-instance attributes:
+	// (locations must match Scene::Drawable::Pipeline::Instanced::AttribLocation; the mesh attributes
+	//  are at fixed locations in both programs so the same vertex array works for either)
+	instanced_program = gl_compile_program(
+		//vertex shader:
+		std::string("#version 330\n")
+		+ Scene::FrameBlockGLSL +
+		"layout(location = 0) in vec4 Position;\n"
+		+ normal_glsl(compact) +
+		"layout(location = 2) in vec4 Color;\n"
+		"layout(location = 3) in vec2 TexCoord;\n"
+		"layout(location = 8) in mat4x3 OBJECT_TO_WORLD;\n"
+		"layout(location = 12) in mat3 NORMAL_TO_WORLD;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec4 color;\n"
+		"out vec2 texCoord;\n"
+		"void main() {\n"
+		"	vec4 world = vec4(OBJECT_TO_WORLD * Position, 1.0);\n"
+		"	gl_Position = WORLD_TO_CLIP * world;\n"
+		"	position = WORLD_TO_LIGHT * world;\n"
+		"	normal = NORMAL_WORLD_TO_LIGHT * (NORMAL_TO_WORLD * object_normal());\n"
+		"	color = Color;\n"
+		"	texCoord = TexCoord;\n"
+		"}\n"
+	,
+		//fragment shader:
+		fragment_shader
+	);
+
+	//(camera matrices are in the "Frame" uniform block)
+	Scene::bind_uniform_blocks(instanced_program);
+
+	instanced_LIGHT_TYPE_int = glGetUniformLocation(instanced_program, "LIGHT_TYPE");
+	instanced_LIGHT_LOCATION_vec3 = glGetUniformLocation(instanced_program, "LIGHT_LOCATION");
+	instanced_LIGHT_DIRECTION_vec3 = glGetUniformLocation(instanced_program, "LIGHT_DIRECTION");
+	instanced_LIGHT_ENERGY_vec3 = glGetUniformLocation(instanced_program, "LIGHT_ENERGY");
+	instanced_LIGHT_CUTOFF_float = glGetUniformLocation(instanced_program, "LIGHT_CUTOFF");
+
+	glUseProgram(instanced_program);
+	glUniform1i(glGetUniformLocation(instanced_program, "TEX"), 0);
+	glUseProgram(0);
 }
 
 LitColorTextureProgram::~LitColorTextureProgram() {
+	glDeleteProgram(instanced_program);
+	instanced_program = 0;
 	glDeleteProgram(program);
 	program = 0;
 }
@@ -5,36 +5,50 @@
 #include "Scene.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
+// (the 'compact' version reads vertices from MeshBuffers with the compact layout -- see MeshBuffer::Layout)
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	LitColorTextureProgram(bool compact = false);
 	~LitColorTextureProgram();
 
+	bool compact;
 	GLuint program = 0;
 
 	//Attribute (per-vertex variable) locations:
 	GLuint Position_vec4 = -1U;
-	GLuint Normal_vec3 = -1U;
+	GLuint Normal_vec3 = -1U; //(a vec2 -- octahedral-encoded -- in the compact version)
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
 
-	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	//Uniform blocks:
+	// "Draw" (at Scene::DrawBlockBinding) has OBJECT_TO_CLIP, OBJECT_TO_LIGHT, NORMAL_TO_LIGHT -- see Scene::DrawBlock
 
-	//lighting:
+	//Uniform (per-invocation variable) locations:
+	// lighting:
 	GLuint LIGHT_TYPE_int = -1U;
 	GLuint LIGHT_LOCATION_vec3 = -1U;
 	GLuint LIGHT_DIRECTION_vec3 = -1U;
 	GLuint LIGHT_ENERGY_vec3 = -1U;
 	GLuint LIGHT_CUTOFF_float = -1U;
+
+	//Instanced variant (per-instance matrices come from vertex attributes; see Scene::Drawable::Pipeline::Instanced):
+	// (uses the "Frame" block, at Scene::FrameBlockBinding, for camera matrices)
+	GLuint instanced_program = 0;
+	// (lighting uniforms need to be set on both programs)
+	GLuint instanced_LIGHT_TYPE_int = -1U;
+	GLuint instanced_LIGHT_LOCATION_vec3 = -1U;
+	GLuint instanced_LIGHT_DIRECTION_vec3 = -1U;
+	GLuint instanced_LIGHT_ENERGY_vec3 = -1U;
+	GLuint instanced_LIGHT_CUTOFF_float = -1U;
 	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
+extern Load< LitColorTextureProgram > lit_color_texture_compact_program; //(LoadTagLazy -- only built if used)
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
+//...or, for meshes from compact MeshBuffers, this one (loads lit_color_texture_compact_program first, if it isn't yet):
+Scene::Drawable::Pipeline const &lit_color_texture_compact_program_pipeline();
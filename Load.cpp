@@ -1,20 +1,227 @@
 #include "Load.hpp"
 
+#include <algorithm>
 #include <array>
-#include <list>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+//Every load function -- tagged or lazy -- is kept in one of these:
+// (a lazy load is just one that isn't in any of the tag lists)
+struct LazyLoad {
+	std::function< void() > prepare; //(empty for one-stage loads)
+	std::function< void() > finish;
+	std::string name;
+
+	//set by whoever runs 'prepare' (under the Workers mutex):
+	bool started = false;
+	bool prepared = false;
+	std::exception_ptr error;
+	float prepare_ms = 0.0f;
+
+	//set when 'finish' is called (main thread only):
+	bool finished = false;
+};
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
+	typedef LazyLoad LoadFunction;
+
+	std::array< std::list< LoadFunction >, MaxLoadTag > &get_load_lists() {
+		static std::array< std::list< LoadFunction >, MaxLoadTag > load_lists;
 		return load_lists;
 	}
+
+	std::list< LazyLoad > &get_lazy_loads() {
+		static std::list< LazyLoad > lazy_loads;
+		return lazy_loads;
+	}
+
+	std::vector< LoadTiming > &get_load_timings() {
+		static std::vector< LoadTiming > load_timings;
+		return load_timings;
+	}
+
+	float ms_since(std::chrono::high_resolution_clock::time_point const &before) {
+		return std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+	}
+
+	//Runs 'prepare' stages, in the order queued, on a few worker threads:
+	// (threads are started as needed and live until exit)
+	struct Workers {
+		~Workers() {
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				quit = true;
+				jobs.clear(); //(don't bother with anything not started yet)
+			}
+			wake.notify_all();
+			for (auto &worker : workers) {
+				worker.join();
+			}
+		}
+
+		//queue a job's 'prepare' (if it hasn't been started already):
+		void push(LoadFunction &job) {
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				if (job.started) return;
+				job.started = true;
+				jobs.emplace_back(&job);
+				//(at least a few threads, even with few cores, since prepares often spend their time waiting on the disk)
+				uint32_t count = std::max(4U, std::thread::hardware_concurrency());
+				if (workers.size() < count && workers.size() < busy + jobs.size()) {
+					workers.emplace_back([this](){ work(); });
+				}
+			}
+			wake.notify_one();
+		}
+
+		void work() {
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				wake.wait(lock, [this](){ return quit || !jobs.empty(); });
+				if (quit) break;
+				LoadFunction *job = jobs.front();
+				jobs.pop_front();
+				++busy;
+				run(*job, lock);
+				--busy;
+			}
+		}
+
+		//run a job's 'prepare' here if it hasn't been started, otherwise wait for it to be done:
+		// (rethrows anything 'prepare' threw)
+		void prepare(LoadFunction &job) {
+			std::unique_lock< std::mutex > lock(mutex);
+			if (!job.started) {
+				job.started = true;
+				run(job, lock);
+			}
+			done.wait(lock, [&job](){ return job.prepared; });
+			if (job.error) std::rethrow_exception(job.error);
+		}
+
+		//(called and returns with 'lock' held)
+		void run(LoadFunction &job, std::unique_lock< std::mutex > &lock) {
+			lock.unlock();
+			auto before = std::chrono::high_resolution_clock::now();
+			std::exception_ptr error;
+			try {
+				job.prepare();
+			} catch (...) {
+				error = std::current_exception();
+			}
+			float elapsed = ms_since(before);
+			lock.lock();
+
+			job.prepared = true;
+			job.error = error;
+			job.prepare_ms = elapsed;
+			done.notify_all();
+		}
+
+		std::mutex mutex;
+		std::condition_variable wake; //for workers: jobs to do (or time to quit)
+		std::condition_variable done; //for everyone else: some job was prepared
+		std::deque< LoadFunction * > jobs;
+		uint32_t busy = 0; //workers running a job
+		bool quit = false;
+		std::vector< std::thread > workers;
+	};
+
+	//(constructed after -- so destroyed before -- the load lists its workers point into)
+	Workers &get_workers() {
+		static Workers workers;
+		return workers;
+	}
+
+	//call a load function's 'finish' (after its 'prepare', if any), noting how long things took:
+	LoadTiming finish(LoadFunction &fn, LoadTag tag) {
+		LoadTiming timing;
+		timing.name = (fn.name.empty() ? "(unnamed)" : fn.name);
+		timing.tag = tag;
+
+		auto before = std::chrono::high_resolution_clock::now();
+		if (fn.prepare) {
+			get_workers().prepare(fn);
+			timing.wait_ms = ms_since(before);
+			timing.prepare_ms = fn.prepare_ms;
+			before = std::chrono::high_resolution_clock::now();
+		}
+		fn.finish();
+		timing.finish_ms = ms_since(before);
+		return timing;
+	}
+
+	void print_timing(std::ostream &out, LoadTiming const &timing) {
+		out << "  " << std::setw(8) << timing.finish_ms << " ms";
+		if (timing.prepare_ms > 0.0f) out << " + " << timing.prepare_ms << " ms prepare (" << timing.wait_ms << " ms waited)";
+		out << "  " << timing.name << "\n";
+	}
+}
+
+void add_load_function(LoadTag tag, std::function< void() > const &fn, std::string const &name) {
+	auto &load_lists = get_load_lists();
+	assert(tag < load_lists.size());
+	load_lists[tag].emplace_back();
+	load_lists[tag].back().finish = fn;
+	load_lists[tag].back().name = name;
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
+void add_load_function(LoadTag tag, std::function< void() > const &prepare, std::function< void() > const &finish, std::string const &name) {
 	auto &load_lists = get_load_lists();
 	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	load_lists[tag].emplace_back();
+	load_lists[tag].back().prepare = prepare;
+	load_lists[tag].back().finish = finish;
+	load_lists[tag].back().name = name;
+}
+
+LazyLoad *add_lazy_load_function(std::function< void() > const &prepare, std::function< void() > const &finish, std::string const &name) {
+	auto &lazy_loads = get_lazy_loads();
+	lazy_loads.emplace_back();
+	lazy_loads.back().prepare = prepare;
+	lazy_loads.back().finish = finish;
+	lazy_loads.back().name = name;
+	return &lazy_loads.back();
+}
+
+void finish_load(LazyLoad *lazy) {
+	assert(lazy);
+	if (lazy->finished) {
+		//(only gets here again if loading failed)
+		if (lazy->error) std::rethrow_exception(lazy->error);
+		throw std::runtime_error("Loading '" + lazy->name + "' failed.");
+	}
+	lazy->finished = true;
+
+	LoadTiming timing;
+	try {
+		timing = finish(*lazy, LoadTagLazy);
+	} catch (...) {
+		if (!lazy->error) lazy->error = std::current_exception();
+		throw;
+	}
+	get_load_timings().emplace_back(timing);
+
+	//(formatted separately, so std::cout's flags and precision are left as they were)
+	std::ostringstream report;
+	report << "Loaded on first use:\n" << std::fixed << std::setprecision(1);
+	print_timing(report, timing);
+	std::cout << report.str();
+	std::cout.flush();
+}
+
+std::vector< LoadTiming > const &load_timings() {
+	return get_load_timings();
 }
 
 void call_load_functions() {
@@ -22,11 +229,44 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
+	auto start = std::chrono::high_resolution_clock::now();
+
 	auto &load_lists = get_load_lists();
+	auto &timings = get_load_timings();
+
+	//start every 'prepare' right away (in tag order, so the ones needed first tend to be done first):
+	uint32_t prepared = 0;
 	for (auto &fn_list : load_lists) {
+		for (auto &fn : fn_list) {
+			if (fn.prepare) {
+				get_workers().push(fn);
+				++prepared;
+			}
+		}
+	}
+
+	//...meanwhile, call everything else here, in order:
+	for (uint32_t tag = 0; tag < load_lists.size(); ++tag) {
+		auto &fn_list = load_lists[tag];
 		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
+			timings.emplace_back(finish(fn_list.front(), LoadTag(tag)));
 			fn_list.pop_front(); //remove from list
 		}
 	}
+
+	float total_ms = ms_since(start);
+
+	//report, slowest first:
+	std::vector< LoadTiming > sorted = timings;
+	std::stable_sort(sorted.begin(), sorted.end(), [](LoadTiming const &a, LoadTiming const &b) {
+		return a.prepare_ms + a.finish_ms > b.prepare_ms + b.finish_ms;
+	});
+	std::ostringstream report; //(as in finish_load)
+	report << "Loaded " << timings.size() << " things in " << std::fixed << std::setprecision(1) << total_ms << " ms"
+		<< " (" << prepared << " prepared on worker threads; " << get_lazy_loads().size() << " more to load on first use):\n";
+	for (auto const &timing : sorted) {
+		print_timing(report, timing);
+	}
+	std::cout << report.str();
+	std::cout.flush();
 }
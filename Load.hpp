@@ -20,27 +20,78 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Things with CPU-side work to do (reading files, decoding, parsing) can be loaded in two stages:
+ *
+ * Load< MeshBuffer > meshes(LoadTagDefault, []() {
+ *     return MeshBuffer::read(data_path("level.pnct")); //on a worker thread -- no OpenGL here!
+ * }, [](std::unique_ptr< MeshBuffer::Data > &data) {
+ *     return new MeshBuffer(std::move(*data)); //on the main (OpenGL) thread
+ * }, "level.pnct");
+ *
+ * Every 'prepare' stage (in every tag) starts on a pool of worker threads as soon as
+ * call_load_functions() is called, so prepare functions mustn't use other Load<>s --
+ * do that in 'finish'. Everything else runs on the main thread, a tag at a time, in the
+ * order it was added; a 'finish' waits for its own 'prepare' if it isn't done yet.
+ * (Things that don't need OpenGL at all -- e.g., Sound::Sample -- can do all their work
+ *  in 'prepare' and just return it from 'finish'.)
+ *
+ * call_load_functions() prints how long each thing took to load (see load_timings()).
+ *
+ * Things that aren't always needed can instead be tagged LoadTagLazy, in which case
+ * call_load_functions() skips them and they are loaded the first time they are used
+ * (dereferenced, or get() is called) -- which must be on the main thread:
+ *
+ * Load< MeshBuffer > bonus_meshes(LoadTagLazy, ...same as above...);
+ *
+ * (A lazy two-stage load runs its 'prepare' right there, on the main thread.)
+ *
  */
 
 #include <functional>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
 	LoadTagDefault,
 	LoadTagLate,
-	MaxLoadTag //<-- just used to track # of load tags
+	MaxLoadTag, //<-- just used to track # of load tags
+	LoadTagLazy = MaxLoadTag //not loaded by call_load_functions(); loaded on first use instead
 };
 
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+// ('name' is used when reporting load times)
+void add_load_function(LoadTag tag, std::function< void() > const &fn, std::string const &name = "");
+
+//...or a function that prepares (on a worker thread) and one that finishes (on the main thread):
+void add_load_function(LoadTag tag, std::function< void() > const &prepare, std::function< void() > const &finish, std::string const &name = "");
 
 //Call all loading functions:
 // (loading functions may throw exceptions if they fail.)
 // (only call *once*)
 void call_load_functions();
 
+//Lazy loads (see above) are added here instead:
+struct LazyLoad; //(one per lazy load)
+LazyLoad *add_lazy_load_function(std::function< void() > const &prepare, std::function< void() > const &finish, std::string const &name = "");
+// (call 'prepare' -- if any -- and then 'finish')
+// (main thread only; throws if loading failed -- again on every call)
+void finish_load(LazyLoad *lazy);
+
+//How long things took during call_load_functions() (and lazy loads, after it):
+struct LoadTiming {
+	std::string name;
+	LoadTag tag;
+	float prepare_ms = 0.0f; //on a worker thread (zero for one-stage loads)
+	float finish_ms = 0.0f; //on the main thread
+	float wait_ms = 0.0f; //main thread waiting for 'prepare' to be done
+};
+std::vector< LoadTiming > const &load_timings();
+
 
 //work-around for MSVC not accepting this as a lambda:
 template< typename T >
@@ -49,22 +100,53 @@ T const *new_T() { return new T; }
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
-		add_load_function(tag, [this,load_fn](){
+	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >, std::string const &name = "") : value(nullptr) {
+		auto fn = [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+		};
+		if (tag == LoadTagLazy) lazy = add_lazy_load_function(nullptr, fn, name);
+		else add_load_function(tag, fn, name);
+	}
+
+	//Two-stage loading: 'prepare()' runs on a worker thread and returns some data, which is
+	// then passed (by reference) to 'finish()' on the main thread, which returns the T:
+	// (the enable_if keeps a name passed to the constructor above from looking like a 'finish')
+	template< typename Prepare, typename Finish, typename = std::enable_if_t< !std::is_convertible< Finish, std::string >::value > >
+	Load(LoadTag tag, Prepare const &prepare, Finish const &finish, std::string const &name = "") : value(nullptr) {
+		using Data = decltype(prepare());
+		//(the prepared data lives here in between)
+		std::shared_ptr< std::unique_ptr< Data > > data = std::make_shared< std::unique_ptr< Data > >();
+		auto prepare_fn = [data,prepare](){
+			data->reset(new Data(prepare()));
+		};
+		auto finish_fn = [this,data,finish](){
+			this->value = finish(**data);
+			data->reset();
+			if (!(this->value)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		};
+		if (tag == LoadTagLazy) lazy = add_lazy_load_function(prepare_fn, finish_fn, name);
+		else add_load_function(tag, prepare_fn, finish_fn, name);
+	}
+
+	//The T (loading it first, if lazy and not loaded yet):
+	T const *get() {
+		if (!value && lazy) finish_load(lazy);
+		return value;
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
-	explicit operator bool() { return value != nullptr; }
-	operator T const *() { return value; }
-	T const &operator*() { return *value; }
-	T const *operator->() { return value; }
+	explicit operator bool() { return get() != nullptr; }
+	operator T const *() { return get(); }
+	T const &operator*() { return *get(); }
+	T const *operator->() { return get(); }
 
 	T const *value;
+	LazyLoad *lazy = nullptr; //(if tagged LoadTagLazy)
 };
 
 
@@ -73,9 +155,8 @@ struct Load {
 template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+	// (not LoadTagLazy -- nothing would ever use it)
+	Load( LoadTag tag, const std::function< void() > &load_fn, std::string const &name = "") {
+		add_load_function(tag, load_fn, name);
 	}
 };
-
-
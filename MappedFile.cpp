@@ -0,0 +1,97 @@
+#include "MappedFile.hpp"
+#include "AssetPack.hpp"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::find_in_pack() {
+	std::string_view contents;
+	if (!find_in_asset_packs(filename, &contents, &holder)) return false;
+	begin = contents.data();
+	length = contents.size();
+	in_pack = true;
+	return true;
+}
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(std::string const &filename_, bool search_packs) : filename(filename_) {
+	if (search_packs && find_in_pack()) return;
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' for reading.");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	file_handle = file;
+	length = size_t(file_size.QuadPart);
+	if (length == 0) return; //(empty files can't be mapped, but there's nothing to map anyway)
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map '" + filename + "'.");
+	}
+	mapping_handle = mapping;
+	begin = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (begin == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map '" + filename + "'.");
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (begin && !in_pack) UnmapViewOfFile(begin);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+}
+
+#else
+
+MappedFile::MappedFile(std::string const &filename_, bool search_packs) : filename(filename_) {
+	if (search_packs && find_in_pack()) return;
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open '" + filename + "' for reading.");
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	length = size_t(info.st_size);
+	if (length == 0) { //(empty files can't be mapped, but there's nothing to map anyway)
+		close(fd);
+		return;
+	}
+
+	void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //(the mapping keeps the file open)
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("Failed to map '" + filename + "'.");
+	}
+	//chunks are read front-to-back, so ask for aggressive read-ahead:
+	madvise(mapped, length, MADV_SEQUENTIAL);
+	begin = reinterpret_cast< char const * >(mapped);
+}
+
+MappedFile::~MappedFile() {
+	if (begin && !in_pack) munmap(const_cast< char * >(begin), length);
+}
+
+#endif
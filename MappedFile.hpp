@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * MappedFile maps a whole file read-only into memory:
+ *
+ * MappedFile file(filename); //throws if the file can't be opened or mapped
+ * ChunkReader chunks(file.data(), file.size(), filename); //(see read_write_chunk.hpp)
+ *
+ * Pages are only read from disk as they are touched, and are shared with the
+ * OS file cache, so nothing is copied until the data is actually used.
+ *
+ * Files in a mounted AssetPack are found there instead (see AssetPack.hpp).
+ */
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+struct MappedFile {
+	MappedFile(std::string const &filename, bool search_packs = true);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *data() const { return begin; }
+	size_t size() const { return length; }
+
+	std::string filename;
+
+	//internals:
+	char const *begin = nullptr;
+	size_t length = 0;
+	bool in_pack = false; //(then nothing to unmap)
+	std::shared_ptr< void const > holder; //(keeps decompressed contents from a pack around)
+	bool find_in_pack();
+	#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
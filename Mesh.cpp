@@ -1,20 +1,190 @@
 #include "Mesh.hpp"
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
 #include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <future>
+#include <thread>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_SSE2 1
+#include <emmintrin.h>
+#endif
 
-	std::ifstream file(filename, std::ios::binary);
+namespace {
+
+//float -> IEEE half (round to nearest even; out-of-range values become infinity):
+uint16_t to_half(float f) {
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t bits = x & 0x7fffffff;
+	if (bits >= 0x7f800000) return uint16_t(sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0)); //inf / nan
+	if (bits >= 0x47800000) return uint16_t(sign | 0x7c00); //too big
+	if (bits < 0x38800000) {
+		//subnormal half (or zero):
+		if (bits < 0x33000000) return uint16_t(sign);
+		uint32_t shift = 126 - (bits >> 23);
+		uint32_t mantissa = (bits & 0x7fffff) | 0x800000;
+		return uint16_t(sign | ((mantissa + (1 << (shift - 1))) >> shift));
+	}
+	//re-bias the exponent and round off the low mantissa bits (a carry into the exponent is correct):
+	return uint16_t(sign | ((bits - 0x38000000 + 0xfff + ((bits >> 13) & 1)) >> 13));
+}
+
+//unit vector -> octahedral encoding (as snorm16 pairs; see the decoding in LitColorTextureProgram):
+glm::i16vec2 to_octahedral(glm::vec3 n) {
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (!(l1 > 0.0f)) return glm::i16vec2(0); //(degenerate normals come out as +z)
+	n /= l1;
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f) {
+		//fold the lower hemisphere over the diagonals:
+		e = glm::vec2(
+			(1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f)
+		);
+	}
+	return glm::i16vec2(
+		int16_t(std::round(glm::clamp(e.x, -1.0f, 1.0f) * 32767.0f)),
+		int16_t(std::round(glm::clamp(e.y, -1.0f, 1.0f) * 32767.0f))
+	);
+}
+
+//grow [*min_, *max_] to hold 'count' positions, 'stride' bytes apart (each followed by at least one more float, as in a Vertex):
+// returns false if any coordinate is NaN or infinite
+bool scan_positions(char const *at, size_t stride, uint32_t count, glm::vec3 *min_, glm::vec3 *max_) {
+#ifdef MESH_SSE2
+	//each load is x, y, z, and the float after them (which ends up in the ignored fourth lane):
+	// (two sets of accumulators, so consecutive vertices don't wait on each other)
+	__m128 min0 = _mm_setr_ps(min_->x, min_->y, min_->z, 0.0f), min1 = min0;
+	__m128 max0 = _mm_setr_ps(max_->x, max_->y, max_->z, 0.0f), max1 = max0;
+	__m128 bad = _mm_setzero_ps(); //(x - x is NaN exactly when x is NaN or infinite)
+	uint32_t v = 0;
+	for (; v + 2 <= count; v += 2) {
+		__m128 p0 = _mm_loadu_ps(reinterpret_cast< float const * >(at + v * stride));
+		__m128 p1 = _mm_loadu_ps(reinterpret_cast< float const * >(at + (v + 1) * stride));
+		min0 = _mm_min_ps(min0, p0);
+		max0 = _mm_max_ps(max0, p0);
+		min1 = _mm_min_ps(min1, p1);
+		max1 = _mm_max_ps(max1, p1);
+		bad = _mm_or_ps(bad, _mm_cmpunord_ps(_mm_sub_ps(p0, p0), _mm_sub_ps(p1, p1)));
+	}
+	if (v < count) {
+		__m128 p0 = _mm_loadu_ps(reinterpret_cast< float const * >(at + v * stride));
+		__m128 d0 = _mm_sub_ps(p0, p0);
+		min0 = _mm_min_ps(min0, p0);
+		max0 = _mm_max_ps(max0, p0);
+		bad = _mm_or_ps(bad, _mm_cmpunord_ps(d0, d0));
+	}
+	float min[4], max[4];
+	_mm_storeu_ps(min, _mm_min_ps(min0, min1));
+	_mm_storeu_ps(max, _mm_max_ps(max0, max1));
+	*min_ = glm::vec3(min[0], min[1], min[2]);
+	*max_ = glm::vec3(max[0], max[1], max[2]);
+	return (_mm_movemask_ps(bad) & 0x7) == 0;
+#else
+	bool finite = true;
+	for (uint32_t v = 0; v < count; ++v) {
+		glm::vec3 p;
+		std::memcpy(&p, at + v * stride, sizeof(p));
+		finite = finite && std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+		*min_ = glm::min(*min_, p);
+		*max_ = glm::max(*max_, p);
+	}
+	return finite;
+#endif
+}
+
+//are all 'count' indices less than 'limit'?
+bool indices_below(uint32_t const *indices, uint32_t count, uint32_t limit) {
+	if (limit == 0) return count == 0;
+	uint32_t i = 0;
+#ifdef MESH_SSE2
+	//(SSE2 only has signed comparisons, so flip the sign bits to compare unsigned values)
+	__m128i const flip = _mm_set1_epi32(std::numeric_limits< int32_t >::min());
+	__m128i const last = _mm_xor_si128(_mm_set1_epi32(int32_t(limit - 1)), flip);
+	__m128i over = _mm_setzero_si128();
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast< __m128i const * >(indices + i)), flip);
+		__m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast< __m128i const * >(indices + i + 4)), flip);
+		over = _mm_or_si128(over, _mm_or_si128(_mm_cmpgt_epi32(a, last), _mm_cmpgt_epi32(b, last)));
+	}
+	if (_mm_movemask_epi8(over) != 0) return false;
+#endif
+	for (; i < count; ++i) {
+		if (indices[i] >= limit) return false;
+	}
+	return true;
+}
+
+//run 'fn(i)' for each i in [0, count) -- on several threads, as runs of about the same number of 'bytes(i)', if there's enough work:
+// (rethrows the first exception thrown by 'fn')
+template< typename B, typename F >
+void parallel_for(uint32_t count, B const &bytes, F const &fn) {
+	constexpr size_t BytesPerThread = 1 << 20; //(enough to be worth starting a thread)
+	size_t total = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		total += bytes(i);
+	}
+	uint32_t threads = uint32_t(std::min< size_t >(std::max(1U, std::thread::hardware_concurrency()), total / BytesPerThread));
+	if (threads <= 1) {
+		for (uint32_t i = 0; i < count; ++i) {
+			fn(i);
+		}
+		return;
+	}
+	std::vector< std::future< void > > runs;
+	size_t done = 0;
+	for (uint32_t t = 0, begin = 0; t < threads && begin < count; ++t) {
+		uint32_t end = begin;
+		if (t + 1 == threads) end = count;
+		while (end < count && done < total * (t + 1) / threads) {
+			done += bytes(end);
+			++end;
+		}
+		if (end == begin) continue; //(an earlier run took this one's share)
+		runs.emplace_back(std::async(std::launch::async, [&fn,begin,end](){
+			for (uint32_t i = begin; i < end; ++i) {
+				fn(i);
+			}
+		}));
+		begin = end;
+	}
+	for (auto &run : runs) {
+		run.get();
+	}
+}
+
+} //namespace
+
+MeshBuffer::Data::Data() = default;
+MeshBuffer::Data::~Data() = default;
+
+MeshBuffer::MeshBuffer(std::string const &filename, Layout layout_) : MeshBuffer(std::move(*read(filename, layout_))) {
+}
+
+std::unique_ptr< MeshBuffer::Data > MeshBuffer::read(std::string const &filename, Layout layout) {
+	std::unique_ptr< Data > ret(new Data);
+	ret->filename = filename;
+	ret->layout = layout;
+	auto &meshes = ret->meshes;
+	auto &names = ret->names;
+
+	//chunks are read straight out of the mapped file (no intermediate copies):
+	ret->file.reset(new MappedFile(filename));
+	MappedFile const &file = *ret->file;
+	ChunkReader chunks(file.data(), file.size(), filename);
 
 	GLuint total = 0;
 
@@ -25,68 +195,308 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		glm::vec2 TexCoord;
 	};
 	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+	ChunkSpan< Vertex > data;
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
-
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	auto has_extension = [&filename](std::string const &extension) {
+		return filename.size() >= extension.size() && filename.substr(filename.size() - extension.size()) == extension;
+	};
+	bool indexed = has_extension(".pnci");
+	ret->indexed = indexed;
 
+	//read data chunk:
+	if (has_extension(".pnct") || indexed) {
+		data = chunks.read< Vertex >("pnct");
 		total = GLuint(data.size()); //store total for later checks on index
-
-		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+		//(converted below, once the meshes -- and so the bounds compact positions are quantized to -- are known)
 	} else {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	//indexed files: indices (relative to each mesh's first vertex) come next:
+	ChunkSpan< uint32_t > indices;
+	if (indexed) {
+		indices = chunks.read< uint32_t >("ind0");
+	}
+
+	ChunkSpan< char > strings = chunks.read< char >("str0");
+	//(keep one copy of the string table for mesh names to refer to)
+	names.assign(strings.begin(), strings.end());
+
+	//vertex range of each mesh (for quantizing compact positions):
+	struct Range {
+		uint32_t vertex_begin, vertex_end;
+		Mesh *mesh;
+	};
+	std::vector< Range > ranges;
+
+	auto add_mesh = [&](std::string_view name, Mesh const &mesh, uint32_t vertex_begin, uint32_t vertex_end) -> Mesh * {
+		auto inserted = meshes.insert(std::make_pair(name, mesh));
+		if (!inserted.second) {
+			std::cerr << "WARNING: mesh name '" << name << "' in filename '" << filename << "' collides with existing mesh." << std::endl;
+			return nullptr;
+		}
+		inserted.first->second.name = Name(name);
+		ranges.emplace_back(Range{vertex_begin, vertex_end, &inserted.first->second});
+		return &inserted.first->second;
+	};
+	auto name_view = [&](uint32_t name_begin, uint32_t name_end) {
+		if (!(name_begin <= name_end && name_end <= strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		return std::string_view(names.data() + name_begin, name_end - name_begin);
+	};
+
+	//per-entry work -- bounds, and checks of the vertices and indices -- done (in parallel) once all entries are read:
+	// (one per index entry, in order; then one per level of detail)
+	struct Check {
+		Mesh *mesh; //compute this mesh's bounds from [vertex_begin, vertex_end), checking positions are finite (nullptr: don't)
+		uint32_t vertex_begin, vertex_end;
+		uint32_t index_begin, index_end; //check these indices are < vertex_end - vertex_begin
+		bool lod; //(for the error message)
+	};
+	std::vector< Check > checks;
+	uint32_t entries = 0; //(checks[0, entries) are for index entries)
 
-	{ //read index chunk, add to meshes:
+	if (!indexed) { //read index chunk, add to meshes:
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_begin, vertex_end;
 		};
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		ChunkSpan< IndexEntry > index = chunks.read< IndexEntry >("idx0");
 
 		for (auto const &entry : index) {
-			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-				throw std::runtime_error("index entry has out-of-range name begin/end");
-			}
+			std::string_view name = name_view(entry.name_begin, entry.name_end);
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+			Mesh *added = add_mesh(name, mesh, entry.vertex_begin, entry.vertex_end);
+			checks.emplace_back(Check{added, entry.vertex_begin, entry.vertex_end, 0, 0, false});
+		}
+		entries = uint32_t(checks.size());
+	} else { //read (indexed) mesh chunk, add to meshes:
+		struct IndexedEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+			uint32_t index_begin, index_end;
+		};
+		static_assert(sizeof(IndexedEntry) == 24, "Indexed entry should be packed");
+
+		ChunkSpan< IndexedEntry > index = chunks.read< IndexedEntry >("idx1");
+
+		//indices are relative to each mesh's first vertex, so they fit in 16 bits unless some mesh is huge:
+		uint32_t largest = 0;
+		for (auto const &entry : index) {
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (!(entry.index_begin <= entry.index_end && entry.index_end <= indices.size())) {
+				throw std::runtime_error("index entry has out-of-range index start/count");
+			}
+			largest = std::max(largest, entry.vertex_end - entry.vertex_begin);
+		}
+		GLenum index_type = (largest <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+
+		//indices to upload:
+		if (index_type == GL_UNSIGNED_SHORT) {
+			ret->converted_indices.resize(indices.size() * sizeof(uint16_t));
+			uint16_t *narrow = reinterpret_cast< uint16_t * >(ret->converted_indices.data());
+			for (uint32_t i = 0; i < indices.size(); ++i) {
+				narrow[i] = uint16_t(indices[i]);
+			}
+			ret->indices = ret->converted_indices.data();
+			ret->indices_size = ret->converted_indices.size();
+		} else {
+			ret->indices = reinterpret_cast< char const * >(indices.data());
+			ret->indices_size = indices.size() * sizeof(uint32_t);
+		}
+
+		for (auto const &entry : index) {
+			Mesh mesh;
+			mesh.type = GL_TRIANGLES;
+			mesh.start = entry.index_begin;
+			mesh.count = entry.index_end - entry.index_begin;
+			mesh.index_type = index_type;
+			mesh.base_vertex = GLint(entry.vertex_begin);
+			Mesh *added = add_mesh(name_view(entry.name_begin, entry.name_end), mesh, entry.vertex_begin, entry.vertex_end);
+			checks.emplace_back(Check{added, entry.vertex_begin, entry.vertex_end, entry.index_begin, entry.index_end, false});
+		}
+		entries = uint32_t(checks.size());
+
+		//(optional) levels of detail for the meshes above:
+		if (chunks.next_is("lod0")) {
+			struct LODEntry {
+				uint32_t mesh; //index in the idx1 chunk
+				uint32_t index_begin, index_end;
+				float error;
+			};
+			static_assert(sizeof(LODEntry) == 16, "LOD entry should be packed");
+
+			ChunkSpan< LODEntry > lods = chunks.read< LODEntry >("lod0");
+			for (auto const &lod : lods) {
+				if (!(lod.mesh < index.size())) {
+					throw std::runtime_error("level of detail entry has out-of-range mesh");
+				}
+				IndexedEntry const &entry = index[lod.mesh];
+				if (!(lod.index_begin <= lod.index_end && lod.index_end <= indices.size())) {
+					throw std::runtime_error("level of detail entry has out-of-range index start/count");
+				}
+				checks.emplace_back(Check{nullptr, entry.vertex_begin, entry.vertex_end, lod.index_begin, lod.index_end, true});
+				//(meshes are found by name, since colliding names weren't added)
+				auto f = meshes.find(name_view(entry.name_begin, entry.name_end));
+				if (f == meshes.end() || f->second.base_vertex != GLint(entry.vertex_begin)) continue;
+				Mesh &mesh = f->second;
+				if (mesh.lod_levels == Mesh::MaxLODs) {
+					std::cerr << "WARNING: mesh '" << f->first << "' in filename '" << filename << "' has more than " << Mesh::MaxLODs << " levels of detail; ignoring the rest." << std::endl;
+					continue;
+				}
+				Mesh::LOD &out = mesh.lods[mesh.lod_levels++];
+				out.start = lod.index_begin;
+				out.count = lod.index_end - lod.index_begin;
+				out.error = lod.error;
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+		}
+	}
+
+	//(optional) bounds of each index entry's vertices, in order -- so they needn't be computed here:
+	if (chunks.next_is("bnd0")) {
+		struct BoundsEntry {
+			glm::vec3 min, max;
+		};
+		static_assert(sizeof(BoundsEntry) == 24, "Bounds entry should be packed");
+
+		ChunkSpan< BoundsEntry > bounds = chunks.read< BoundsEntry >("bnd0");
+		if (bounds.size() != entries) {
+			throw std::runtime_error("Mesh file '" + filename + "' has " + std::to_string(bounds.size()) + " mesh bounds for " + std::to_string(entries) + " meshes.");
+		}
+		auto finite = [](glm::vec3 const &v) {
+			return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+		};
+		for (uint32_t i = 0; i < entries; ++i) {
+			Check &check = checks[i];
+			BoundsEntry const &b = bounds[i];
+			if (check.mesh && check.vertex_begin != check.vertex_end) {
+				if (!(finite(b.min) && finite(b.max) && b.min.x <= b.max.x && b.min.y <= b.max.y && b.min.z <= b.max.z)) {
+					throw std::runtime_error("Mesh file '" + filename + "' has invalid bounds for mesh '" + std::string(check.mesh->name.str()) + "'.");
+				}
+				check.mesh->min = b.min;
+				check.mesh->max = b.max;
 			}
+			check.mesh = nullptr;
 		}
+		ret->bounds_from_file = true;
 	}
 
-	if (file.peek() != EOF) {
+	//compute bounds and check vertices / indices, spread over a few threads for big files:
+	parallel_for(uint32_t(checks.size()), [&](uint32_t i) {
+		Check const &check = checks[i];
+		return (check.mesh ? size_t(check.vertex_end - check.vertex_begin) * sizeof(Vertex) : 0)
+			+ size_t(check.index_end - check.index_begin) * sizeof(uint32_t);
+	}, [&](uint32_t i) {
+		Check const &check = checks[i];
+		if (check.mesh) {
+			if (!scan_positions(reinterpret_cast< char const * >(data.data() + check.vertex_begin), sizeof(Vertex), check.vertex_end - check.vertex_begin, &check.mesh->min, &check.mesh->max)) {
+				throw std::runtime_error("Mesh '" + std::string(check.mesh->name.str()) + "' in file '" + filename + "' has a vertex position that isn't a finite number.");
+			}
+		}
+		if (!indices_below(indices.data() + check.index_begin, check.index_end - check.index_begin, check.vertex_end - check.vertex_begin)) {
+			throw std::runtime_error(check.lod ? "level of detail entry has out-of-range vertex index" : "index entry has out-of-range vertex index");
+		}
+	});
+
+	if (chunks.remaining() != 0) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
+	if (layout == Layout::Full) {
+		//(uploaded directly from the mapping)
+		ret->vertices = reinterpret_cast< char const * >(data.data());
+		ret->vertices_size = data.size() * sizeof(Vertex);
+
+		//store attrib locations:
+		ret->Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
+		ret->Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+		ret->Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+		ret->TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+	} else {
+		struct CompactVertex {
+			glm::u16vec4 Position; //xyz quantized to the mesh's bounds; w is padding
+			glm::i16vec2 Normal; //octahedral
+			glm::u8vec4 Color;
+			uint16_t TexCoord[2]; //half floats
+		};
+		static_assert(sizeof(CompactVertex) == 4*2+2*2+4*1+2*2, "CompactVertex is packed.");
+
+		//each vertex gets quantized to the bounds of the mesh it belongs to, so meshes can't partially overlap:
+		// (meshes that share exactly the same vertices -- and so the same bounds -- are fine)
+		std::sort(ranges.begin(), ranges.end(), [](Range const &a, Range const &b) {
+			if (a.vertex_begin != b.vertex_begin) return a.vertex_begin < b.vertex_begin;
+			return a.vertex_end < b.vertex_end;
+		});
+		ret->converted_vertices.assign(data.size() * sizeof(CompactVertex), 0);
+		CompactVertex *compact = reinterpret_cast< CompactVertex * >(ret->converted_vertices.data());
+		std::vector< Range const * > convert; //(ranges whose vertices need converting -- one of each set of identical ranges)
+		for (uint32_t r = 0; r < ranges.size(); ++r) {
+			Range const &range = ranges[r];
+			Mesh &mesh = *range.mesh;
+			if (range.vertex_begin == range.vertex_end) continue;
+			if (r > 0 && ranges[r-1].vertex_begin == range.vertex_begin && ranges[r-1].vertex_end == range.vertex_end) {
+				mesh.position_scale = ranges[r-1].mesh->position_scale;
+				mesh.position_offset = ranges[r-1].mesh->position_offset;
+				continue;
+			}
+			if (r > 0 && ranges[r-1].vertex_end > range.vertex_begin) {
+				throw std::runtime_error("Mesh file '" + filename + "' has meshes with partially overlapping vertex ranges, which can't be loaded with the compact layout.");
+			}
+
+			mesh.position_offset = mesh.min;
+			mesh.position_scale = mesh.max - mesh.min;
+			convert.emplace_back(&range);
+		}
+
+		//(ranges don't overlap, so they can be converted in parallel)
+		parallel_for(uint32_t(convert.size()), [&](uint32_t i) {
+			return size_t(convert[i]->vertex_end - convert[i]->vertex_begin) * sizeof(Vertex);
+		}, [&](uint32_t i) {
+			Range const &range = *convert[i];
+			Mesh const &mesh = *range.mesh;
+			//(an axis the mesh is flat along has scale 0, and all its vertices quantize to 0 on that axis)
+			glm::vec3 quantize;
+			for (uint32_t a = 0; a < 3; ++a) {
+				quantize[a] = (mesh.position_scale[a] > 0.0f ? 65535.0f / mesh.position_scale[a] : 0.0f);
+			}
+			for (uint32_t v = range.vertex_begin; v < range.vertex_end; ++v) {
+				Vertex const &in = data[v];
+				CompactVertex &out = compact[v];
+				glm::vec3 q = glm::clamp(glm::round((in.Position - mesh.position_offset) * quantize), glm::vec3(0.0f), glm::vec3(65535.0f));
+				out.Position = glm::u16vec4(q, 0);
+				out.Normal = to_octahedral(in.Normal);
+				out.Color = in.Color;
+				out.TexCoord[0] = to_half(in.TexCoord.x);
+				out.TexCoord[1] = to_half(in.TexCoord.y);
+			}
+		});
+
+		ret->vertices = ret->converted_vertices.data();
+		ret->vertices_size = ret->converted_vertices.size();
+
+		//(positions come out of the vertex fetch in [0,1]; Mesh::position_scale / position_offset map them back)
+		ret->Position = Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Position));
+		ret->Normal = Attrib(2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Normal));
+		ret->Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Color));
+		ret->TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), offsetof(CompactVertex, TexCoord));
+	}
+
+	//(the mapping can go once nothing points into it)
+	if (!ret->converted_vertices.empty() && (!indexed || !ret->converted_indices.empty())) {
+		ret->file.reset();
+	}
+
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
 	for (auto const &m : meshes) {
@@ -96,14 +506,134 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 	}
 	std::cout << std::endl;
 	*/
+
+	return ret;
+}
+
+std::unique_ptr< MeshBuffer::Data > MeshBuffer::read_subset(Data const &from, std::vector< std::string_view > const &names) {
+	std::unique_ptr< Data > ret(new Data);
+	ret->filename = from.filename;
+	ret->layout = from.layout;
+	ret->indexed = from.indexed;
+	ret->bounds_from_file = from.bounds_from_file;
+	ret->Position = from.Position;
+	ret->Normal = from.Normal;
+	ret->Color = from.Color;
+	ret->TexCoord = from.TexCoord;
+
+	size_t stride = size_t(from.Position.stride);
+	size_t index_size = 0;
+
+	//find the meshes, and (first) copy their names:
+	std::vector< std::pair< size_t, Mesh const * > > found; //(name offset, mesh)
+	for (auto const &name : names) {
+		auto f = from.meshes.find(name);
+		if (f == from.meshes.end()) {
+			throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+		}
+		found.emplace_back(ret->names.size(), &f->second);
+		ret->names.append(name);
+	}
+
+	//copy each mesh's vertices (and indices), once for meshes that share them:
+	std::map< std::pair< GLuint, GLuint >, GLuint > copied_vertices; //[begin, end) in 'from' -> begin in 'ret'
+	std::map< std::pair< GLuint, GLuint >, GLuint > copied_indices; //[start, start + count) in 'from' -> start in 'ret'
+	auto copy_vertices = [&](GLuint begin, GLuint end) {
+		auto inserted = copied_vertices.emplace(std::make_pair(begin, end), GLuint(ret->converted_vertices.size() / stride));
+		if (inserted.second) {
+			ret->converted_vertices.insert(ret->converted_vertices.end(), from.vertices + begin * stride, from.vertices + end * stride);
+		}
+		return inserted.first->second;
+	};
+	auto copy_indices = [&](GLuint start, GLuint count) {
+		auto inserted = copied_indices.emplace(std::make_pair(start, start + count), GLuint(ret->converted_indices.size() / index_size));
+		if (inserted.second) {
+			ret->converted_indices.insert(ret->converted_indices.end(), from.indices + start * index_size, from.indices + (start + count) * index_size);
+		}
+		return inserted.first->second;
+	};
+
+	for (uint32_t i = 0; i < found.size(); ++i) {
+		Mesh mesh = *found[i].second;
+		if (mesh.index_type == GL_NONE) {
+			mesh.start = copy_vertices(mesh.start, mesh.start + mesh.count);
+		} else {
+			//(all the meshes in a buffer have the same index type)
+			index_size = (mesh.index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+			//the vertices used are [base_vertex, base_vertex + largest index used]:
+			GLuint used = 0;
+			auto scan = [&](GLuint start, GLuint count) {
+				for (GLuint at = start; at < start + count; ++at) {
+					uint32_t index;
+					if (mesh.index_type == GL_UNSIGNED_SHORT) index = reinterpret_cast< uint16_t const * >(from.indices)[at];
+					else index = reinterpret_cast< uint32_t const * >(from.indices)[at];
+					used = std::max(used, GLuint(index + 1));
+				}
+			};
+			scan(mesh.start, mesh.count);
+			for (uint32_t l = 0; l < mesh.lod_levels; ++l) {
+				scan(mesh.lods[l].start, mesh.lods[l].count);
+			}
+			mesh.base_vertex = GLint(copy_vertices(GLuint(mesh.base_vertex), GLuint(mesh.base_vertex) + used));
+			mesh.start = copy_indices(mesh.start, mesh.count);
+			for (uint32_t l = 0; l < mesh.lod_levels; ++l) {
+				mesh.lods[l].start = copy_indices(mesh.lods[l].start, mesh.lods[l].count);
+			}
+		}
+		std::string_view name(ret->names.data() + found[i].first, names[i].size());
+		ret->meshes.emplace(name, mesh);
+	}
+
+	ret->vertices = ret->converted_vertices.data();
+	ret->vertices_size = ret->converted_vertices.size();
+	ret->indices = ret->converted_indices.data();
+	ret->indices_size = ret->converted_indices.size();
+
+	return ret;
+}
+
+MeshBuffer::MeshBuffer(Data &&data) : layout(data.layout) {
+	//upload data:
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, data.vertices_size, data.vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (data.indexed) {
+		glGenBuffers(1, &index_buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices_size, data.indices, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	Position = data.Position;
+	Normal = data.Normal;
+	Color = data.Color;
+	TexCoord = data.TexCoord;
+
+	//take the names, re-pointing the views at this copy of the string table:
+	// (moving a std::string may move its characters -- e.g., short strings stored inline)
+	names = data.names;
+	for (auto const &[name, mesh] : data.meshes) {
+		auto inserted = meshes.emplace(std::string_view(names.data() + (name.data() - data.names.data()), name.size()), mesh);
+		by_name.emplace(mesh.name, &inserted.first->second);
+	}
+}
+
+const Mesh &MeshBuffer::lookup(Name name) const {
+	auto f = by_name.find(name);
+	if (f == by_name.end()) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name.str()) + "' that doesn't exist.");
+	}
+	return *f->second;
 }
 
 const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
+	Name found = Name::find(name);
+	if (found.empty() && !name.empty()) {
 		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
 	}
-	return f->second;
+	return lookup(found);
 }
 
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
@@ -128,7 +658,10 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//(the element buffer binding is part of the vertex array object's state)
+	if (index_buffer) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
 	glBindVertexArray(0);
+	if (index_buffer) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	//Check that all active attributes were bound:
 	GLint active = 0;
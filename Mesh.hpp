@@ -7,13 +7,33 @@
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
  *
+ * Two file formats are supported:
+ *  .pnct -- non-indexed triangles, as written by scenes/export-meshes.py
+ *  .pnci -- the same vertices welded + indexed (and ordered for the
+ *           post-transform vertex cache), plus simplified levels of
+ *           detail, as written by index-meshes
+ *
+ * Either can be loaded with the full (float) vertex layout or with a compact
+ *  one, which is a bit over half the size -- see MeshBuffer::Layout.
+ *
+ * Either may also end with a "bnd0" chunk holding each mesh's bounds (both
+ *  writers add one); otherwise they're computed -- on a few threads, for big
+ *  files -- while checking that vertex positions are finite.
+ *
  */
 
 #include "GL.hpp"
+#include "Name.hpp"
 #include <glm/glm.hpp>
 #include <map>
 #include <limits>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct MappedFile;
 
 
 struct Mesh {
@@ -23,20 +43,63 @@ struct Mesh {
 	GLuint start = 0; //index of first vertex
 	GLuint count = 0; //count of vertices
 
+	//Indexed meshes (from .pnci files) are instead ranges of the buffer's element array:
+	GLenum index_type = GL_NONE; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT if indexed; then 'start' / 'count' are in indices...
+	GLint base_vertex = 0; //...and get this added to them (see glDrawElementsBaseVertex)
+
+	//Compact buffers store positions quantized to the mesh's bounds, which come out of the vertex
+	// fetch in [0,1]; object-space position = position_offset + position_scale * (stored position):
+	glm::vec3 position_scale = glm::vec3(1.0f);
+	glm::vec3 position_offset = glm::vec3(0.0f);
+
+	//Indexed meshes may also come with simplified versions (see index-meshes) -- coarsest last -- which are
+	// more ranges of the element array over the same vertices; 'error' is about how far (in object space)
+	// each strays from the full mesh:
+	enum : uint32_t { MaxLODs = 3 };
+	struct LOD {
+		GLuint start = 0;
+		GLuint count = 0;
+		float error = 0.0f;
+	} lods[MaxLODs];
+	uint32_t lod_levels = 0; //how many of 'lods' are in use
+
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//The mesh's name in its file (interned; see Name.hpp):
+	Name name;
 };
 
 struct MeshBuffer {
+	//Vertex layouts:
+	// Full -- float positions, normals, and texcoords; 8-bit colors (36 bytes per vertex)
+	// Compact -- 16-bit positions quantized to each mesh's bounds, octahedral-encoded 16-bit normals,
+	//   8-bit colors, half-float texcoords (20 bytes per vertex)
+	//   note: programs need to decode the two-component Normal (e.g., lit_color_texture_compact_program)
+	//   and draws need to apply Mesh::position_scale / position_offset (Scene's pipelines do).
+	enum class Layout { Full, Compact };
+
 	//construct from a file:
-	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	// note: will throw if file fails to read (or has out-of-range indices, or NaN / infinite vertex positions).
+	MeshBuffer(std::string const &filename, Layout layout = Layout::Full);
+
+	//...or in two steps, so the reading (and converting) can happen on another thread:
+	// (see the two-stage Load<> in Load.hpp)
+	struct Data;
+	static std::unique_ptr< Data > read(std::string const &filename, Layout layout = Layout::Full); //no OpenGL calls
+	MeshBuffer(Data &&data); //uploads to OpenGL
+
+	//copy some of the meshes in already-read data into data of their own, e.g., to upload
+	// just what one part of a scene needs (see SceneStreamer); no OpenGL calls:
+	// note: will throw if a mesh isn't found.
+	static std::unique_ptr< Data > read_subset(Data const &from, std::vector< std::string_view > const &names);
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
-	const Mesh &lookup(std::string const &name) const;
+	const Mesh &lookup(Name name) const; //(a hash table probe on the name's id -- e.g., buffer->lookup("Cube"_name))
+	const Mesh &lookup(std::string const &name) const; //(same, after finding the interned name)
 	
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
@@ -44,11 +107,19 @@ struct MeshBuffer {
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//...and, for indexed meshes, the element buffer holding their indices (0 if none):
+	GLuint index_buffer = 0;
+
+	Layout layout;
 
 	//-- internals ---
 
-	//used by the lookup() function:
-	std::map< std::string, Mesh > meshes;
+	//every mesh, in name order:
+	// (names are views into 'names', the file's string table)
+	std::map< std::string_view, Mesh > meshes;
+	std::string names;
+	//...and indexed by Mesh::name, as used by the lookup() function:
+	std::unordered_map< Name, Mesh const * > by_name;
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
@@ -68,3 +139,34 @@ struct MeshBuffer {
 	Attrib Color;
 	Attrib TexCoord;
 };
+
+//Everything read from a mesh file, ready to upload:
+struct MeshBuffer::Data {
+	Data();
+	~Data();
+	Data(Data const &) = delete;
+	Data &operator=(Data const &) = delete;
+
+	std::string filename;
+	Layout layout = Layout::Full;
+	bool indexed = false;
+	bool bounds_from_file = false; //were Mesh::min / max read from the file's "bnd0" chunk (rather than computed)?
+
+	//bytes for the vertex and (if indexed) element buffers -- in 'file', or in the converted copies:
+	char const *vertices = nullptr;
+	size_t vertices_size = 0;
+	char const *indices = nullptr;
+	size_t indices_size = 0;
+
+	std::unique_ptr< MappedFile > file;
+	std::vector< char > converted_vertices; //compact layout
+	std::vector< char > converted_indices; //narrowed to 16 bits
+
+	//(as in MeshBuffer)
+	std::map< std::string_view, Mesh > meshes;
+	std::string names;
+	Attrib Position;
+	Attrib Normal;
+	Attrib Color;
+	Attrib TexCoord;
+};
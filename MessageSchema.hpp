@@ -0,0 +1,512 @@
+#pragma once
+
+/*
+ * MessageSchema describes the wire layout of a network message once, at
+ * compile time, and generates both encode() and decode() from that one list,
+ * so the sender and the receiver can't drift apart.
+ *
+ * A message struct declares its fields (in wire order) with an encoding each:
+ *
+ * struct PlayerEntry {
+ *     glm::vec2 position;
+ *     uint8_t team;
+ *     bool stunned;
+ *
+ *     using Schema = MessageSchema<
+ *         Field< &PlayerEntry::position, Quantized< Range< 0, 8 >, 16 > >,
+ *         Bits< &PlayerEntry::team, &PlayerEntry::stunned >
+ *     >;
+ * };
+ *
+ * //later:
+ * char buffer[PlayerEntry::Schema::MaxSize];
+ * size_t used = encode(entry, buffer, sizeof(buffer)); //0 if it didn't fit
+ * size_t read = decode(buffer, used, &entry); //0 if input is incomplete
+ *
+ * Encodings:
+ *  Raw - the value's bytes, big-endian (floats as their IEEE bits; glm vectors per-component;
+ *        std::vector's of floats / float glm vectors as a VarInt count and then bulk-converted floats)
+ *  Quantized< R, B > - floats mapped from [R::min,R::max] onto a B-bit (8 or 16) unsigned integer
+ *  VarInt - unsigned integers as LEB128 (7 bits per byte, high bit means "more")
+ * Element kinds:
+ *  Field< &T::member, Encoding > - one member
+ *  Bits< &T::a, &T::b, ... > - up to 8 bool-ish members packed into one byte
+ *  Array< &T::vec, CountEncoding, MaxCount > - a std::vector of structs that have their own Schema
+ *
+ * Schemas made only of fixed-size elements have Fixed == true and a static Size;
+ * their encode/decode check the buffer size once and then run straight-line code.
+ *
+ */
+
+#include "Serialization.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+//---- encodings ----
+
+struct Raw { };
+
+template< typename R, uint32_t B >
+struct Quantized {
+	static_assert(B == 8 || B == 16, "Quantized supports 8- or 16-bit values");
+	static_assert(R::max > R::min, "Quantized needs a non-empty range");
+};
+
+struct VarInt { };
+
+//convenient (integer-valued) range for Quantized<>:
+template< int32_t Min, int32_t Max, int32_t Den = 1 >
+struct Range {
+	static constexpr float min = float(Min) / float(Den);
+	static constexpr float max = float(Max) / float(Den);
+};
+
+//---- internals ----
+
+namespace message_schema {
+
+constexpr size_t Unbounded = std::numeric_limits< size_t >::max();
+
+constexpr size_t add_sizes(size_t a, size_t b) {
+	return (a == Unbounded || b == Unbounded) ? Unbounded : a + b;
+}
+
+//kept out of line so the error path doesn't get in the way of inlining:
+[[noreturn]] inline void throw_count_error(size_t count, uint32_t max_count) {
+	throw std::runtime_error("Array has " + std::to_string(count) + " elements; schema allows at most " + std::to_string(max_count));
+}
+
+template< typename M >
+struct MemberTraits;
+
+template< typename C, typename V >
+struct MemberTraits< V C::* > {
+	using Class = C;
+	using Value = V;
+};
+
+//big-endian helpers:
+inline void store_u8(char *out, uint8_t x) {
+	out[0] = char(x);
+}
+inline void store_u16(char *out, uint16_t x) {
+	out[0] = char(x >> 8);
+	out[1] = char(x);
+}
+inline void store_u32(char *out, uint32_t x) {
+	store_be32(x, out);
+}
+inline uint8_t load_u8(char const *in) {
+	return uint8_t(in[0]);
+}
+inline uint16_t load_u16(char const *in) {
+	return uint16_t((uint16_t(uint8_t(in[0])) << 8) | uint16_t(uint8_t(in[1])));
+}
+inline uint32_t load_u32(char const *in) {
+	return load_be32(in);
+}
+
+//Scalar codecs: how one value of type V is stored with encoding E.
+// Fixed codecs provide: Size, put(out, v), get(in, &v)
+// Variable codecs provide: MaxSize, size(v), put(out, v) -> end, get(in, end, &v) -> end (nullptr if incomplete)
+template< typename E, typename V, typename Enable = void >
+struct Codec;
+
+//Raw integers, enums and bools:
+template< typename V >
+struct Codec< Raw, V, std::enable_if_t< std::is_integral< V >::value || std::is_enum< V >::value > > {
+	static constexpr bool Fixed = true;
+	static constexpr size_t Size = sizeof(V);
+	static_assert(Size == 1 || Size == 2 || Size == 4, "Raw integers must be 1, 2, or 4 bytes");
+	using U = std::conditional_t< Size == 1, uint8_t, std::conditional_t< Size == 2, uint16_t, uint32_t > >;
+
+	static void put(char *out, V v) {
+		if constexpr (Size == 1) store_u8(out, U(v));
+		else if constexpr (Size == 2) store_u16(out, U(v));
+		else store_u32(out, U(v));
+	}
+	static void get(char const *in, V *v) {
+		if constexpr (Size == 1) *v = V(load_u8(in));
+		else if constexpr (Size == 2) *v = V(load_u16(in));
+		else *v = V(load_u32(in));
+	}
+};
+
+//Raw floats:
+template< >
+struct Codec< Raw, float > {
+	static constexpr bool Fixed = true;
+	static constexpr size_t Size = 4;
+	static void put(char *out, float v) {
+		serialize_float(v, out);
+	}
+	static void get(char const *in, float *v) {
+		*v = deserialize_float(in);
+	}
+};
+
+//Quantized floats:
+template< typename R, uint32_t B >
+struct Codec< Quantized< R, B >, float > {
+	static constexpr bool Fixed = true;
+	static constexpr size_t Size = B / 8;
+	static constexpr float Steps = float((uint32_t(1) << B) - 1);
+	static constexpr float Scale = Steps / (R::max - R::min);
+	static constexpr float InvScale = (R::max - R::min) / Steps;
+
+	static void put(char *out, float v) {
+		float t = (v - R::min) * Scale + 0.5f;
+		uint32_t q = uint32_t(std::min(std::max(t, 0.0f), Steps)); //(NaN ends up as zero)
+		if constexpr (B == 8) store_u8(out, uint8_t(q));
+		else store_u16(out, uint16_t(q));
+	}
+	static void get(char const *in, float *v) {
+		uint32_t q;
+		if constexpr (B == 8) q = load_u8(in);
+		else q = load_u16(in);
+		*v = R::min + float(q) * InvScale;
+	}
+};
+
+//Raw or quantized glm vectors are just their components in order:
+template< typename E, glm::length_t N, typename T, glm::qualifier Q >
+struct Codec< E, glm::vec< N, T, Q >, std::enable_if_t< !std::is_same< E, VarInt >::value > > {
+	using C = Codec< E, T >;
+	static constexpr bool Fixed = true;
+	static constexpr size_t Size = N * C::Size;
+	static void put(char *out, glm::vec< N, T, Q > const &v) {
+		for (glm::length_t i = 0; i < N; ++i) C::put(out + i * C::Size, v[i]);
+	}
+	static void get(char const *in, glm::vec< N, T, Q > *v) {
+		for (glm::length_t i = 0; i < N; ++i) C::get(in + i * C::Size, &(*v)[i]);
+	}
+};
+
+//Variable-length unsigned integers:
+template< typename V >
+struct Codec< VarInt, V, std::enable_if_t< std::is_integral< V >::value && std::is_unsigned< V >::value > > {
+	static constexpr bool Fixed = false;
+	static constexpr size_t MinSize = 1;
+	static constexpr size_t MaxSize = (sizeof(V) * 8 + 6) / 7;
+
+	static size_t size(V v) {
+		size_t ret = 1;
+		while (v >= 0x80) {
+			v >>= 7;
+			ret += 1;
+		}
+		return ret;
+	}
+	static char *put(char *out, V v) {
+		while (v >= 0x80) {
+			*(out++) = char(uint8_t(v) | 0x80);
+			v >>= 7;
+		}
+		*(out++) = char(uint8_t(v));
+		return out;
+	}
+	static char const *get(char const *in, char const *end, V *v) {
+		V ret = 0;
+		for (uint32_t shift = 0; in < end; shift += 7) {
+			if (shift >= sizeof(V) * 8) {
+				throw std::runtime_error("VarInt is too long for its type");
+			}
+			uint8_t b = uint8_t(*(in++));
+			ret |= V(b & 0x7f) << shift;
+			if (!(b & 0x80)) {
+				*v = ret;
+				return in;
+			}
+		}
+		return nullptr; //ran out of input
+	}
+};
+
+template< typename V >
+struct IsFloats : std::false_type { };
+template< >
+struct IsFloats< float > : std::true_type { };
+template< glm::length_t N, glm::qualifier Q >
+struct IsFloats< glm::vec< N, float, Q > > : std::true_type { };
+
+//Raw arrays of floats (or float vectors) go through the bulk byte-swap in Serialization.hpp:
+template< typename V >
+struct Codec< Raw, std::vector< V >, std::enable_if_t< IsFloats< V >::value > > {
+	using Count = Codec< VarInt, uint32_t >;
+	static constexpr size_t Floats = sizeof(V) / sizeof(float);
+	static_assert(sizeof(V) == Floats * sizeof(float), "float vectors should be tightly packed");
+
+	static constexpr bool Fixed = false;
+	static constexpr size_t MinSize = Count::MinSize;
+	static constexpr size_t MaxSize = Unbounded;
+
+	static size_t size(std::vector< V > const &v) {
+		return Count::size(uint32_t(v.size())) + v.size() * Floats * 4;
+	}
+	static char *put(char *out, std::vector< V > const &v) {
+		out = Count::put(out, uint32_t(v.size()));
+		serialize_floats(reinterpret_cast< float const * >(v.data()), v.size() * Floats, out);
+		return out + v.size() * Floats * 4;
+	}
+	static char const *get(char const *in, char const *end, std::vector< V > *v) {
+		uint32_t count = 0;
+		in = Count::get(in, end, &count);
+		if (!in) return nullptr;
+		//(checked before resizing, so a bogus count can't trigger a huge allocation)
+		if (size_t(end - in) / (Floats * 4) < count) return nullptr;
+		v->resize(count);
+		deserialize_floats(in, count * Floats, reinterpret_cast< float * >(v->data()));
+		return in + count * Floats * 4;
+	}
+};
+
+
+} //namespace message_schema
+
+//---- elements ----
+
+//Elements provide:
+// MinSize, MaxSize, Fixed
+// size(msg) - bytes this element will use for msg
+// encode(msg, out) -> out + size(msg) (caller guarantees space)
+// decode(in, end, msg) -> end of element, or nullptr if [in,end) is too short
+// if Fixed: decode_fixed(in, msg) (caller guarantees space)
+
+template< auto Member, typename Encoding = Raw >
+struct Field {
+	using Traits = message_schema::MemberTraits< decltype(Member) >;
+	using Class = typename Traits::Class;
+	using Value = typename Traits::Value;
+	using C = message_schema::Codec< Encoding, Value >;
+
+	static constexpr bool Fixed = C::Fixed;
+	static constexpr size_t MinSize = []() { if constexpr (C::Fixed) return C::Size; else return C::MinSize; }();
+	static constexpr size_t MaxSize = []() { if constexpr (C::Fixed) return C::Size; else return C::MaxSize; }();
+
+	static size_t size(Class const &msg) {
+		if constexpr (Fixed) return C::Size;
+		else return C::size(msg.*Member);
+	}
+	static char *encode(Class const &msg, char *out) {
+		if constexpr (Fixed) {
+			C::put(out, msg.*Member);
+			return out + C::Size;
+		} else {
+			return C::put(out, msg.*Member);
+		}
+	}
+	static void decode_fixed(char const *in, Class *msg) {
+		C::get(in, &(msg->*Member));
+	}
+	static char const *decode(char const *in, char const *end, Class *msg) {
+		if constexpr (Fixed) {
+			if (size_t(end - in) < C::Size) return nullptr;
+			C::get(in, &(msg->*Member));
+			return in + C::Size;
+		} else {
+			return C::get(in, end, &(msg->*Member));
+		}
+	}
+};
+
+template< auto First, auto... Rest >
+struct Bits {
+	static_assert(sizeof...(Rest) < 8, "Bits packs at most 8 members into a byte");
+	using Class = typename message_schema::MemberTraits< decltype(First) >::Class;
+
+	static constexpr bool Fixed = true;
+	static constexpr size_t MinSize = 1;
+	static constexpr size_t MaxSize = 1;
+
+	static size_t size(Class const &) { return 1; }
+	static char *encode(Class const &msg, char *out) {
+		uint8_t byte = ((msg.*First) ? 1 : 0);
+		uint32_t bit = 1;
+		((byte |= uint8_t(((msg.*Rest) ? 1 : 0) << (bit++))), ...);
+		*out = char(byte);
+		return out + 1;
+	}
+	static void decode_fixed(char const *in, Class *msg) {
+		uint8_t byte = uint8_t(*in);
+		uint32_t bit = 1;
+		set(msg->*First, byte & 1);
+		(set(msg->*Rest, (byte >> (bit++)) & 1), ...);
+	}
+	static char const *decode(char const *in, char const *end, Class *msg) {
+		if (in == end) return nullptr;
+		decode_fixed(in, msg);
+		return in + 1;
+	}
+private:
+	template< typename V >
+	static void set(V &v, uint8_t b) { v = V(b); }
+};
+
+template< auto Member, typename CountEncoding = VarInt, uint32_t MaxCount = 0xffff >
+struct Array {
+	using Traits = message_schema::MemberTraits< decltype(Member) >;
+	using Class = typename Traits::Class;
+	using Value = typename Traits::Value;
+	using Element = typename Value::value_type;
+	using ElementSchema = typename Element::Schema;
+	using CountCodec = message_schema::Codec< CountEncoding, uint32_t >;
+
+	static constexpr bool Fixed = false;
+	static constexpr size_t MinSize = []() { if constexpr (CountCodec::Fixed) return CountCodec::Size; else return CountCodec::MinSize; }();
+	static constexpr size_t MaxSize = message_schema::Unbounded;
+
+	static size_t count_size(uint32_t count) {
+		if constexpr (CountCodec::Fixed) return CountCodec::Size;
+		else return CountCodec::size(count);
+	}
+
+	static size_t size(Class const &msg) {
+		Value const &vec = msg.*Member;
+		size_t ret = count_size(uint32_t(vec.size()));
+		if constexpr (ElementSchema::Fixed) {
+			ret += vec.size() * ElementSchema::Size;
+		} else {
+			for (auto const &e : vec) ret += ElementSchema::size(e);
+		}
+		return ret;
+	}
+	static char *encode(Class const &msg, char *out) {
+		Value const &vec = msg.*Member;
+		if (vec.size() > MaxCount) message_schema::throw_count_error(vec.size(), MaxCount);
+		if constexpr (CountCodec::Fixed) {
+			CountCodec::put(out, uint32_t(vec.size()));
+			out += CountCodec::Size;
+		} else {
+			out = CountCodec::put(out, uint32_t(vec.size()));
+		}
+		for (auto const &e : vec) {
+			out = ElementSchema::encode(e, out);
+		}
+		return out;
+	}
+	static char const *decode(char const *in, char const *end, Class *msg) {
+		uint32_t count = 0;
+		if constexpr (CountCodec::Fixed) {
+			if (size_t(end - in) < CountCodec::Size) return nullptr;
+			CountCodec::get(in, &count);
+			in += CountCodec::Size;
+		} else {
+			in = CountCodec::get(in, end, &count);
+			if (!in) return nullptr;
+		}
+		if (count > MaxCount) message_schema::throw_count_error(count, MaxCount);
+		Value &vec = msg->*Member;
+		if constexpr (ElementSchema::Fixed) {
+			//can check for the whole array at once:
+			if (size_t(end - in) < count * ElementSchema::Size) return nullptr;
+			vec.resize(count);
+			for (auto &e : vec) {
+				ElementSchema::decode_fixed(in, &e);
+				in += ElementSchema::Size;
+			}
+		} else {
+			vec.resize(count);
+			for (auto &e : vec) {
+				in = ElementSchema::decode(in, end, &e);
+				if (!in) return nullptr;
+			}
+		}
+		return in;
+	}
+};
+
+//---- schema ----
+
+template< typename... Elements >
+struct MessageSchema {
+	static_assert(sizeof...(Elements) > 0, "MessageSchema needs at least one element");
+
+	static constexpr bool Fixed = (Elements::Fixed && ...);
+	static constexpr size_t MinSize = (Elements::MinSize + ...);
+	static constexpr size_t MaxSize = []() {
+		size_t ret = 0;
+		((ret = message_schema::add_sizes(ret, Elements::MaxSize)), ...);
+		return ret;
+	}();
+	//only meaningful for Fixed schemas:
+	static constexpr size_t Size = Fixed ? MinSize : 0;
+
+	template< typename T >
+	static size_t size(T const &msg) {
+		if constexpr (Fixed) return Size;
+		else return (Elements::size(msg) + ...);
+	}
+
+	template< typename T >
+	static char *encode(T const &msg, char *out) {
+		((out = Elements::encode(msg, out)), ...);
+		return out;
+	}
+
+	template< typename T >
+	static void decode_fixed(char const *in, T *msg) {
+		static_assert(Fixed, "decode_fixed only works on fixed-size schemas");
+		size_t offset = 0;
+		((Elements::decode_fixed(in + offset, msg), offset += Elements::MinSize), ...);
+	}
+
+	template< typename T >
+	static char const *decode(char const *in, char const *end, T *msg) {
+		if constexpr (Fixed) {
+			if (size_t(end - in) < Size) return nullptr;
+			decode_fixed(in, msg);
+			return in + Size;
+		} else {
+			//stops at the first element that runs out of input:
+			bool ok = (((in = Elements::decode(in, end, msg)) != nullptr) && ...);
+			return ok ? in : nullptr;
+		}
+	}
+};
+
+//---- top-level helpers ----
+
+//number of bytes encode() will write for msg:
+template< typename T >
+size_t encoded_size(T const &msg) {
+	return T::Schema::size(msg);
+}
+
+//encode msg into [out, out+capacity); returns bytes written, or 0 if it wouldn't fit:
+template< typename T >
+size_t encode(T const &msg, char *out, size_t capacity) {
+	using Schema = typename T::Schema;
+	if constexpr (Schema::Fixed) {
+		if (capacity < Schema::Size) return 0;
+	} else if (capacity < Schema::MaxSize) {
+		if (capacity < Schema::size(msg)) return 0;
+	}
+	return size_t(Schema::encode(msg, out) - out);
+}
+
+//append the encoding of msg to a byte vector (e.g., Connection::send_buffer):
+template< typename T >
+void encode_append(T const &msg, std::vector< char > *to_) {
+	auto &to = *to_;
+	size_t at = to.size();
+	to.resize(at + encoded_size(msg));
+	encode(msg, to.data() + at, to.size() - at);
+}
+
+//decode msg from [in, in+size); returns bytes consumed, or 0 if more input is needed:
+// (on 0, msg may have been partially overwritten)
+// throws on malformed input
+template< typename T >
+size_t decode(char const *in, size_t size, T *msg) {
+	char const *end = T::Schema::decode(in, in + size, msg);
+	return end ? size_t(end - in) : 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "MessageSchema.hpp"
+#include "GameConsts.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Wire formats for messages between client and server.
+// Each message is a one-byte type header followed by its schema encoding.
+
+// Positions are sent quantized over the (square) court:
+struct CourtRange {
+  static constexpr float min = 0.0f;
+  static constexpr float max = court.x > court.y ? court.x : court.y;
+};
+
+// Client -> server: current button state
+struct InputMessage {
+  static constexpr char Type = 'b';
+
+  uint8_t left = 0;
+  uint8_t right = 0;
+  uint8_t down = 0;
+  uint8_t up = 0;
+  uint8_t space = 0;
+
+  // Tick of the latest snapshot the client had when sending this, so the
+  // server can judge steals against what the player was seeing
+  uint32_t seen_tick = 0;
+
+  using Schema = MessageSchema<
+    Bits< &InputMessage::left, &InputMessage::right, &InputMessage::down,
+      &InputMessage::up, &InputMessage::space >,
+    Field< &InputMessage::seen_tick, VarInt >
+  >;
+};
+
+// Server -> client: per-connection part of a snapshot
+struct SnapshotHeader {
+  static constexpr char Type = 'm';
+
+  // Whether the receiving player was stunned this tick
+  uint8_t just_stunned = 0;
+
+  using Schema = MessageSchema<
+    Bits< &SnapshotHeader::just_stunned >
+  >;
+};
+
+// Server -> client: shared part of a snapshot (follows SnapshotHeader)
+struct SnapshotBody {
+  // Server tick this snapshot was taken at
+  uint32_t tick = 0;
+
+  float red_zone_health = 0.0f;
+  float blue_zone_health = 0.0f;
+  glm::vec2 ball_position = glm::vec2(0.0f);
+
+  struct Player {
+    glm::vec2 position = glm::vec2(0.0f);
+    uint8_t team = 0;
+    uint8_t stunned = 0;
+
+    using Schema = MessageSchema<
+      Field< &Player::position, Quantized< CourtRange, 16 > >,
+      Bits< &Player::team, &Player::stunned >
+    >;
+  };
+  std::vector< Player > players;
+
+  using Schema = MessageSchema<
+    Field< &SnapshotBody::tick, VarInt >,
+    Field< &SnapshotBody::red_zone_health, Quantized< Range< 0, 1 >, 16 > >,
+    Field< &SnapshotBody::blue_zone_health, Quantized< Range< 0, 1 >, 16 > >,
+    Field< &SnapshotBody::ball_position, Quantized< CourtRange, 16 > >,
+    Array< &SnapshotBody::players, VarInt >
+  >;
+};
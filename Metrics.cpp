@@ -0,0 +1,149 @@
+#include "Metrics.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+uint64_t Metrics::Histogram::bucket_max(uint32_t index) {
+	if (index < SubBuckets) return index;
+	uint32_t shift = index / SubBuckets - 1;
+	uint64_t mantissa = SubBuckets + (index % SubBuckets);
+	//(the top bucket ends at UINT64_MAX, which the shift would overflow)
+	if (shift + SubBucketBits >= 63 && mantissa == 2 * SubBuckets - 1) return UINT64_MAX;
+	return ((mantissa + 1) << shift) - 1;
+}
+
+Metrics::Series &Metrics::find_or_add(std::string const &name, std::string const &help, std::string const &labels, Kind kind, bool *added) {
+	auto ret = families.emplace(name, Family());
+	Family &family = ret.first->second;
+	if (ret.second) {
+		family.kind = kind;
+		family.help = help;
+	} else if (family.kind != kind) {
+		throw std::runtime_error("Metric '" + name + "' registered as two different kinds.");
+	}
+
+	for (auto &series : family.series) {
+		if (series.labels == labels) {
+			*added = false;
+			return series;
+		}
+	}
+	family.series.emplace_back();
+	family.series.back().labels = labels;
+	*added = true;
+	return family.series.back();
+}
+
+Metrics::Counter &Metrics::counter(std::string const &name, std::string const &help, std::string const &labels) {
+	bool added;
+	Series &series = find_or_add(name, help, labels, KindCounter, &added);
+	if (added) series.counter.reset(new Counter);
+	return *series.counter;
+}
+
+Metrics::Gauge &Metrics::gauge(std::string const &name, std::string const &help, std::string const &labels) {
+	bool added;
+	Series &series = find_or_add(name, help, labels, KindGauge, &added);
+	if (added) series.gauge.reset(new Gauge);
+	return *series.gauge;
+}
+
+Metrics::Histogram &Metrics::histogram(std::string const &name, std::string const &help, std::string const &labels,
+	double scale, uint64_t min_value, uint64_t max_value) {
+	bool added;
+	Series &series = find_or_add(name, help, labels, KindHistogram, &added);
+	if (added) {
+		series.histogram.reset(new Histogram);
+		series.histogram->scale = scale;
+		series.histogram->first_exported = Histogram::bucket(min_value);
+		series.histogram->last_exported = Histogram::bucket(max_value);
+	}
+	return *series.histogram;
+}
+
+void Metrics::remove(void const *metric) {
+	for (auto f = families.begin(); f != families.end(); ++f) {
+		auto &list = f->second.series;
+		for (auto s = list.begin(); s != list.end(); ++s) {
+			if (s->counter.get() == metric || s->gauge.get() == metric || s->histogram.get() == metric) {
+				list.erase(s);
+				if (list.empty()) families.erase(f);
+				return;
+			}
+		}
+	}
+}
+
+//helper: format a sample value (std::to_string only keeps six decimal places):
+static std::string format_value(double value) {
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+	return buffer;
+}
+
+//helper: write 'name{labels}' or 'name{labels,extra}':
+static void write_name(std::ostream &to, std::string const &name, std::string const &labels, std::string const &extra = "") {
+	to << name;
+	if (labels.empty() && extra.empty()) return;
+	to << '{' << labels;
+	if (!labels.empty() && !extra.empty()) to << ',';
+	to << extra << '}';
+}
+
+void Metrics::write_prometheus(std::ostream &to) const {
+	for (auto const &[name, family] : families) {
+		char const *type = (family.kind == KindCounter ? "counter" : family.kind == KindGauge ? "gauge" : "histogram");
+		to << "# HELP " << name << ' ' << family.help << '\n';
+		to << "# TYPE " << name << ' ' << type << '\n';
+
+		for (auto const &series : family.series) {
+			if (family.kind == KindCounter) {
+				write_name(to, name, series.labels);
+				to << ' ' << series.counter->get() << '\n';
+			} else if (family.kind == KindGauge) {
+				write_name(to, name, series.labels);
+				to << ' ' << series.gauge->get() << '\n';
+			} else { assert(family.kind == KindHistogram);
+				Histogram const &h = *series.histogram;
+				//buckets are cumulative in prometheus:
+				uint64_t count = 0;
+				for (uint32_t b = 0; b < Histogram::BucketCount; ++b) {
+					count += h.buckets[b].load(std::memory_order_relaxed);
+					if (b < h.first_exported || b > h.last_exported) continue;
+					write_name(to, name + "_bucket", series.labels, "le=\"" + format_value(double(Histogram::bucket_max(b)) * h.scale) + "\"");
+					to << ' ' << count << '\n';
+				}
+				write_name(to, name + "_bucket", series.labels, "le=\"+Inf\"");
+				to << ' ' << count << '\n';
+				write_name(to, name + "_sum", series.labels);
+				to << ' ' << format_value(double(h.sum.load(std::memory_order_relaxed)) * h.scale) << '\n';
+				write_name(to, name + "_count", series.labels);
+				to << ' ' << count << '\n';
+			}
+		}
+	}
+}
+
+bool Metrics::write_file(std::string const &path) const {
+	//write to a temporary file and rename over the old one, so readers see either the old or new file:
+	std::string temp = path + ".tmp";
+	{
+		std::ofstream out(temp, std::ios::binary);
+		write_prometheus(out);
+		if (!out) {
+			std::cerr << "WARNING: failed to write metrics to '" << temp << "'." << std::endl;
+			return false;
+		}
+	}
+	#ifdef _WIN32
+	std::remove(path.c_str()); //(rename won't replace an existing file on windows)
+	#endif
+	if (std::rename(temp.c_str(), path.c_str()) != 0) {
+		std::cerr << "WARNING: failed to move metrics to '" << path << "'." << std::endl;
+		return false;
+	}
+	return true;
+}
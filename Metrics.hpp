@@ -0,0 +1,137 @@
+#pragma once
+
+/*
+ * Metrics is a small registry of counters, gauges, and histograms that can be
+ * written out in the Prometheus text exposition format.
+ *
+ * Registering a metric is slow (string work + allocation), so do it once and
+ * keep the returned reference; updating through the reference is just a few
+ * relaxed atomic loads and stores.
+ *
+ * Each metric should only be updated from one thread at a time (updates are a
+ * load + store rather than a locked read-modify-write, which is several times
+ * slower); reading/exporting from another thread is fine:
+ *
+ * //setup:
+ * Metrics metrics;
+ * Metrics::Counter &ticks = metrics.counter("server_ticks_total", "Ticks run.");
+ * Metrics::Histogram &tick_time = metrics.histogram("server_tick_seconds", "Tick duration.",
+ *     "stage=\"update\"", 1e-9, 1000, 100000000); //recorded in ns, exported in s
+ *
+ * //per tick:
+ * ticks.add();
+ * tick_time.record(ns);
+ *
+ * //every so often:
+ * metrics.write_file("server.prom");
+ *
+ * Histograms use log-linear ("HDR-style") buckets: four buckets per power of
+ * two, so any recorded value lands in a bucket within 25% of it, with no
+ * configuration of bucket boundaries needed.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+struct Metrics {
+	//single-writer increment (see note above):
+	static void bump(std::atomic< uint64_t > &value, uint64_t amount) {
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	//Monotonically increasing count:
+	struct Counter {
+		void add(uint64_t amount = 1) { bump(value, amount); }
+		uint64_t get() const { return value.load(std::memory_order_relaxed); }
+		std::atomic< uint64_t > value{0};
+	};
+
+	//Value that can go up and down:
+	struct Gauge {
+		void set(int64_t to) { value.store(to, std::memory_order_relaxed); }
+		void add(int64_t amount) { value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); }
+		int64_t get() const { return value.load(std::memory_order_relaxed); }
+		std::atomic< int64_t > value{0};
+	};
+
+	//Distribution of (unsigned integer) values:
+	struct Histogram {
+		static constexpr uint32_t SubBucketBits = 2;
+		static constexpr uint32_t SubBuckets = 1 << SubBucketBits;
+		static constexpr uint32_t BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+		//which bucket a value lands in:
+		static uint32_t bucket(uint64_t value) {
+			if (value < SubBuckets) return uint32_t(value);
+			#ifdef _MSC_VER
+			unsigned long exponent;
+			_BitScanReverse64(&exponent, value);
+			#else
+			uint32_t exponent = 63 - uint32_t(__builtin_clzll(value));
+			#endif
+			uint32_t shift = exponent - SubBucketBits;
+			return (shift + 1) * SubBuckets + uint32_t((value >> shift) & (SubBuckets - 1));
+		}
+		//largest value that lands in a bucket:
+		static uint64_t bucket_max(uint32_t index);
+
+		void record(uint64_t value) {
+			bump(buckets[bucket(value)], 1);
+			bump(sum, value);
+		}
+
+		std::atomic< uint64_t > buckets[BucketCount] = { };
+		std::atomic< uint64_t > sum{0};
+
+		//export settings (set on registration):
+		double scale = 1.0; //exported values are recorded values * scale
+		uint32_t first_exported = 0; //bucket boundaries to write out
+		uint32_t last_exported = BucketCount - 1;
+	};
+
+	//Register (or find, if name + labels already exist) a metric.
+	// 'labels' is the Prometheus label list without braces, e.g. "stage=\"poll\""
+	// (throws if the name is already used by a different kind of metric)
+	Counter &counter(std::string const &name, std::string const &help, std::string const &labels = "");
+	Gauge &gauge(std::string const &name, std::string const &help, std::string const &labels = "");
+	// [min_value, max_value] is the range that gets written out as separate 'le' buckets
+	Histogram &histogram(std::string const &name, std::string const &help, std::string const &labels,
+		double scale, uint64_t min_value, uint64_t max_value);
+
+	//Unregister a metric (e.g. a per-connection one, when the connection closes):
+	// (references to it are invalid after this)
+	void remove(void const *metric);
+
+	//Write all metrics in Prometheus text format:
+	void write_prometheus(std::ostream &to) const;
+
+	//Write metrics to a file, atomically replacing it (so scrapers never see a partial file):
+	// (returns false, after printing a warning, on failure)
+	bool write_file(std::string const &path) const;
+
+	//internals:
+	enum Kind { KindCounter, KindGauge, KindHistogram };
+	struct Series {
+		std::string labels;
+		std::unique_ptr< Counter > counter;
+		std::unique_ptr< Gauge > gauge;
+		std::unique_ptr< Histogram > histogram;
+	};
+	struct Family {
+		Kind kind;
+		std::string help;
+		std::list< Series > series;
+	};
+	std::map< std::string, Family > families; //(sorted by name)
+
+	Series &find_or_add(std::string const &name, std::string const &help, std::string const &labels, Kind kind, bool *added);
+};
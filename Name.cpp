@@ -0,0 +1,137 @@
+#include "Name.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Entry {
+		std::string_view str;
+		uint64_t hash;
+	};
+
+	struct Table {
+		//entries are stored in fixed-size blocks that never move, so str() / hash() can read them without the lock:
+		// (a Name's entry is written before its id is handed out, and blocks are only ever added)
+		static constexpr uint32_t BlockBits = 12;
+		static constexpr uint32_t BlockSize = 1 << BlockBits;
+		static constexpr uint32_t MaxBlocks = 4096; //(so, up to 16M names)
+		std::atomic< Entry * > blocks[MaxBlocks] = {};
+
+		std::mutex mutex; //held while probing or adding to the table
+		uint32_t count = 0; //entries in use
+		std::vector< uint32_t > slots; //open-addressed (linear probing) table of ids, 0 = empty; size is a power of two
+
+		//characters of interned strings, allocated a few pages at a time:
+		std::vector< std::unique_ptr< char[] > > storage;
+		char *storage_next = nullptr;
+		size_t storage_left = 0;
+
+		Table() : slots(1024, 0) {
+			add(std::string_view(), Name::hash_of(std::string_view())); //id 0 is the empty name
+		}
+
+		Entry const &entry(uint32_t id) const {
+			return blocks[id >> BlockBits].load(std::memory_order_acquire)[id & (BlockSize - 1)];
+		}
+
+		//id of a string, or 0 if it isn't in the table (call with mutex held):
+		uint32_t probe(std::string_view str, uint64_t hash) const {
+			uint32_t mask = uint32_t(slots.size()) - 1;
+			for (uint32_t slot = uint32_t(hash) & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+				Entry const &e = entry(slots[slot]);
+				if (e.hash == hash && e.str == str) return slots[slot];
+			}
+			return 0;
+		}
+
+		//add a string that isn't in the table (call with mutex held):
+		uint32_t add(std::string_view str, uint64_t hash) {
+			if (count == MaxBlocks * BlockSize) {
+				throw std::runtime_error("Interning '" + std::string(str) + "' would make more than " + std::to_string(count) + " names.");
+			}
+
+			//copy the characters:
+			if (storage_left < str.size()) {
+				size_t size = std::max< size_t >(str.size(), 64 << 10);
+				storage.emplace_back(new char[size]);
+				storage_next = storage.back().get();
+				storage_left = size;
+			}
+			if (!str.empty()) std::memcpy(storage_next, str.data(), str.size());
+			std::string_view stored(storage_next, str.size());
+			storage_next += str.size();
+			storage_left -= str.size();
+
+			uint32_t id = count;
+			if ((id & (BlockSize - 1)) == 0) {
+				blocks[id >> BlockBits].store(new Entry[BlockSize], std::memory_order_release);
+			}
+			blocks[id >> BlockBits].load(std::memory_order_relaxed)[id & (BlockSize - 1)] = Entry{ stored, hash };
+			++count;
+
+			if (id == 0) return id; //(the empty name isn't in 'slots'; Name(str) handles it)
+
+			//keep the table at most half full, re-inserting with the stored hashes when it grows:
+			if (size_t(count) * 2 > slots.size()) {
+				std::vector< uint32_t > old_slots(slots.size() * 2, 0);
+				std::swap(slots, old_slots);
+				for (uint32_t old : old_slots) {
+					if (old != 0) insert(old);
+				}
+			}
+			insert(id);
+			return id;
+		}
+
+		void insert(uint32_t id) {
+			uint32_t mask = uint32_t(slots.size()) - 1;
+			uint32_t slot = uint32_t(entry(id).hash) & mask;
+			while (slots[slot] != 0) slot = (slot + 1) & mask;
+			slots[slot] = id;
+		}
+	};
+
+	//(a function-local static, so names can be made during static initialization)
+	Table &table() {
+		static Table table;
+		return table;
+	}
+}
+
+Name::Name(std::string_view str) : Name(Literal{ str, hash_of(str) }) {
+}
+
+Name::Name(Literal const &literal) {
+	if (literal.str.empty()) return;
+	Table &t = table();
+	std::lock_guard< std::mutex > lock(t.mutex);
+	id = t.probe(literal.str, literal.hash);
+	if (id == 0) id = t.add(literal.str, literal.hash);
+}
+
+Name Name::find(std::string_view str) {
+	return find(Literal{ str, hash_of(str) });
+}
+
+Name Name::find(Literal const &literal) {
+	Name ret;
+	if (literal.str.empty()) return ret;
+	Table &t = table();
+	std::lock_guard< std::mutex > lock(t.mutex);
+	ret.id = t.probe(literal.str, literal.hash);
+	return ret;
+}
+
+std::string_view Name::str() const {
+	return table().entry(id).str;
+}
+
+uint64_t Name::hash() const {
+	return table().entry(id).hash;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+ * A Name is an interned string: an id in one global table that stores each
+ * distinct string once, along with its hash. Names compare, hash, and key
+ * containers as plain integers, so looking things up by Name costs no string
+ * compares or allocations:
+ *
+ * Name a("Player"); //interns "Player" (thread-safe)
+ * Name b = "Player"_name; //same, but the string's hash is computed at compile time
+ * assert(a == b && a.str() == "Player");
+ *
+ * //look up a string without adding it to the table (e.g., names typed by a user):
+ * Name c = Name::find("Enemy"); //the empty Name() if "Enemy" was never interned
+ *
+ * Transform names (Scene::Transform::name) and mesh names (Mesh::name) are
+ * Names, so Scene::lookup() and MeshBuffer::lookup() are hash table probes.
+ *
+ * Interned strings are never freed, so str() views stay valid for the life
+ * of the program.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+struct Name {
+	Name() = default; //the empty name ("")
+
+	//intern a string (takes a lock; the first time a string is seen, also copies it):
+	explicit Name(std::string_view str);
+
+	//strings with their hashes already computed -- see operator""_name, below:
+	struct Literal {
+		std::string_view str;
+		uint64_t hash;
+	};
+	Name(Literal const &literal);
+
+	//the Name of an already-interned string, or the empty Name() if it isn't interned (never adds to the table):
+	static Name find(std::string_view str);
+	static Name find(Literal const &literal);
+
+	std::string_view str() const; //(no lock)
+	uint64_t hash() const; //hash_of(str()), as stored in the table (no lock)
+	bool empty() const { return id == 0; }
+
+	//the hash used for names (64-bit FNV-1a):
+	static constexpr uint64_t hash_of(std::string_view str) {
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		for (char c : str) {
+			hash ^= uint8_t(c);
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	//names compare by id (so operator< is not alphabetical order; it's interning order):
+	bool operator==(Name const &other) const { return id == other.id; }
+	bool operator!=(Name const &other) const { return id != other.id; }
+	bool operator<(Name const &other) const { return id < other.id; }
+
+	//index in the global table (0 is the empty name):
+	uint32_t id = 0;
+};
+
+//"string"_name is a Name::Literal, hashed at compile time (as long as the optimizer is on, or it's used in a constant expression):
+// e.g., scene.lookup("Player"_name), or static constexpr Name::Literal Player = "Player"_name;
+constexpr Name::Literal operator""_name(char const *str, size_t size) {
+	return Name::Literal{ std::string_view(str, size), Name::hash_of(std::string_view(str, size)) };
+}
+
+//ids are unique, so they make fine hashes for std::unordered_map< Name, ... >:
+namespace std {
+	template< >
+	struct hash< Name > {
+		size_t operator()(Name const &name) const { return name.id; }
+	};
+}
@@ -2,104 +2,18 @@
 
 #include "ClientState.hpp"
 #include "DrawLines.hpp"
+#include "DrawSprites.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
 #include "hex_dump.hpp"
-#include "Serialization.hpp"
 #include "GameConsts.hpp"
+#include "Trace.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
 #include <random>
 
 PlayMode::PlayMode(Client &client_) : client(client_) {
-	//----- allocate OpenGL resources -----
-	{ //vertex buffer:
-		glGenBuffers(1, &vertex_buffer);
-		//for now, buffer will be un-filled.
-
-		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
-	}
-
-	{ //vertex array mapping buffer for color_texture_program:
-		//ask OpenGL to fill vertex_buffer_for_color_texture_program with the name of an unused vertex array object:
-		glGenVertexArrays(1, &vertex_buffer_for_color_texture_program);
-
-		//set vertex_buffer_for_color_texture_program as the current vertex array object:
-		glBindVertexArray(vertex_buffer_for_color_texture_program);
-
-		//set vertex_buffer as the source of glVertexAttribPointer() commands:
-		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-
-		//set up the vertex array object to describe arrays of PongMode::Vertex:
-		glVertexAttribPointer(
-			color_texture_program.Position_vec4, //attribute
-			3, //size
-			GL_FLOAT, //type
-			GL_FALSE, //normalized
-			sizeof(Vertex), //stride
-			(GLbyte *)0 + 0 //offset
-		);
-		glEnableVertexAttribArray(color_texture_program.Position_vec4);
-		//[Note that it is okay to bind a vec3 input to a vec4 attribute -- the w component will be filled with 1.0 automatically]
-	   
-
-		glVertexAttribPointer(
-			color_texture_program.Color_vec4, //attribute
-			4, //size
-			GL_UNSIGNED_BYTE, //type
-			GL_TRUE, //normalized
-			sizeof(Vertex), //stride
-			(GLbyte *)0 + 4*3 //offset
-		);
-		glEnableVertexAttribArray(color_texture_program.Color_vec4);
-
-		glVertexAttribPointer(
-			color_texture_program.TexCoord_vec2, //attribute
-			2, //size
-			GL_FLOAT, //type
-			GL_FALSE, //normalized
-			sizeof(Vertex), //stride
-			(GLbyte *)0 + 4*3 + 4*1 //offset
-		);
-		glEnableVertexAttribArray(color_texture_program.TexCoord_vec2);
-
-		//done referring to vertex_buffer, so unbind it:
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		//done setting up vertex array object, so unbind it:
-		glBindVertexArray(0);
-
-		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
-	}
-
-	{ //solid white texture:
-		//ask OpenGL to fill white_tex with the name of an unused texture object:
-		glGenTextures(1, &white_tex);
-
-		//bind that texture object as a GL_TEXTURE_2D-type texture:
-		glBindTexture(GL_TEXTURE_2D, white_tex);
-
-		//upload a 1x1 image of solid white to the texture:
-		glm::uvec2 size = glm::uvec2(1,1);
-		std::vector< glm::u8vec4 > data(size.x*size.y, glm::u8vec4(0xff, 0xff, 0xff, 0xff));
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-
-		//set filtering and wrapping parameters:
-		//(it's a bit silly to mipmap a 1x1 texture, but I'm doing it because you may want to use this code to load different sizes of texture)
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-		//since texture uses a mipmap and we haven't uploaded one, instruct opengl to make one for us:
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		//Okay, texture uploaded, can unbind it:
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		GL_ERRORS(); //PARANOIA: print out any OpenGL errors that may have happened
-	}
 }
 
 PlayMode::~PlayMode() {
@@ -189,19 +103,27 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 }
 
 void PlayMode::update(float elapsed) {
+	TRACE_SCOPE("PlayMode::update");
 
 	//queue data for sending to server:
-	if (left.changed || right.changed || down.changed || up.changed) {
-		//send a 6-byte message of type 'b':
-		client.connections.back().send('b');
-		client.connections.back().send(left.pressed);
-		client.connections.back().send(right.pressed);
-		client.connections.back().send(down.pressed);
-		client.connections.back().send(up.pressed);
-		client.connections.back().send(space.pressed);
+	since_input += elapsed;
+	if (left.changed || right.changed || down.changed || up.changed || since_input >= input_ack_interval) {
+		since_input = 0.0f;
+		InputMessage input;
+		input.left = left.pressed;
+		input.right = right.pressed;
+		input.down = down.pressed;
+		input.up = up.pressed;
+		input.space = space.pressed;
+		input.seen_tick = snapshot.tick;
+
+		Connection &connection = client.connections.back();
+		connection.send(InputMessage::Type);
+		encode_append(input, &connection.send_buffer);
 	}
 
 	//send/receive data:
+	TRACE_SCOPE("client poll");
 	client.poll([this](Connection *c, Connection::Event event){
 		if (event == Connection::OnOpen) {
 			std::cout << "[" << c->socket << "] opened" << std::endl;
@@ -210,85 +132,63 @@ void PlayMode::update(float elapsed) {
 			throw std::runtime_error("Lost connection to server!");
 		} else { assert(event == Connection::OnRecv);
 			std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
-      /* Message format:
+      /* Message format (see Messages.hpp):
        * Header 'm' (1 byte)
-       * Number of players (2 bytes)
-       * Whether self is stunned (1 byte)
-       * Red zone health (4 bytes)
-       * Blue zone health (4 bytes)
-       * Ball position (8 bytes)
-       * Player positions and whether stunned (9 * n bytes)
+       * SnapshotHeader: whether self is stunned
+       * SnapshotBody: zone healths, ball position, player positions/teams/stunned
        */
-			while (c->recv_buffer.size() >= 4) {
-				std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
+			TRACE_SCOPE("parse snapshots");
+			while (!c->recv_buffer.empty()) {
 				char type = c->recv_buffer[0];
-				if (type != 'm') {
+				if (type != SnapshotHeader::Type) {
 					throw std::runtime_error("Server sent unknown message type '" + std::to_string(type) + "'");
 				}
 
-				uint32_t num_players = (
-					(uint32_t(c->recv_buffer[1]) << 8) | (uint32_t(c->recv_buffer[2]))
-				);
+				char const *begin = c->recv_buffer.data() + 1;
+				size_t remain = c->recv_buffer.size() - 1;
 
-				if (c->recv_buffer.size() < 3 + 17 + num_players * 10) break; //if whole message isn't here, can't process
+				SnapshotHeader header;
+				size_t header_size = decode(begin, remain, &header);
+				if (header_size == 0) break; //if whole message isn't here, can't process
+
+				//(decoded aside: a partial message may have overwritten some fields -- including the tick sent back as seen_tick)
+				SnapshotBody decoded;
+				size_t body_size = decode(begin + header_size, remain - header_size, &decoded);
+				if (body_size == 0) break;
+				snapshot = std::move(decoded);
+
+        state.just_stunned = header.just_stunned;
+        state.red_zone_health = snapshot.red_zone_health;
+        state.blue_zone_health = snapshot.blue_zone_health;
+        state.ball_position = snapshot.ball_position;
 
-        auto buf_it = c->recv_buffer.begin();
-        std::advance(buf_it, 3);
         // Increase vector sizes if needed
-        if(num_players != state.players.size()) {
-          state.players.resize(num_players);
+        if(snapshot.players.size() != state.players.size()) {
+          state.players.resize(snapshot.players.size());
         }
-
-        // Load whether we've been stunned
-        state.just_stunned = buf_it[0];
-        std::advance(buf_it, 1);
-
-        // Load zone healths
-        state.red_zone_health = deserialize_float(buf_it);
-        std::advance(buf_it, 4);
-        state.blue_zone_health = deserialize_float(buf_it);
-        std::advance(buf_it, 4);
-
-        // Load ball position
-        state.ball_position.x = deserialize_float(buf_it);
-        std::advance(buf_it, 4);
-        state.ball_position.y = deserialize_float(buf_it);
-        std::advance(buf_it, 4);
-
-        // Load player positions
-        for(size_t i = 0; i < num_players; i++) {
-          state.players[i].pos.x = deserialize_float(buf_it);
-          std::advance(buf_it, 4);
-          state.players[i].pos.y = deserialize_float(buf_it);
-          std::advance(buf_it, 4);
-          state.players[i].team = buf_it[0];
-          std::advance(buf_it, 1);
-          state.players[i].stunned = buf_it[0];
-          std::advance(buf_it, 1);
+        for(size_t i = 0; i < snapshot.players.size(); i++) {
+          state.players[i].pos = snapshot.players[i].position;
+          state.players[i].team = snapshot.players[i].team;
+          state.players[i].stunned = snapshot.players[i].stunned;
         }
 
 				//and consume this part of the buffer:
-				c->recv_buffer.erase(c->recv_buffer.begin(), buf_it);
+				c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 1 + header_size + body_size);
 			}
 		}
 	}, 0.0);
 }
 
 void PlayMode::draw(glm::uvec2 const &drawable_size) {
-	//vertices will be accumulated into this list and then uploaded+drawn at the end of this function:
-	std::vector< Vertex > vertices;
+	TRACE_SCOPE("PlayMode::draw");
+	//rectangles are collected (one compact record each) and drawn together once the transform is known:
+	// (world_to_clip is filled in below)
+	DrawSprites sprites(glm::mat4(1.0f));
 
 	// inline helper function for rectangle drawing:
-	auto draw_rectangle = [&vertices](glm::vec2 const &center,
+	auto draw_rectangle = [&](glm::vec2 const &center,
 			glm::vec2 const &size, glm::u8vec4 const &color) {
-		// draw rectangle as two CCW-oriented triangles:
-		vertices.emplace_back(glm::vec3(center.x-size.x, center.y-size.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-		vertices.emplace_back(glm::vec3(center.x+size.x, center.y-size.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-		vertices.emplace_back(glm::vec3(center.x+size.x, center.y+size.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-
-		vertices.emplace_back(glm::vec3(center.x-size.x, center.y-size.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-		vertices.emplace_back(glm::vec3(center.x+size.x, center.y+size.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
-		vertices.emplace_back(glm::vec3(center.x-size.x, center.y+size.y, 0.0f), color, glm::vec2(0.5f, 0.5f));
+		sprites.draw(center, size, color);
 	};
 
 	//compute scale factor for court given that...
@@ -371,30 +271,12 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//don't use the depth test:
 	glDisable(GL_DEPTH_TEST);
 
-	//upload vertices to vertex_buffer:
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STREAM_DRAW); //upload vertices array
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	//set color_texture_program as current program:
-	glUseProgram(color_texture_program.program);
-
-	//upload OBJECT_TO_CLIP to the proper uniform location:
-	glUniformMatrix4fv(color_texture_program.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(court_to_clip));
-
-	//use the mapping vertex_buffer_for_color_texture_program to fetch vertex data:
-	glBindVertexArray(vertex_buffer_for_color_texture_program);
-
-	//bind the solid white texture to location zero so things will be drawn just with their colors:
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, white_tex);
-
-	//run the OpenGL pipeline:
-	glDrawArrays(GL_TRIANGLES, 0, GLsizei(vertices.size()));
-
-	//unbind the solid white texture:
-	glBindTexture(GL_TEXTURE_2D, 0);
-
+	//draw all the rectangles (in one instanced draw call):
+	{
+		TRACE_SCOPE("draw sprites");
+		sprites.world_to_clip = court_to_clip;
+		sprites.submit();
+	}
 
 	{ //use DrawLines to overlay some text:
 		glDisable(GL_DEPTH_TEST);
@@ -1,8 +1,8 @@
 #include "Mode.hpp"
 
 #include "ClientState.hpp"
+#include "Messages.hpp"
 #include "Connection.hpp"
-#include "ColorTextureProgram.hpp"
 
 #include "GL.hpp"
 #include <glm/glm.hpp>
@@ -34,6 +34,13 @@ struct PlayMode : Mode {
 
   // State of last received server state
   ClientState state;
+  // Last completely received snapshot (its tick is acked in InputMessage::seen_tick)
+  SnapshotBody snapshot;
+
+  // Input is also re-sent this often without button changes, so the server
+  // has a recent InputMessage::seen_tick to judge this client's lag by
+  static constexpr float input_ack_interval = 0.1f;
+  float since_input = 0.0f;
 
   static constexpr float max_shake_dist = 0.05f;
   static constexpr float shake_reduce = 0.8f;
@@ -44,28 +51,6 @@ struct PlayMode : Mode {
 
 	//----- opengl assets / helpers ------
 
-	//draw functions will work on vectors of vertices, defined as follows:
-	struct Vertex {
-		Vertex(glm::vec3 const &Position_, glm::u8vec4 const &Color_, glm::vec2 const &TexCoord_) :
-			Position(Position_), Color(Color_), TexCoord(TexCoord_) { }
-		glm::vec3 Position;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
-	};
-	static_assert(sizeof(Vertex) == 4*3 + 1*4 + 4*2, "PongMode::Vertex should be packed");
-
-	//Shader program that draws transformed, vertices tinted with vertex colors:
-	ColorTextureProgram color_texture_program;
-
-	//Buffer used to hold vertex data during drawing:
-	GLuint vertex_buffer = 0;
-
-	//Vertex Array Object that maps buffer locations to color_texture_program attribute locations:
-	GLuint vertex_buffer_for_color_texture_program = 0;
-
-	//Solid white texture:
-	GLuint white_tex = 0;
-
 	//matrix that maps from clip coordinates to court-space coordinates:
 	glm::mat3x2 clip_to_court = glm::mat3x2(1.0f);
 	// computed in draw() as the inverse of OBJECT_TO_CLIP
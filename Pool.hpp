@@ -0,0 +1,140 @@
+#pragma once
+
+/*
+ * Pool< T > is an append-only container that stores its elements in
+ * fixed-size contiguous chunks.
+ *
+ * Compared to std::list it has no per-element heap node and iterates over
+ * packed memory, while still never moving elements once they are created
+ * (so pointers to elements stay valid until the pool is cleared).
+ *
+ * Elements are also addressable by index (their order of creation):
+ *
+ * Pool< Thing > things;
+ * Thing &a = things.emplace_back(...);
+ * uint32_t index = things.index_of(&a); //== 0
+ * assert(&things[index] == &a);
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+template< typename T, uint32_t ChunkBits = 8 >
+struct Pool {
+	static constexpr uint32_t ChunkSize = 1 << ChunkBits;
+	static constexpr uint32_t InvalidIndex = -1U;
+
+	Pool() = default;
+	Pool(Pool const &other) { *this = other; }
+	Pool &operator=(Pool const &other) {
+		if (this == &other) return *this;
+		clear();
+		for (T const &t : other) emplace_back(t);
+		return *this;
+	}
+	~Pool() { clear(); }
+
+	//---- std::list-style interface ----
+
+	template< typename... Args >
+	T &emplace_back(Args&&... args) {
+		if ((count & (ChunkSize - 1)) == 0 && (count >> ChunkBits) == chunks.size()) add_chunk();
+		T *t = new (slot(count)) T(std::forward< Args >(args)...);
+		++count;
+		return *t;
+	}
+
+	T &back() { assert(count); return (*this)[count - 1]; }
+	T const &back() const { assert(count); return (*this)[count - 1]; }
+	T &front() { assert(count); return (*this)[0]; }
+	T const &front() const { assert(count); return (*this)[0]; }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	//destroy all elements (chunks are kept for reuse):
+	void clear() {
+		for (uint32_t i = 0; i < count; ++i) {
+			(*this)[i].~T();
+		}
+		count = 0;
+	}
+
+	//---- index handles ----
+
+	T &operator[](uint32_t index) { assert(index < count); return *std::launder(reinterpret_cast< T * >(slot(index))); }
+	T const &operator[](uint32_t index) const { assert(index < count); return *std::launder(reinterpret_cast< T const * >(slot(index))); }
+
+	//index of an element of this pool, or InvalidIndex if 't' isn't in this pool:
+	uint32_t index_of(T const *t) const {
+		if (t == nullptr || chunks_by_address.empty()) return InvalidIndex;
+		//find the last chunk starting at or before t:
+		auto f = std::upper_bound(chunks_by_address.begin(), chunks_by_address.end(), t,
+			[](T const *a, std::pair< T const *, uint32_t > const &b) { return std::less< T const * >()(a, b.first); });
+		if (f == chunks_by_address.begin()) return InvalidIndex;
+		--f;
+		ptrdiff_t offset = t - f->first;
+		if (offset >= ptrdiff_t(ChunkSize)) return InvalidIndex;
+		uint32_t index = (f->second << ChunkBits) + uint32_t(offset);
+		if (index >= count) return InvalidIndex;
+		return index;
+	}
+
+	//---- iteration ----
+
+	template< typename P, typename V >
+	struct Iterator {
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = ptrdiff_t;
+		using pointer = V *;
+		using reference = V &;
+
+		Iterator(P *pool_, uint32_t index_) : pool(pool_), index(index_) { }
+		V &operator*() const { return (*pool)[index]; }
+		V *operator->() const { return &(*pool)[index]; }
+		Iterator &operator++() { ++index; return *this; }
+		Iterator operator++(int) { Iterator ret = *this; ++index; return ret; }
+		bool operator==(Iterator const &o) const { return index == o.index; }
+		bool operator!=(Iterator const &o) const { return index != o.index; }
+
+		P *pool;
+		uint32_t index;
+	};
+	using iterator = Iterator< Pool, T >;
+	using const_iterator = Iterator< Pool const, T const >;
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, count); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, count); }
+
+	//---- internals ----
+
+	struct Chunk {
+		alignas(T) unsigned char data[ChunkSize * sizeof(T)];
+	};
+	std::vector< std::unique_ptr< Chunk > > chunks;
+	std::vector< std::pair< T const *, uint32_t > > chunks_by_address; //(chunk start, chunk number), sorted by start
+	uint32_t count = 0;
+
+	void *slot(uint32_t index) const {
+		return chunks[index >> ChunkBits]->data + (index & (ChunkSize - 1)) * sizeof(T);
+	}
+
+	void add_chunk() {
+		chunks.emplace_back(new Chunk);
+		std::pair< T const *, uint32_t > entry(reinterpret_cast< T const * >(chunks.back()->data), uint32_t(chunks.size() - 1));
+		auto at = std::upper_bound(chunks_by_address.begin(), chunks_by_address.end(), entry,
+			[](std::pair< T const *, uint32_t > const &a, std::pair< T const *, uint32_t > const &b) { return std::less< T const * >()(a.first, b.first); });
+		chunks_by_address.insert(at, entry);
+	}
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// Fixed-size ring buffer of recent server ticks (ball + player positions),
+// used to check steals against what a lagged client was actually seeing.
+//
+// Frames are stored by value in a flat array, so recording a tick and looking
+// one up never allocate, and each lookup only touches one contiguous frame.
+template< uint32_t MaxPlayers, uint32_t Length >
+struct RewindHistory {
+  static_assert((Length & (Length - 1)) == 0, "Length should be a power of two");
+
+  static constexpr uint8_t NoSlot = 0xff;
+
+  struct Frame {
+    uint32_t tick = 0;
+    // Whether this frame holds a recorded tick
+    bool valid = false;
+    glm::vec2 ball_position = glm::vec2(0.0f);
+    // Which slots hold a position in this frame
+    uint64_t present = 0;
+    glm::vec2 player_positions[MaxPlayers];
+
+    void set_player(uint8_t slot, glm::vec2 const &position) {
+      player_positions[slot] = position;
+      present |= (uint64_t(1) << slot);
+    }
+    bool has_player(uint8_t slot) const {
+      return slot != NoSlot && (present & (uint64_t(1) << slot));
+    }
+  };
+
+  // Start recording frame for tick, overwriting the oldest one:
+  Frame &record(uint32_t tick) {
+    Frame &frame = frames[tick & (Length - 1)];
+    frame.tick = tick;
+    frame.valid = true;
+    frame.present = 0;
+    return frame;
+  }
+
+  // Frame for tick, or nullptr if it's too old or was never recorded:
+  Frame const *find(uint32_t tick) const {
+    Frame const &frame = frames[tick & (Length - 1)];
+    if(!frame.valid || frame.tick != tick) return nullptr;
+    return &frame;
+  }
+
+  // Forget everything (e.g. when positions are reset between rounds)
+  void clear() {
+    for(Frame &frame : frames) {
+      frame.valid = false;
+    }
+  }
+
+  // Player slots, so positions can live in a fixed array:
+  uint8_t acquire_slot() {
+    for(uint32_t s = 0; s < MaxPlayers; s++) {
+      if(!(used_slots & (uint64_t(1) << s))) {
+        used_slots |= (uint64_t(1) << s);
+        // Older frames may still hold the previous owner's positions:
+        for(Frame &frame : frames) {
+          frame.present &= ~(uint64_t(1) << s);
+        }
+        return uint8_t(s);
+      }
+    }
+    return NoSlot;
+  }
+
+  void release_slot(uint8_t slot) {
+    if(slot == NoSlot) return;
+    used_slots &= ~(uint64_t(1) << slot);
+  }
+
+  static_assert(MaxPlayers <= 64, "slots are tracked in a uint64_t");
+  uint64_t used_slots = 0;
+
+  Frame frames[Length];
+};
@@ -1,11 +1,17 @@
 #include "Scene.hpp"
+#include "DrawList.hpp"
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+#include "Trace.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
 
 //-------------------------
 
@@ -56,144 +62,323 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_local_to_world() const {
+//generations are unique over all transforms, so a parent being replaced also looks like a change:
+// (atomic so scenes may be updated from other threads, e.g. in a Load<> 'prepare' stage -- every
+//  update in this tree, including SceneStreamer::finish's build_bvh(), currently runs on the main thread)
+static std::atomic< uint64_t > next_generation(1);
+//update passes (see Scene::update_transforms):
+static std::atomic< uint64_t > next_pass(1);
+
+void Scene::Transform::refresh(uint64_t pass) const {
+	if (pass != 0 && cache.checked_pass == pass) return;
+	cache.checked_pass = pass;
+
+	uint64_t parent_generation = 0;
+	if (parent) {
+		parent->refresh(pass);
+		parent_generation = parent->cache.generation;
+	}
+
+	//nothing changed?
+	if (cache.generation != 0
+	 && cache.parent == parent
+	 && cache.parent_generation == parent_generation
+	 && cache.position == position
+	 && cache.rotation == rotation
+	 && cache.scale == scale) return;
+
+	cache.position = position;
+	cache.rotation = rotation;
+	cache.scale = scale;
+	cache.parent = parent;
+	cache.parent_generation = parent_generation;
+	cache.generation = next_generation.fetch_add(1, std::memory_order_relaxed);
+
 	if (!parent) {
-		return make_local_to_parent();
+		cache.local_to_world = make_local_to_parent();
 	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		cache.local_to_world = parent->cache.local_to_world * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
 	}
+	cache.world_to_local_valid = false;
+}
+
+glm::mat4x3 Scene::Transform::make_local_to_world() const {
+	refresh();
+	return cache.local_to_world;
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
-	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	refresh();
+	if (!cache.world_to_local_valid) {
+		if (!parent) {
+			cache.world_to_local = make_parent_to_local();
+		} else {
+			cache.world_to_local = make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		cache.world_to_local_valid = true;
 	}
+	return cache.world_to_local;
 }
 
-//-------------------------
+uint64_t Scene::update_transforms() const {
+	uint64_t pass = next_pass.fetch_add(1, std::memory_order_relaxed);
+	for (auto const &transform : transforms) {
+		transform.refresh(pass);
+	}
+	return pass;
+}
 
-glm::mat4 Scene::Camera::make_projection() const {
-	return glm::infinitePerspective( fovy, aspect, near );
+Scene::Transform *Scene::lookup(Name name) {
+	return const_cast< Transform * >(static_cast< Scene const & >(*this).lookup(name));
+}
+
+Scene::Transform const *Scene::lookup(Name name) const {
+	TransformNames &t = transform_names;
+	auto index_from = [this,&t](uint32_t begin) {
+		for (uint32_t i = begin; i < transforms.size(); ++i) {
+			t.index.emplace(transforms[i].name, i); //(keeps the first of any duplicates)
+		}
+		t.indexed = uint32_t(transforms.size());
+	};
+	if (t.indexed > transforms.size()) { //(transforms were cleared)
+		t.index.clear();
+		t.indexed = 0;
+	}
+	index_from(t.indexed);
+
+	auto f = t.index.find(name);
+	if (f == t.index.end()) return nullptr;
+	if (transforms[f->second].name != name) {
+		//that transform was renamed, so rebuild the index:
+		t.index.clear();
+		index_from(0);
+		f = t.index.find(name);
+		if (f == t.index.end()) return nullptr;
+	}
+	return &transforms[f->second];
 }
 
 //-------------------------
 
+BVH::Box Scene::Drawable::make_world_bounds() const {
+	BVH::Box box;
+	if (!(bounds_min.x <= bounds_max.x && bounds_min.y <= bounds_max.y && bounds_min.z <= bounds_max.z)) return box;
+	glm::mat4x3 const &m = transform->cache.local_to_world;
+	glm::vec3 center = m * glm::vec4(0.5f * (bounds_max + bounds_min), 1.0f);
+	glm::vec3 half_local = 0.5f * (bounds_max - bounds_min);
+	glm::vec3 half = glm::abs(m[0]) * half_local.x + glm::abs(m[1]) * half_local.y + glm::abs(m[2]) * half_local.z;
+	box.min = center - half;
+	box.max = center + half;
+	return box;
+}
 
-void Scene::draw(Camera const &camera) const {
-	assert(camera.transform);
-	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
-	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
-	draw(world_to_clip, world_to_light);
+//split [0, count) into chunks, running 'fn(begin, end)' on several threads if there's enough work:
+template< typename F >
+static void parallel_chunks(uint32_t count, F const &fn) {
+	uint32_t threads = std::max(1U, std::min(std::thread::hardware_concurrency(), count / (BVH::ParallelThreshold / 2)));
+	if (threads <= 1) {
+		fn(0, count);
+		return;
+	}
+	std::vector< std::future< void > > chunks;
+	for (uint32_t t = 0; t < threads; ++t) {
+		chunks.emplace_back(std::async(std::launch::async, fn, uint32_t(uint64_t(count) * t / threads), uint32_t(uint64_t(count) * (t + 1) / threads)));
+	}
+	for (auto &chunk : chunks) {
+		chunk.get();
+	}
+}
+
+void Scene::build_bvh() {
+	TRACE_SCOPE("Scene::build_bvh");
+	uint64_t pass = update_transforms();
+
+	DrawableBVH &d = drawable_bvh;
+	d.boxes.assign(drawables.size(), BVH::Box());
+	d.transforms.assign(drawables.size(), nullptr);
+	d.generations.assign(drawables.size(), 0);
+	d.unbounded.clear();
+	d.foreign_transforms = false;
+	for (uint32_t i = 0; i < drawables.size(); ++i) {
+		Transform const *transform = drawables[i].transform;
+		transform->refresh(pass); //(no-op unless the transform belongs to some other scene)
+		d.transforms[i] = transform;
+		d.generations[i] = transform->cache.generation;
+		if (transforms.index_of(transform) == Pool< Transform >::InvalidIndex) d.foreign_transforms = true;
+	}
+	d.checked_generation = next_generation.load(std::memory_order_relaxed);
+	parallel_chunks(uint32_t(drawables.size()), [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			d.boxes[i] = drawables[i].make_world_bounds();
+		}
+	});
+	for (uint32_t i = 0; i < drawables.size(); ++i) {
+		if (d.boxes[i].empty()) d.unbounded.emplace_back(i);
+	}
+	d.bvh.build(d.boxes);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+uint32_t Scene::update_bvh(uint64_t pass) const {
+	DrawableBVH &d = drawable_bvh;
+	if (d.boxes.empty()) return 0;
+	TRACE_SCOPE("Scene::update_bvh");
+
+	if (d.foreign_transforms) {
+		//(serially, since refresh() may update transforms shared with other scenes' drawables)
+		for (Transform const *transform : d.transforms) {
+			transform->refresh(pass);
+		}
+	}
+	//no world matrix anywhere has been recomputed since the last check?
+	// (generations made by other threads, for other scenes, just mean a wasted check)
+	uint64_t generation = next_generation.load(std::memory_order_relaxed);
+	if (d.checked_generation == generation) return 0;
+	d.checked_generation = generation;
+
+	//find drawables whose world matrices changed since their boxes were computed:
+	static thread_local std::vector< uint32_t > moved;
+	moved.clear();
+	for (uint32_t i = 0; i < d.transforms.size(); ++i) {
+		Transform const &transform = *d.transforms[i];
+		if (transform.cache.generation != d.generations[i]) {
+			d.generations[i] = transform.cache.generation;
+			moved.emplace_back(i);
+		}
+	}
+	if (moved.empty()) return 0;
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+	parallel_chunks(uint32_t(moved.size()), [&](uint32_t begin, uint32_t end) {
+		for (uint32_t m = begin; m < end; ++m) {
+			d.boxes[moved[m]] = drawables[moved[m]].make_world_bounds();
+		}
+	});
+	d.bvh.refit(d.boxes);
+	return uint32_t(moved.size());
+}
 
-		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
-		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
-		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+Scene::Drawable const *Scene::pick(glm::vec3 const &origin, glm::vec3 const &direction, float *distance) const {
+	uint64_t pass = update_transforms();
+	update_bvh(pass);
+
+	glm::vec3 inv_direction = 1.0f / direction;
+	float t = std::numeric_limits< float >::infinity();
+	Drawable const *best = nullptr;
+	auto check = [&](Drawable const &drawable) {
+		drawable.transform->refresh(pass);
+		BVH::Box box = drawable.make_world_bounds();
+		if (box.empty()) return;
+		float hit = BVH::ray_box(origin, inv_direction, box.min, box.max, t);
+		if (hit < t) {
+			t = hit;
+			best = &drawable;
+		}
+	};
 
+	uint32_t begin = 0; //first drawable not covered by the BVH
+	if (!drawable_bvh.bvh.empty()) {
+		uint32_t item = drawable_bvh.bvh.raycast(origin, direction, t, [](uint32_t, float enter) {
+			return enter; //(boxes are all there is to test)
+		});
+		if (item != -1U) best = &drawables[item];
+		begin = uint32_t(drawable_bvh.boxes.size());
+	}
+	for (uint32_t i = begin; i < drawables.size(); ++i) {
+		check(drawables[i]);
+	}
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+	if (distance) *distance = t;
+	return best;
+}
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+void Scene::find_near(glm::vec3 const &center, float radius, std::function< void(Drawable const &) > const &callback) const {
+	uint64_t pass = update_transforms();
+	update_bvh(pass);
 
-		//Configure program uniforms:
+	auto check = [&](Drawable const &drawable) {
+		drawable.transform->refresh(pass);
+		BVH::Box box = drawable.make_world_bounds();
+		if (box.empty()) return;
+		glm::vec3 d = glm::max(box.min - center, glm::max(glm::vec3(0.0f), center - box.max));
+		if (glm::dot(d, d) <= radius * radius) callback(drawable);
+	};
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+	uint32_t begin = 0; //first drawable not covered by the BVH
+	if (!drawable_bvh.bvh.empty()) {
+		drawable_bvh.bvh.query_sphere(center, radius, [&](uint32_t item) {
+			callback(drawables[item]);
+		});
+		begin = uint32_t(drawable_bvh.boxes.size());
+	}
+	for (uint32_t i = begin; i < drawables.size(); ++i) {
+		check(drawables[i]);
+	}
+}
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
-		}
+//-------------------------
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+glm::mat4 Scene::Camera::make_projection() const {
+	return glm::infinitePerspective( fovy, aspect, near );
+}
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
-		}
+//-------------------------
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
-		}
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+void Scene::bind_uniform_blocks(GLuint program) {
+	GLuint frame = glGetUniformBlockIndex(program, "Frame");
+	if (frame != GL_INVALID_INDEX) glUniformBlockBinding(program, frame, FrameBlockBinding);
+	GLuint draw = glGetUniformBlockIndex(program, "Draw");
+	if (draw != GL_INVALID_INDEX) glUniformBlockBinding(program, draw, DrawBlockBinding);
+}
 
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
-			}
-		}
+Scene::DrawStats Scene::draw(Camera const &camera) const {
+	assert(camera.transform);
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
+	return draw(world_to_clip, world_to_light);
+}
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+Scene::DrawStats Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	TRACE_SCOPE("Scene::draw");
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
-		}
-		glActiveTexture(GL_TEXTURE0);
+	//bring all world matrices up to date (only recomputes what changed since last frame):
+	uint64_t pass = update_transforms();
 
-	}
+	//gather drawables in the view frustum and sort them so that drawables sharing a program / vertex array / textures are drawn together:
+	// (a single list is re-used between calls to avoid re-allocating every frame)
+	static DrawList draw_list;
+	draw_list.clear();
+	draw_list.add(*this, world_to_clip, pass);
+	draw_list.sort();
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+	//send them to OpenGL, skipping binds of state that's already current:
+	DrawStateCache state(gl_draw_backend());
+	draw_list.submit(world_to_clip, world_to_light, state);
+	state.reset();
 
 	GL_ERRORS();
+
+	DrawStats stats = draw_list.stats;
+	stats.program_changes = state.stats.program_changes;
+	stats.vao_changes = state.stats.vao_changes;
+	stats.texture_changes = state.stats.texture_changes;
+	return stats;
 }
 
 
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
-
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	//chunks are read straight out of the mapped file (no intermediate copies):
+	MappedFile file(filename);
+	ChunkReader chunks(file.data(), file.size(), filename);
 
-	struct HierarchyEntry {
-		uint32_t parent;
-		uint32_t name_begin;
-		uint32_t name_end;
-		glm::vec3 position;
-		glm::quat rotation;
-		glm::vec3 scale;
+	ChunkSpan< char > names = chunks.read< char >("str0");
+	auto name_view = [&names](uint32_t begin, uint32_t end) {
+		return std::string_view(names.data() + begin, end - begin);
 	};
-	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
 
-	struct MeshEntry {
-		uint32_t transform;
-		uint32_t name_begin;
-		uint32_t name_end;
-	};
-	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkSpan< HierarchyEntry > hierarchy = chunks.read< HierarchyEntry >("xfh0");
+
+	ChunkSpan< MeshEntry > meshes = chunks.read< MeshEntry >("msh0");
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +387,7 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	ChunkSpan< CameraEntry > cameras = chunks.read< CameraEntry >("cam0");
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,8 +398,7 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
+	ChunkSpan< LightEntry > lights = chunks.read< LightEntry >("lmp0");
 
 
 	//--------------------------------
@@ -235,7 +418,7 @@ void Scene::load(std::string const &filename,
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			t->name = Name(name_view(h.name_begin, h.name_end));
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -248,6 +431,7 @@ void Scene::load(std::string const &filename,
 	}
 	assert(hierarchy_transforms.size() == hierarchy.size());
 
+	std::string name; //(reused, so each mesh's name doesn't need a fresh allocation)
 	for (auto const &m : meshes) {
 		if (m.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
@@ -255,7 +439,7 @@ void Scene::load(std::string const &filename,
 		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
+		name = name_view(m.name_begin, m.name_end);
 
 		if (on_drawable) {
 			on_drawable(*this, hierarchy_transforms[m.transform], name);
@@ -302,9 +486,9 @@ void Scene::load(std::string const &filename,
 	}
 
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	load_extra(chunks, names, hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	if (chunks.remaining() != 0) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -327,51 +511,66 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
-
-	transform_to_transform.clear();
+void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map) {
 
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
+	//transform i in this scene is a copy of transform i in other, so pointers are remapped by index:
+	auto remap = [this,&other](Transform const *t) -> Transform * {
+		if (t == nullptr) return nullptr;
+		uint32_t index = other.transforms.index_of(t);
+		if (index == Pool< Transform >::InvalidIndex) {
+			throw std::out_of_range("Scene::set: object refers to a transform from outside the scene.");
+		}
+		return &transforms[index];
+	};
 
-	//Copy transforms and store mapping:
+	//Copy transforms:
 	transforms.clear();
+	transform_names = TransformNames();
 	for (auto const &t : other.transforms) {
 		transforms.emplace_back();
 		transforms.back().name = t.name;
 		transforms.back().position = t.position;
 		transforms.back().rotation = t.rotation;
 		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
-
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
 	}
 
 	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	for (uint32_t i = 0; i < transforms.size(); ++i) {
+		transforms[i].parent = remap(other.transforms[i].parent);
 	}
 
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		d.transform = remap(d.transform);
 	}
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		c.transform = remap(c.transform);
 	}
 
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		l.transform = remap(l.transform);
+	}
+
+	//copy other's BVH (it refers to drawables by index, so it still fits), but refit it before use:
+	drawable_bvh = other.drawable_bvh;
+	for (uint32_t i = 0; i < drawable_bvh.transforms.size(); ++i) {
+		drawable_bvh.transforms[i] = drawables[i].transform;
+	}
+	std::fill(drawable_bvh.generations.begin(), drawable_bvh.generations.end(), 0);
+	drawable_bvh.checked_generation = 0;
+
+	//if requested, also supply the old -> new mapping:
+	if (transform_map) {
+		transform_map->clear();
+		transform_map->insert(std::make_pair(nullptr, nullptr));
+		for (uint32_t i = 0; i < transforms.size(); ++i) {
+			transform_map->insert(std::make_pair(&other.transforms[i], &transforms[i]));
+		}
 	}
 }
@@ -11,21 +11,26 @@
  */
 
 #include "GL.hpp"
+#include "Name.hpp"
+#include "Pool.hpp"
+#include "BVH.hpp"
+#include "read_write_chunk.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-#include <list>
+#include <algorithm>
 #include <memory>
 #include <functional>
+#include <limits>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
 struct Scene {
 	struct Transform {
-		//Transform names are useful for debugging and looking up locations in a loaded scene:
-		std::string name;
+		//Transform names are useful for debugging and looking up locations in a loaded scene (see Scene::lookup):
+		Name name;
 
 		//The core function of a transform is to store a transformation in the world:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -40,10 +45,37 @@ struct Scene {
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
 		// ..relative to the world:
+		// (these are cached, and only recomputed when this transform or an ancestor has changed)
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
+		//Cached world matrices -- valid after a call to refresh() or Scene::update_transforms():
+		struct Cache {
+			//position/rotation/scale/parent that the matrices were computed from:
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			uint64_t parent_generation = 0;
+
+			//changes every time local_to_world is recomputed (0 == never computed):
+			uint64_t generation = 0;
+			//last update pass that checked this transform:
+			uint64_t checked_pass = 0;
+
+			glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+			glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+			bool world_to_local_valid = false; //(computed on demand)
+		};
+		mutable Cache cache;
+
+		//Bring 'cache' up to date; any change to position/rotation/scale/parent is detected here,
+		// and also invalidates the subtree below this transform (via parent_generation):
+		// (pass != 0 means "skip if already checked during update pass 'pass'")
+		void refresh(uint64_t pass = 0) const;
+
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
+		// (Scene stores transforms in a Pool, so these pointers stay valid as more are added)
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
@@ -54,6 +86,20 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//object-space bounding box of whatever the pipeline draws (e.g., Mesh::min / Mesh::max), used for frustum culling:
+		// (the default, min > max, means "unknown"; such drawables are never culled)
+		glm::vec3 bounds_min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 bounds_max = glm::vec3(-std::numeric_limits< float >::infinity());
+		//...transformed to a world-space box (using the transform's cached world matrix; empty if bounds are unknown):
+		BVH::Box make_world_bounds() const;
+
+		//level of detail to draw -- 0 for the pipeline's own start / count, i > 0 for pipeline.lods[i-1]:
+		// (draw() picks this from the drawable's size on screen; see Scene::lod_policy)
+		mutable uint32_t lod = 0;
+		//...and the range of vertices (or indices) that means:
+		GLuint lod_start() const { uint32_t l = std::min(lod, pipeline.lod_levels); return l == 0 ? pipeline.start : pipeline.lods[l-1].start; }
+		GLuint lod_count() const { uint32_t l = std::min(lod, pipeline.lod_levels); return l == 0 ? pipeline.count : pipeline.lods[l-1].count; }
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -64,14 +110,59 @@ struct Scene {
 			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
+			//...or, for indexed meshes, 'start' / 'count' are a range of the vao's element buffer; passed to glDrawElementsBaseVertex:
+			GLenum index_type = GL_NONE; //GL_UNSIGNED_SHORT / GL_UNSIGNED_INT, or GL_NONE to draw arrays
+			GLint base_vertex = 0; //added to each index
+			//for meshes from compact MeshBuffers, maps the (quantized) vertex positions to object space
+			// -- object position = position_offset + position_scale * Position -- copy these from Mesh:
+			// (folded into the object matrices when drawing, so programs don't need to know)
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_offset = glm::vec3(0.0f);
+
+			//(optional) simplified versions of the mesh, drawn instead of start / count when it's small on screen;
+			// copy these from Mesh::lods -- each level's 'error' is in object space:
+			enum : uint32_t { MaxLODs = 3 };
+			struct LOD {
+				GLuint start = 0;
+				GLuint count = 0;
+				float error = 0.0f;
+			} lods[MaxLODs];
+			uint32_t lod_levels = 0; //how many of 'lods' are in use
 
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
+			//...or, if set, the program reads those three matrices from the "Draw" uniform block instead (see Scene::DrawBlock):
+			bool uses_draw_block = false;
 
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
+			//(optional) instanced variant of 'program':
+			// runs of drawables whose pipelines match in everything but their transform are drawn with one
+			// glDrawArraysInstanced call through this program, which reads each drawable's matrices from
+			// per-instance vertex attributes (see InstanceData) instead of the uniforms above.
+			// (only used for drawables without set_uniforms, and only while 'program' == 'base' -- so pointing
+			//  a copied pipeline at a different program turns instancing off)
+			struct Instanced {
+				GLuint program = 0;
+				GLuint base = 0; //the program this is a variant of
+
+				//uniform locations (shared by all instances; programs can also get these from the "Frame" block -- see Scene::FrameBlock):
+				GLuint WORLD_TO_CLIP_mat4 = -1U;
+				GLuint WORLD_TO_LIGHT_mat4x3 = -1U;
+				GLuint NORMAL_WORLD_TO_LIGHT_mat3 = -1U; //inverse transpose of WORLD_TO_LIGHT's upper 3x3
+
+				//per-instance attributes, at fixed locations:
+				// OBJECT_TO_WORLD (mat4x3) at AttribLocation + 0..3, NORMAL_TO_WORLD (mat3) at AttribLocation + 4..6
+				// (so the vertex array's own attributes need to be at locations below AttribLocation)
+				enum : GLuint { AttribLocation = 8 };
+				struct InstanceData {
+					glm::mat4x3 object_to_world;
+					glm::mat3 normal_to_world;
+				};
+			} instanced;
+
 			//texture objects to bind for the first TextureCount textures:
 			enum : uint32_t { TextureCount = 4 };
 			struct TextureInfo {
@@ -117,16 +208,147 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	// (Pools are packed, pointer-stable, and index-addressable; see Pool.hpp)
+	Pool< Transform > transforms;
+	Pool< Drawable > drawables;
+	Pool< Camera > cameras;
+	Pool< Light > lights;
+
+	//Refresh the cached world matrices of every transform in one pass:
+	// (a linear sweep over 'transforms', which is in topological order for loaded scenes;
+	//  other parents are handled before their children, and unchanged subtrees are skipped)
+	// returns the pass number, which can be passed to Transform::refresh() to skip re-checking
+	uint64_t update_transforms() const;
+
+	//Find the first transform (in 'transforms') with a given name, or nullptr:
+	// e.g., Scene::Transform *hip = scene.lookup("Hip.FL"_name);
+	// (a hash table probe; the table is brought up to date with transforms added since the last lookup, but
+	//  a transform renamed after that may not be found by its new name -- set() and load() are fine)
+	Transform *lookup(Name name);
+	Transform const *lookup(Name name) const;
+
+	struct TransformNames {
+		std::unordered_map< Name, uint32_t > index; //name -> first transform with that name
+		uint32_t indexed = 0; //transforms[0, indexed) are in 'index'
+	};
+	mutable TransformNames transform_names;
+
+	//---- bounding volume hierarchy ----
+	//Optionally, a BVH over the world bounds of drawables can speed up culling and picking in large scenes.
+	// build_bvh() builds it over all drawables with known bounds; draw(), pick(), and find_near() then use it,
+	// refitting it first if any of those drawables have moved.
+	// (Rebuild it after adding drawables or changing their bounds_min / bounds_max / transform -- until then,
+	//  draw() checks drawables added since the build one-by-one, and other changes are not noticed.)
+	void build_bvh();
+
+	//refit the BVH to drawables whose transforms have changed (called by draw(), etc; 'pass' is from update_transforms()):
+	// returns the number of drawables that moved
+	uint32_t update_bvh(uint64_t pass) const;
+
+	struct DrawableBVH {
+		BVH bvh; //items are indices into 'drawables'
+		std::vector< BVH::Box > boxes; //world bounds of drawables[0 .. boxes.size()) (empty for unknown bounds)
+		std::vector< Transform const * > transforms; //drawables[i].transform, for quickly checking whether boxes moved
+		std::vector< uint64_t > generations; //transform cache generation each box was computed from
+		std::vector< uint32_t > unbounded; //drawables in [0, boxes.size()) with unknown bounds
+		uint64_t checked_generation = 0; //if no transform anywhere has been recomputed since this, nothing moved
+		bool foreign_transforms = false; //do any drawables use transforms from other scenes? (these need refresh() calls)
+	};
+	mutable DrawableBVH drawable_bvh;
+
+	//closest drawable whose world bounds are hit by a ray, or nullptr:
+	// (boxes only -- no triangle tests; 'distance', if given, gets the distance in units of 'direction')
+	Drawable const *pick(glm::vec3 const &origin, glm::vec3 const &direction, float *distance = nullptr) const;
+
+	//call 'callback' for every drawable whose world bounds overlap a sphere:
+	void find_near(glm::vec3 const &center, float radius, std::function< void(Drawable const &) > const &callback) const;
+
+	//---- uniform blocks ----
+	//draw() provides these std140 uniform blocks to the programs it runs:
+	// (a program using them should call bind_uniform_blocks() once after linking)
+
+	//"Frame" -- per-call values, bound at FrameBlockBinding:
+	struct FrameBlock {
+		glm::mat4 WORLD_TO_CLIP;
+		glm::vec4 WORLD_TO_LIGHT[4]; //mat4x3 (std140 pads each column to a vec4)
+		glm::vec4 NORMAL_WORLD_TO_LIGHT[3]; //mat3
+	};
+	//"Draw" -- per-drawable matrices (for pipelines with uses_draw_block), bound at DrawBlockBinding:
+	struct DrawBlock {
+		glm::mat4 OBJECT_TO_CLIP;
+		glm::vec4 OBJECT_TO_LIGHT[4]; //mat4x3
+		glm::vec4 NORMAL_TO_LIGHT[3]; //mat3
+	};
+	enum : GLuint {
+		FrameBlockBinding = 0,
+		DrawBlockBinding = 1,
+	};
+	//GLSL declarations matching the above, to paste into shaders:
+	static constexpr char const *FrameBlockGLSL =
+		"layout(std140) uniform Frame {\n"
+		"	mat4 WORLD_TO_CLIP;\n"
+		"	mat4x3 WORLD_TO_LIGHT;\n"
+		"	mat3 NORMAL_WORLD_TO_LIGHT;\n"
+		"};\n";
+	static constexpr char const *DrawBlockGLSL =
+		"layout(std140) uniform Draw {\n"
+		"	mat4 OBJECT_TO_CLIP;\n"
+		"	mat4x3 OBJECT_TO_LIGHT;\n"
+		"	mat3 NORMAL_TO_LIGHT;\n"
+		"};\n";
+	//point a program's Frame / Draw blocks (whichever it has) at the bindings above:
+	static void bind_uniform_blocks(GLuint program);
+
+	//Level of detail selection:
+	// draw() gives drawables with Pipeline::lods the simplest level whose error covers at most 'max_error'
+	// of the screen's height; a level is only switched to once that's true by a margin of 'hysteresis'
+	// (relative), so drawables near a threshold don't flicker back and forth.
+	// (the chosen level is remembered in Drawable::lod, so drawing the scene from two very different
+	//  viewpoints every frame -- e.g., for a shadow map -- will defeat the hysteresis)
+	struct LODPolicy {
+		bool enabled = true;
+		float max_error = 0.001f; //(about a pixel at 1080p)
+		float hysteresis = 0.25f;
+	} lod_policy;
+
+	//What a call to draw() did:
+	struct DrawStats {
+		uint32_t drawables = 0; //drawables with something to draw...
+		uint32_t culled = 0; //...that were outside the view frustum
+		uint32_t drawn = 0; //...that were sent to OpenGL
+		uint32_t instanced = 0; //...of which this many were drawn as part of an instanced draw
+		uint32_t simplified = 0; //...and this many at a simpler level of detail
+		uint64_t elements = 0; //vertices (or indices) drawn, counting each instance
+		uint32_t draw_calls = 0;
+		uint32_t program_changes = 0;
+		uint32_t vao_changes = 0;
+		uint32_t texture_changes = 0;
+	};
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
-	void draw(Camera const &camera) const;
+	// (drawables whose bounds are outside the camera's view frustum are skipped)
+	DrawStats draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
-	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+	DrawStats draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+
+	//entries in a scene file's transform hierarchy ("xfh0") and mesh ("msh0") chunks:
+	// (names are ranges of the "str0" chunk; parents come before their children)
+	struct HierarchyEntry {
+		uint32_t parent; //index in "xfh0", or -1U
+		uint32_t name_begin;
+		uint32_t name_end;
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
+	struct MeshEntry {
+		uint32_t transform; //index in "xfh0"
+		uint32_t name_begin;
+		uint32_t name_end;
+	};
+	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
 
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
@@ -137,7 +359,8 @@ struct Scene {
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	// ('from' reads further chunks out of the mapped file; see read_write_chunk.hpp)
+	virtual void load_extra(ChunkReader &from, ChunkSpan< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
@@ -145,7 +368,7 @@ struct Scene {
 	//load a scene:
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
 
-	//copy a scene (with proper pointer fixup):
+	//copy a scene (with proper pointer fixup, by index):
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
@@ -0,0 +1,429 @@
+#include "SceneStreamer.hpp"
+#include "DrawList.hpp"
+
+#include "gl_errors.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <map>
+
+namespace {
+	//world-space box around an object-space box (as in Scene::Drawable::make_world_bounds):
+	BVH::Box world_box(glm::mat4x3 const &m, glm::vec3 const &min, glm::vec3 const &max) {
+		BVH::Box box;
+		glm::vec3 center = m * glm::vec4(0.5f * (max + min), 1.0f);
+		glm::vec3 half_local = 0.5f * (max - min);
+		glm::vec3 half = glm::abs(m[0]) * half_local.x + glm::abs(m[1]) * half_local.y + glm::abs(m[2]) * half_local.z;
+		box.min = center - half;
+		box.max = center + half;
+		return box;
+	}
+
+	float distance_to(BVH::Box const &box, glm::vec3 const &point) {
+		glm::vec3 d = glm::max(box.min - point, glm::max(glm::vec3(0.0f), point - box.max));
+		return glm::length(d);
+	}
+}
+
+SceneStreamer::SceneStreamer(std::string const &scene_filename, std::string const &meshes_filename, Settings const &settings_, OnDrawable const &on_drawable_)
+	: settings(settings_), on_drawable(on_drawable_), scene_file(scene_filename) {
+
+	//read the parts of the scene file that are streamed (see Scene::load):
+	chunks.reset(new ChunkReader(scene_file.data(), scene_file.size(), scene_filename));
+	names = chunks->read< char >("str0");
+	hierarchy = chunks->read< Scene::HierarchyEntry >("xfh0");
+	meshes = chunks->read< Scene::MeshEntry >("msh0");
+
+	auto name_view = [this](uint32_t begin, uint32_t end) {
+		return std::string_view(names.data() + begin, end - begin);
+	};
+
+	//check it over (the loader thread trusts it), computing world matrices along the way:
+	std::vector< glm::mat4x3 > local_to_world;
+	local_to_world.reserve(hierarchy.size());
+	for (auto const &h : hierarchy) {
+		if (h.parent != -1U && h.parent >= local_to_world.size()) {
+			throw std::runtime_error("scene file '" + scene_filename + "' did not contain transforms in topological-sort order.");
+		}
+		if (!(h.name_begin <= h.name_end && h.name_end <= names.size())) {
+			throw std::runtime_error("scene file '" + scene_filename + "' contains hierarchy entry with invalid name indices");
+		}
+		Scene::Transform transform;
+		transform.position = h.position;
+		transform.rotation = h.rotation;
+		transform.scale = h.scale;
+		if (h.parent == -1U) {
+			local_to_world.emplace_back(transform.make_local_to_parent());
+		} else {
+			local_to_world.emplace_back(local_to_world[h.parent] * glm::mat4(transform.make_local_to_parent()));
+		}
+	}
+
+	source = MeshBuffer::read(meshes_filename, settings.layout);
+
+	std::vector< BVH::Box > boxes; //world bounds of each mesh entry
+	boxes.reserve(meshes.size());
+	std::vector< Mesh const * > entry_meshes; //mesh of each mesh entry
+	entry_meshes.reserve(meshes.size());
+	BVH::Box everything;
+	for (auto const &m : meshes) {
+		if (m.transform >= hierarchy.size()) {
+			throw std::runtime_error("scene file '" + scene_filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
+		}
+		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
+			throw std::runtime_error("scene file '" + scene_filename + "' contains mesh entry with invalid name indices");
+		}
+		auto f = source->meshes.find(name_view(m.name_begin, m.name_end));
+		if (f == source->meshes.end()) {
+			throw std::runtime_error("scene file '" + scene_filename + "' uses mesh '" + std::string(name_view(m.name_begin, m.name_end)) + "', which isn't in '" + meshes_filename + "'.");
+		}
+		Mesh const &mesh = f->second;
+		entry_meshes.emplace_back(&mesh);
+		BVH::Box box;
+		if (mesh.min.x <= mesh.max.x && mesh.min.y <= mesh.max.y && mesh.min.z <= mesh.max.z) {
+			box = world_box(local_to_world[m.transform], mesh.min, mesh.max);
+		} else {
+			box.expand(local_to_world[m.transform][3]); //(empty meshes are placed by their transform)
+		}
+		boxes.emplace_back(box);
+		everything.expand(box);
+	}
+
+	//fill in the settings left to be picked:
+	if (!(settings.cell_size > 0.0f)) {
+		glm::vec3 size = (everything.empty() ? glm::vec3(0.0f) : everything.max - everything.min);
+		settings.cell_size = std::max(size.x, size.y) / 16.0f;
+		if (!(settings.cell_size > 0.0f)) settings.cell_size = 1.0f;
+	}
+	if (!(settings.load_radius > 0.0f)) settings.load_radius = 2.0f * settings.cell_size;
+	if (!(settings.unload_radius > 0.0f)) settings.unload_radius = 1.5f * settings.load_radius;
+	settings.unload_radius = std::max(settings.unload_radius, settings.load_radius);
+
+	//sort mesh entries into cells:
+	std::map< std::pair< int32_t, int32_t >, uint32_t > cell_at;
+	for (uint32_t i = 0; i < meshes.size(); ++i) {
+		glm::vec3 center = boxes[i].center();
+		glm::ivec2 coord = glm::ivec2(glm::floor(glm::vec2(center) / settings.cell_size));
+		auto inserted = cell_at.emplace(std::make_pair(coord.x, coord.y), uint32_t(cells.size()));
+		if (inserted.second) {
+			cells.emplace_back();
+			cells.back().coord = coord;
+		}
+		Cell &cell = cells[inserted.first->second];
+		cell.meshes.emplace_back(i);
+		cell.bounds.expand(boxes[i]);
+	}
+	stats.cells = uint32_t(cells.size());
+
+	//estimate the mesh data each cell will need before it's read, so update() can count cells still loading
+	// against Settings::resident_budget -- each mesh once, as read_subset copies it:
+	size_t stride = size_t(source->Position.stride);
+	std::vector< GLint > bases; //(indexed meshes use the vertices from their base_vertex up to the next mesh's)
+	for (auto const &[name, mesh] : source->meshes) {
+		if (mesh.index_type != GL_NONE) bases.emplace_back(mesh.base_vertex);
+	}
+	if (stride) bases.emplace_back(GLint(source->vertices_size / stride));
+	std::sort(bases.begin(), bases.end());
+	auto mesh_bytes = [&](Mesh const &mesh) {
+		if (mesh.index_type == GL_NONE) return size_t(mesh.count) * stride;
+		size_t indices = mesh.count;
+		for (uint32_t l = 0; l < mesh.lod_levels; ++l) indices += mesh.lods[l].count;
+		auto next = std::upper_bound(bases.begin(), bases.end(), mesh.base_vertex);
+		size_t vertices = (next == bases.end() ? 0 : size_t(*next - mesh.base_vertex));
+		return indices * (mesh.index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t)) + vertices * stride;
+	};
+	for (auto &cell : cells) {
+		std::vector< Mesh const * > used;
+		for (uint32_t m : cell.meshes) used.emplace_back(entry_meshes[m]);
+		std::sort(used.begin(), used.end());
+		used.erase(std::unique(used.begin(), used.end()), used.end());
+		for (Mesh const *mesh : used) cell.estimated_bytes += mesh_bytes(*mesh);
+	}
+
+	std::cout << "Streaming " << meshes.size() << " meshes from '" << scene_filename << "' in " << cells.size() << " cells of size " << settings.cell_size
+		<< " (loading within " << settings.load_radius << ", unloading beyond " << settings.unload_radius << ")." << std::endl;
+
+	loader = std::thread([this](){ load_cells(); });
+}
+
+SceneStreamer::~SceneStreamer() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	loader.join();
+
+	for (auto &cell : cells) {
+		if (cell.state == Cell::Loaded) unload(cell);
+	}
+}
+
+void SceneStreamer::load_cells() {
+	Trace::set_thread_name("scene streamer");
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		wake.wait(lock, [this](){ return quit || !queue.empty(); });
+		if (quit) break;
+
+		//prepare the nearest queued cell:
+		auto next = std::min_element(queue.begin(), queue.end(), [this](uint32_t a, uint32_t b) {
+			return cells[a].distance < cells[b].distance;
+		});
+		Cell &cell = cells[*next];
+		queue.erase(next);
+		assert(cell.state == Cell::Queued);
+		cell.state = Cell::Preparing;
+
+		lock.unlock();
+		try {
+			prepare(cell);
+		} catch (...) {
+			cell.error = std::current_exception();
+		}
+		lock.lock();
+
+		cell.state = Cell::Prepared;
+	}
+}
+
+void SceneStreamer::prepare(Cell &cell) const {
+	TRACE_SCOPE("SceneStreamer::prepare");
+
+	//the transforms the cell's meshes hang from -- and their ancestors -- in file order (so parents come first):
+	std::vector< uint32_t > used;
+	for (uint32_t m : cell.meshes) {
+		for (uint32_t t = meshes[m].transform; t != -1U; t = hierarchy[t].parent) {
+			used.emplace_back(t);
+		}
+	}
+	std::sort(used.begin(), used.end());
+	used.erase(std::unique(used.begin(), used.end()), used.end());
+
+	cell.scene.reset(new Scene);
+	std::vector< Scene::Transform * > transforms; //(same order as 'used')
+	transforms.reserve(used.size());
+	for (uint32_t t : used) {
+		Scene::HierarchyEntry const &h = hierarchy[t];
+		Scene::Transform *transform = &cell.scene->transforms.emplace_back();
+		transform->name = Name(std::string_view(names.data() + h.name_begin, h.name_end - h.name_begin));
+		transform->position = h.position;
+		transform->rotation = h.rotation;
+		transform->scale = h.scale;
+		if (h.parent != -1U) {
+			transform->parent = transforms[std::lower_bound(used.begin(), used.end(), h.parent) - used.begin()];
+		}
+		transforms.emplace_back(transform);
+	}
+
+	std::vector< std::string_view > mesh_names;
+	cell.drawables.clear();
+	for (uint32_t m : cell.meshes) {
+		Scene::MeshEntry const &entry = meshes[m];
+		std::string_view name(names.data() + entry.name_begin, entry.name_end - entry.name_begin);
+		Scene::Transform *transform = transforms[std::lower_bound(used.begin(), used.end(), entry.transform) - used.begin()];
+		cell.drawables.emplace_back(transform, Name(name));
+		mesh_names.emplace_back(name);
+	}
+	std::sort(mesh_names.begin(), mesh_names.end());
+	mesh_names.erase(std::unique(mesh_names.begin(), mesh_names.end()), mesh_names.end());
+
+	cell.data = MeshBuffer::read_subset(*source, mesh_names);
+	cell.bytes = cell.data->vertices_size + cell.data->indices_size;
+}
+
+void SceneStreamer::finish(Cell &cell) {
+	TRACE_SCOPE("SceneStreamer::finish");
+	assert(cell.state == Cell::Prepared && cell.data);
+
+	cell.buffer.reset(new MeshBuffer(std::move(*cell.data)));
+	cell.data.reset();
+	if (settings.program) cell.vao = cell.buffer->make_vao_for_program(settings.program);
+
+	for (auto const &[transform, name] : cell.drawables) {
+		on_drawable(*cell.scene, transform, cell.buffer->lookup(name), cell.vao);
+	}
+	cell.drawables.clear();
+	cell.scene->build_bvh();
+
+	GL_ERRORS();
+}
+
+void SceneStreamer::unload(Cell &cell) {
+	if (cell.vao) glDeleteVertexArrays(1, &cell.vao);
+	cell.vao = 0;
+	if (cell.buffer) {
+		glDeleteBuffers(1, &cell.buffer->buffer);
+		if (cell.buffer->index_buffer) glDeleteBuffers(1, &cell.buffer->index_buffer);
+	}
+	cell.buffer.reset();
+	cell.scene.reset();
+	cell.drawables.clear();
+	cell.data.reset();
+	cell.bytes = 0;
+	cell.state = Cell::Unloaded;
+}
+
+void SceneStreamer::update(glm::vec3 const &focus) {
+	TRACE_SCOPE("SceneStreamer::update");
+
+	stats.uploaded = 0;
+	stats.uploaded_bytes = 0;
+	stats.unloaded = 0;
+
+	std::vector< Cell * > ready; //prepared cells to upload
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		std::vector< uint32_t > wanted; //unloaded cells within the load radius
+		for (uint32_t c = 0; c < cells.size(); ++c) {
+			Cell &cell = cells[c];
+			cell.distance = distance_to(cell.bounds, focus);
+			if (cell.distance > settings.unload_radius) {
+				//not wanted any more:
+				if (cell.state == Cell::Queued) {
+					queue.erase(std::find(queue.begin(), queue.end(), c));
+					cell.state = Cell::Unloaded;
+				} else if (cell.state == Cell::Prepared) {
+					if (cell.error) std::rethrow_exception(cell.error);
+					unload(cell); //(nothing uploaded yet, so this just drops the prepared data)
+				} else if (cell.state == Cell::Loaded) {
+					stats.resident_bytes -= cell.bytes;
+					unload(cell);
+					stats.unloaded += 1;
+				}
+				//(Preparing cells are dropped once they're Prepared)
+			} else if (cell.state == Cell::Unloaded) {
+				if (cell.distance <= settings.load_radius) wanted.emplace_back(c);
+			} else if (cell.state == Cell::Prepared) {
+				if (cell.error) std::rethrow_exception(cell.error);
+				ready.emplace_back(&cell);
+			}
+		}
+
+		//ask for wanted cells, nearest first, while the mesh data loaded and on its way fits in the budget:
+		// (cells still loading count too, or a fast-moving focus could queue far more than the budget before any of it is resident)
+		size_t loading_bytes = 0;
+		for (auto const &cell : cells) loading_bytes += loading_estimate(cell);
+		std::sort(wanted.begin(), wanted.end(), [this](uint32_t a, uint32_t b) {
+			return cells[a].distance < cells[b].distance;
+		});
+		for (uint32_t c : wanted) {
+			if (stats.resident_bytes + loading_bytes >= settings.resident_budget) break;
+			cells[c].state = Cell::Queued;
+			queue.emplace_back(c);
+			loading_bytes += cells[c].estimated_bytes;
+		}
+	}
+	wake.notify_one();
+
+	//upload prepared cells, nearest first, until this frame's budget is spent:
+	// (prepared cells belong to the main thread, so no lock needed)
+	std::sort(ready.begin(), ready.end(), [](Cell const *a, Cell const *b) {
+		return a->distance < b->distance;
+	});
+	for (Cell *cell : ready) {
+		if (stats.uploaded > 0 && stats.uploaded_bytes + cell->bytes > settings.upload_budget) break;
+		finish(*cell);
+		stats.uploaded += 1;
+		stats.uploaded_bytes += cell->bytes;
+		stats.resident_bytes += cell->bytes;
+		std::unique_lock< std::mutex > lock(mutex);
+		cell->state = Cell::Loaded;
+	}
+
+	stats.loaded = 0;
+	stats.loading = 0;
+	stats.loading_bytes = 0;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		for (auto const &cell : cells) {
+			if (cell.state == Cell::Loaded) stats.loaded += 1;
+			else if (cell.state != Cell::Unloaded) stats.loading += 1;
+			stats.loading_bytes += loading_estimate(cell);
+		}
+	}
+}
+
+size_t SceneStreamer::loading_estimate(Cell const &cell) {
+	if (cell.state == Cell::Queued || cell.state == Cell::Preparing) return cell.estimated_bytes;
+	if (cell.state == Cell::Prepared) return cell.bytes; //(known by now)
+	return 0;
+}
+
+Scene::DrawStats SceneStreamer::draw(Scene::Camera const &camera) const {
+	assert(camera.transform);
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	return draw(world_to_clip);
+}
+
+Scene::DrawStats SceneStreamer::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	TRACE_SCOPE("SceneStreamer::draw");
+
+	//gather drawables from every loaded cell in view into one list, so they're sorted (and instanced) together:
+	// (as in Scene::draw)
+	static DrawList draw_list;
+	draw_list.clear();
+	Frustum frustum(world_to_clip);
+	uint32_t culled = 0; //drawables in cells outside the view
+	for (auto const &cell : cells) {
+		if (!cell.buffer) continue; //(not loaded)
+		if (!frustum.overlaps(cell.bounds.center(), cell.bounds.half())) {
+			for (auto const &drawable : cell.scene->drawables) {
+				//(counting the drawables DrawList would have, i.e., those with something to draw)
+				if (drawable.pipeline.program && drawable.pipeline.vao && drawable.pipeline.count) culled += 1;
+			}
+			continue;
+		}
+		uint64_t pass = cell.scene->update_transforms();
+		cell.scene->lod_policy = lod_policy;
+		draw_list.add(*cell.scene, world_to_clip, pass);
+	}
+	draw_list.sort();
+
+	DrawStateCache state(gl_draw_backend());
+	draw_list.submit(world_to_clip, world_to_light, state);
+	state.reset();
+
+	GL_ERRORS();
+
+	Scene::DrawStats stats = draw_list.stats;
+	stats.drawables += culled;
+	stats.culled += culled;
+	stats.program_changes = state.stats.program_changes;
+	stats.vao_changes = state.stats.vao_changes;
+	stats.texture_changes = state.stats.texture_changes;
+	return stats;
+}
+
+Scene::Drawable const *SceneStreamer::pick(glm::vec3 const &origin, glm::vec3 const &direction, float *distance) const {
+	float best_distance = std::numeric_limits< float >::infinity();
+	Scene::Drawable const *best = nullptr;
+	for (auto const &cell : cells) {
+		if (!cell.buffer) continue; //(not loaded)
+		float t = std::numeric_limits< float >::infinity();
+		Scene::Drawable const *hit = cell.scene->pick(origin, direction, &t);
+		if (hit && t < best_distance) {
+			best_distance = t;
+			best = hit;
+		}
+	}
+	if (distance) *distance = best_distance;
+	return best;
+}
+
+bool SceneStreamer::is_loaded(Scene::Drawable const *drawable) const {
+	for (auto const &cell : cells) {
+		if (cell.buffer && cell.scene->drawables.index_of(drawable) != Pool< Scene::Drawable >::InvalidIndex) return true;
+	}
+	return false;
+}
+
+void SceneStreamer::for_each_loaded(std::function< void(Scene const &) > const &fn) const {
+	for (auto const &cell : cells) {
+		if (cell.buffer) fn(*cell.scene);
+	}
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+/*
+ * SceneStreamer draws a scene that is too big to load all at once, by only
+ * keeping the parts of it near some point -- their drawables, and the mesh
+ * data those use -- loaded:
+ *
+ * SceneStreamer::Settings settings;
+ * settings.program = lit_color_texture_program->program;
+ * SceneStreamer world(data_path("world.scene"), data_path("world.pnct"), settings,
+ *     [](Scene &scene, Scene::Transform *transform, Mesh const &mesh, GLuint vao) {
+ *         scene.drawables.emplace_back(transform);
+ *         ... //set up the pipeline, as in a Scene::load on_drawable callback
+ *     });
+ *
+ * //every frame:
+ * world.update(player->position);
+ * world.draw(*camera);
+ *
+ * When opened, the mesh entries in the scene file are sorted into a grid of square
+ * cells (in x/y -- scenes are z-up) by the center of their world-space bounds.
+ * update() asks for the cells within Settings::load_radius of its point, nearest
+ * first, and a background thread prepares each one: it builds the cell's own Scene
+ * (with copies of the transforms its meshes hang from) and copies the vertices the
+ * cell uses out of the mesh file (see MeshBuffer::read_subset). Back on the main
+ * thread, update() uploads prepared cells -- about Settings::upload_budget bytes per
+ * frame -- and calls 'on_drawable' for each of their meshes. Cells further than
+ * Settings::unload_radius are freed again.
+ *
+ * Things to know:
+ *  - only meshes are streamed (cameras, lights, and extra chunks aren't read)
+ *  - cells have their own copies of transforms, so this is for static scenery
+ *  - the mesh file is read when opened; with the Full layout, vertices are then
+ *    copied straight out of the (mapped) file as cells need them, so it can be bigger
+ *    than memory -- the Compact layout converts the whole file up front
+ *  - each cell gets one vertex array object, for Settings::program; the streamer
+ *    deletes it and the cell's buffers when unloading, but not anything 'on_drawable' made
+ */
+
+#include "Scene.hpp"
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct SceneStreamer {
+	struct Settings {
+		float cell_size = 0.0f; //side of a cell (0 means "about a sixteenth of the scene's width")
+		float load_radius = 0.0f; //cells whose bounds are closer than this are loaded (0 means 2 * cell_size)...
+		float unload_radius = 0.0f; //...and freed once they're further than this (0 means 1.5 * load_radius)
+		size_t upload_budget = 8 << 20; //bytes of mesh data to upload per frame (at least one cell is, if any are ready)
+		size_t resident_budget = 512 << 20; //no more cells are asked for while this many bytes of mesh data are loaded or loading
+		MeshBuffer::Layout layout = MeshBuffer::Layout::Full;
+		GLuint program = 0; //program to make each cell's vertex array object for
+	};
+
+	//called (on the main thread) for each mesh in a cell that was just uploaded:
+	// 'mesh' is in the cell's own buffer, which 'vao' (made for Settings::program) reads from
+	typedef std::function< void(Scene &, Scene::Transform *, Mesh const &, GLuint vao) > OnDrawable;
+
+	//open a scene and the mesh file its meshes are in (throws on file format errors, or if meshes are missing):
+	SceneStreamer(std::string const &scene_filename, std::string const &meshes_filename, Settings const &settings, OnDrawable const &on_drawable);
+	~SceneStreamer();
+	SceneStreamer(SceneStreamer const &) = delete;
+	SceneStreamer &operator=(SceneStreamer const &) = delete;
+
+	//load cells near 'focus' and free ones far from it (main thread, once a frame):
+	// (rethrows anything that went wrong while preparing a cell)
+	void update(glm::vec3 const &focus);
+
+	//draw every loaded cell (as Scene::draw does; cells outside the view are skipped as a whole):
+	Scene::DrawStats draw(Scene::Camera const &camera) const;
+	Scene::DrawStats draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+
+	//closest drawable in a loaded cell hit by a ray (see Scene::pick):
+	Scene::Drawable const *pick(glm::vec3 const &origin, glm::vec3 const &direction, float *distance = nullptr) const;
+
+	//is 'drawable' in a loaded cell? (drawables go away when their cells are unloaded)
+	bool is_loaded(Scene::Drawable const *drawable) const;
+
+	//call 'fn' with each loaded cell's scene:
+	void for_each_loaded(std::function< void(Scene const &) > const &fn) const;
+
+	//level of detail selection for every cell (copied to each cell's Scene::lod_policy when drawing):
+	Scene::LODPolicy lod_policy;
+
+	struct Stats {
+		uint32_t cells = 0; //in the grid
+		uint32_t loaded = 0; //cells uploaded and drawable
+		uint32_t loading = 0; //cells asked for, but not uploaded yet
+		size_t resident_bytes = 0; //mesh data uploaded for loaded cells
+		size_t loading_bytes = 0; //mesh data (estimated, until prepared) for loading cells
+		//during the last update():
+		uint32_t uploaded = 0; //cells
+		size_t uploaded_bytes = 0;
+		uint32_t unloaded = 0; //cells
+	} stats;
+
+	//-- internals --
+	struct Cell {
+		glm::ivec2 coord = glm::ivec2(0);
+		BVH::Box bounds; //world bounds of the meshes in the cell
+		std::vector< uint32_t > meshes; //entries in the scene file's "msh0" chunk
+
+		//Unloaded -> Queued -> Preparing (on the loader thread) -> Prepared -> Loaded (on the main thread) -> Unloaded
+		// (changes happen with 'mutex' held; the loader thread only touches Queued / Preparing cells)
+		enum State { Unloaded, Queued, Preparing, Prepared, Loaded } state = Unloaded;
+		float distance = 0.0f; //from the focus of the last update()
+
+		//prepared on the loader thread:
+		std::unique_ptr< Scene > scene;
+		std::vector< std::pair< Scene::Transform *, Name > > drawables; //(transform, mesh name) for on_drawable, once uploaded
+		std::unique_ptr< MeshBuffer::Data > data;
+		size_t bytes = 0; //vertex + index data
+		size_t estimated_bytes = 0; //...as estimated from the mesh file when opened (for cells not prepared yet)
+		std::exception_ptr error;
+
+		//made on the main thread (so loaded cells -- the ones with a buffer -- can be found without the lock):
+		std::unique_ptr< MeshBuffer > buffer;
+		GLuint vao = 0;
+	};
+	std::vector< Cell > cells;
+
+	Settings settings;
+	OnDrawable on_drawable;
+
+	//the scene file (read in place by the loader thread):
+	MappedFile scene_file;
+	std::unique_ptr< ChunkReader > chunks; //(kept, since it holds copies of any misaligned chunks)
+	ChunkSpan< char > names;
+	ChunkSpan< Scene::HierarchyEntry > hierarchy;
+	ChunkSpan< Scene::MeshEntry > meshes;
+	//the mesh file, as read when opened (cells copy their meshes out of this):
+	std::unique_ptr< MeshBuffer::Data > source;
+
+	//loader thread:
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector< uint32_t > queue; //Queued cells (the nearest is prepared next)
+	bool quit = false;
+	std::thread loader;
+	void load_cells(); //(the loader thread's loop)
+	void prepare(Cell &cell) const; //(loader thread)
+	void finish(Cell &cell); //(main thread)
+	void unload(Cell &cell); //(main thread)
+	static size_t loading_estimate(Cell const &cell); //mesh data on its way for a loading cell (with 'mutex' held)
+};
@@ -1,30 +1,208 @@
 #pragma once
 
-#include <arpa/inet.h>
-#include <netinet/in.h>
+// Helpers for writing values in network (big-endian) byte order.
+//
+// The bulk float routines byte-swap with SSSE3/AVX2 shuffles when the CPU
+// supports them (checked at runtime on GCC/Clang, at compile time elsewhere)
+// and fall back to a scalar loop otherwise.
 
-static inline void serialize_int(int32_t in_x, std::vector<char>::iterator buffer) {
-  uint32_t x = htonl((uint32_t) in_x);
-  buffer[0] = x >> 24;
-  buffer[1] = x >> 16;
-  buffer[2] = x >> 8;
-  buffer[3] = x;
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SERIALIZATION_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SERIALIZATION_BIG_ENDIAN 1
+#endif
+
+static inline uint32_t load_be32(char const *in) {
+  return (uint32_t(uint8_t(in[0])) << 24) |
+         (uint32_t(uint8_t(in[1])) << 16) |
+         (uint32_t(uint8_t(in[2])) << 8) |
+          uint32_t(uint8_t(in[3]));
+}
+
+static inline void store_be32(uint32_t x, char *out) {
+  out[0] = char(x >> 24);
+  out[1] = char(x >> 16);
+  out[2] = char(x >> 8);
+  out[3] = char(x);
+}
+
+static inline void serialize_int(int32_t x, char *buffer) {
+  store_be32(uint32_t(x), buffer);
+}
+
+static inline void serialize_float(float in_x, char *buffer) {
+  uint32_t x;
+  std::memcpy(&x, &in_x, 4);
+  store_be32(x, buffer);
+}
+
+static inline int32_t deserialize_int(char const *buffer) {
+  return int32_t(load_be32(buffer));
 }
 
-static inline void serialize_float(float in_x, std::vector<char>::iterator buffer) {
-  int32_t x = reinterpret_cast<int32_t&>(in_x);
-  return serialize_int(x, buffer);
+static inline float deserialize_float(char const *buffer) {
+  uint32_t x = load_be32(buffer);
+  float ret;
+  std::memcpy(&ret, &x, 4);
+  return ret;
+}
+
+static inline void serialize_int(int32_t x, std::vector<char>::iterator buffer) {
+  serialize_int(x, &buffer[0]);
+}
+
+static inline void serialize_float(float x, std::vector<char>::iterator buffer) {
+  serialize_float(x, &buffer[0]);
 }
 
 static inline int32_t deserialize_int(std::vector<char>::iterator buffer) {
-  return ntohl(
-        (((uint32_t) buffer[0]) << 24) |
-        (((uint32_t) buffer[1]) << 16) |
-        (((uint32_t) buffer[2]) << 8) |
-        ((uint32_t) buffer[3]));
+  return deserialize_int(&buffer[0]);
 }
 
 static inline float deserialize_float(std::vector<char>::iterator buffer) {
-  int32_t x = deserialize_int(buffer);
-  return reinterpret_cast<float&>(x);
+  return deserialize_float(&buffer[0]);
+}
+
+// ---- bulk conversion ----
+
+namespace serialization_detail {
+
+// Swapping the bytes of each 32-bit word converts both to and from big-endian,
+// so serialize and deserialize share these kernels:
+// (whole-word loads and stores, which compilers turn into one bswap each; byte-at-a-time
+// stores through char pointers can't be combined, since they might alias the input)
+static inline void swap32_scalar(char const *in, size_t count, char *out) {
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t x;
+    std::memcpy(&x, in + 4 * i, 4);
+    x = (x >> 24) | ((x >> 8) & 0xff00u) | ((x << 8) & 0xff0000u) | (x << 24);
+    std::memcpy(out + 4 * i, &x, 4);
+  }
+}
+
+#if defined(SERIALIZATION_X86) && !defined(SERIALIZATION_BIG_ENDIAN)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SERIALIZATION_TARGET(T) __attribute__((target(T)))
+#else
+#define SERIALIZATION_TARGET(T)
+#endif
+
+#if defined(__GNUC__) || defined(__clang__) || defined(__SSSE3__) || defined(__AVX__)
+SERIALIZATION_TARGET("ssse3")
+static inline void swap32_ssse3(char const *in, size_t count, char *out) {
+  __m128i const mask = _mm_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast< __m128i const * >(in + 4 * i));
+    _mm_storeu_si128(reinterpret_cast< __m128i * >(out + 4 * i), _mm_shuffle_epi8(v, mask));
+  }
+  swap32_scalar(in + 4 * i, count - i, out + 4 * i);
+}
+#define SERIALIZATION_HAVE_SSSE3 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__) || defined(__AVX2__)
+SERIALIZATION_TARGET("avx2")
+static inline void swap32_avx2(char const *in, size_t count, char *out) {
+  //(vpshufb shuffles within each 128-bit lane, so the mask repeats)
+  __m256i const mask = _mm256_setr_epi8(
+    3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12,
+    3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(in + 4 * i));
+    _mm256_storeu_si256(reinterpret_cast< __m256i * >(out + 4 * i), _mm256_shuffle_epi8(v, mask));
+  }
+  swap32_scalar(in + 4 * i, count - i, out + 4 * i);
+}
+#define SERIALIZATION_HAVE_AVX2 1
+#endif
+
+typedef void (*Swap32Fn)(char const *, size_t, char *);
+
+static inline Swap32Fn pick_swap32() {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return swap32_avx2;
+  if (__builtin_cpu_supports("ssse3")) return swap32_ssse3;
+  return swap32_scalar;
+#elif defined(SERIALIZATION_HAVE_AVX2)
+  return swap32_avx2;
+#elif defined(SERIALIZATION_HAVE_SSSE3)
+  return swap32_ssse3;
+#else
+  return swap32_scalar;
+#endif
+}
+
+static inline void swap32(char const *in, size_t count, char *out) {
+  // Short arrays aren't worth the indirect call:
+  if (count < 8) {
+    swap32_scalar(in, count, out);
+    return;
+  }
+  static Swap32Fn const fn = pick_swap32();
+  fn(in, count, out);
+}
+
+#else
+
+static inline void swap32(char const *in, size_t count, char *out) {
+#ifdef SERIALIZATION_BIG_ENDIAN
+  std::memmove(out, in, count * 4);
+#else
+  swap32_scalar(in, count, out);
+#endif
+}
+
+#endif
+
+// The byte-swapping kernels this build can run on this CPU, so that tests and
+// benchmarks can compare them (swap32() uses the last one for 8 or more values):
+struct Swap32Kernel {
+  char const *name;
+  void (*fn)(char const *in, size_t count, char *out);
+};
+
+static inline std::vector< Swap32Kernel > swap32_kernels() {
+  std::vector< Swap32Kernel > kernels;
+#if !defined(SERIALIZATION_BIG_ENDIAN)
+  kernels.push_back(Swap32Kernel{"scalar", swap32_scalar});
+#endif
+#if defined(SERIALIZATION_X86) && !defined(SERIALIZATION_BIG_ENDIAN)
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3")) kernels.push_back(Swap32Kernel{"ssse3", swap32_ssse3});
+  if (__builtin_cpu_supports("avx2")) kernels.push_back(Swap32Kernel{"avx2", swap32_avx2});
+#else
+#if defined(SERIALIZATION_HAVE_SSSE3)
+  kernels.push_back(Swap32Kernel{"ssse3", swap32_ssse3});
+#endif
+#if defined(SERIALIZATION_HAVE_AVX2)
+  kernels.push_back(Swap32Kernel{"avx2", swap32_avx2});
+#endif
+#endif
+#endif
+  return kernels;
+}
+
+} //namespace serialization_detail
+
+// Write count floats to out (4 * count bytes), big-endian IEEE-754:
+static inline void serialize_floats(float const *in, size_t count, char *out) {
+  serialization_detail::swap32(reinterpret_cast< char const * >(in), count, out);
+}
+
+// Read count big-endian floats from in (4 * count bytes):
+static inline void deserialize_floats(char const *in, size_t count, float *out) {
+  serialization_detail::swap32(in, count, reinterpret_cast< char * >(out));
 }
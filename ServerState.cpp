@@ -1,12 +1,13 @@
 #include "ServerState.hpp"
 
-#include "Serialization.hpp"
 #include "GameConsts.hpp"
+#include "Trace.hpp"
 
 #include <limits.h>
 #include <iostream>
 
 ServerState::ServerState() {
+  tick = 0;
   setup();
 }
 
@@ -22,6 +23,9 @@ void ServerState::setup() {
   red_zone_health = 1.0f;
   blue_zone_health = 1.0f;
 
+  // Everyone teleports back to their zone, so old positions are meaningless
+  history.clear();
+
   for(auto &[unused_c, player] : players) {
     (void) unused_c;
     player.stunned = 0.0f;
@@ -46,26 +50,53 @@ void ServerState::connect(Connection* c) {
     }
   }
   uint8_t team = reds < blues;
-  players.emplace(c, Player(glm::vec2(team ? red_zone_position : blue_zone_position), team));
+  auto ret = players.emplace(c, Player(glm::vec2(team ? red_zone_position : blue_zone_position), team));
+  ret.first->second.slot = history.acquire_slot();
 }
 
 void ServerState::disconnect(Connection* c) {
   auto f = players.find(c);
   assert(f != players.end());
+  history.release_slot(f->second.slot);
   players.erase(f);
 }
 
-void ServerState::received(Connection* c,
-    int in_left, int in_right, int in_down, int in_up, int in_space) {
+void ServerState::received(Connection* c, InputMessage const &input) {
   Player& player = players.at(c);
-  player.left = in_left;
-  player.right = in_right;
-  player.down = in_down;
-  player.up = in_up;
-  player.space = in_space;
+  player.left = input.left;
+  player.right = input.right;
+  player.down = input.down;
+  player.up = input.up;
+  player.space = input.space;
+
+  player.seen_tick = input.seen_tick;
+  player.seen_received_tick = tick;
+  player.has_seen = true;
+}
+
+uint32_t ServerState::Player::rewind_ticks(uint32_t now) const {
+  uint32_t age = now - seen_received_tick;
+  if(!has_seen || age > max_ack_age) return 0;
+
+  // Snapshots keep arriving after the ack was sent, so the player is now
+  // seeing about seen_tick + age
+  uint32_t viewing = seen_tick + age;
+  // A tick from the future is bogus (signed difference, so wraparound works)
+  int32_t behind = int32_t(now - viewing);
+  if(behind <= 0) return 0;
+  return std::min(uint32_t(behind), max_rewind_ticks);
+}
+
+// Simplified collision
+static bool touching_ball(glm::vec2 const &player_position, glm::vec2 const &ball_position) {
+  return (fabs(player_position.x - ball_position.x) < (player_size + ball_size) * 3.5f) &&
+    (fabs(player_position.y - ball_position.y) < (player_size + ball_size) * 3.5f);
 }
 
 void ServerState::update(float elapsed) {
+  TRACE_SCOPE("ServerState::update");
+  tick++;
+
   // Cool down after a round
   if(cooldown > 0) {
     cooldown -= elapsed;
@@ -209,9 +240,17 @@ void ServerState::update(float elapsed) {
         (ball_player != nullptr && player.team == ball_player->team) ||
         player.shoot_ghosting > 0) continue;
 
-    // Simplified collision
-    if((fabs(player.position.x - ball_position.x) < (player_size + ball_size) * 3.5f) &&
-        (fabs(player.position.y - ball_position.y) < (player_size + ball_size) * 3.5f)) {
+    // Also check against the world as this player last saw it, so lagged
+    // players don't lose steals they saw themselves make
+    History::Frame const *seen = nullptr;
+    uint32_t rewind = player.rewind_ticks(tick);
+    if(rewind > 0) {
+      seen = history.find(tick - rewind);
+    }
+
+    if(touching_ball(player.position, ball_position) ||
+        (seen && seen->has_player(player.slot) &&
+         touching_ball(seen->player_positions[player.slot], seen->ball_position))) {
       if(ball_player != nullptr) {
         ball_player->ball = false;
         ball_player->stunned = stun_duration;
@@ -224,7 +263,18 @@ void ServerState::update(float elapsed) {
     }
   }
 
+  // Remember this tick's positions for later steal checks
+  auto &frame = history.record(tick);
+  frame.ball_position = ball_position;
+  for(auto &[unused_c, player] : players) {
+    (void)unused_c;
+    if(player.slot != History::NoSlot) {
+      frame.set_player(player.slot, player.position);
+    }
+  }
+
   // Check if ball collides with either zone
+  // (not lag-compensated: this doesn't depend on what any player saw)
   glm::vec2 red_dimensions = zone_dimensions * red_zone_health;
   if((abs(ball_position.x - red_zone_position.x) < (ball_size + red_dimensions.x) / 2) &&
       (abs(ball_position.y - red_zone_position.y) < (ball_size + red_dimensions.y) / 2)) {
@@ -243,57 +293,40 @@ void ServerState::update(float elapsed) {
 }
 
 void ServerState::broadcast() {
-  /* Message format:
+  TRACE_SCOPE("ServerState::broadcast");
+  /* Message format (see Messages.hpp):
    * Header 'm' (1 byte)
-   * Number of players (2 bytes)
-   * Whether self is stunned (1 byte)
+   * SnapshotHeader: whether self is stunned
    * ---- Shared: ----
-   * Red zone health (4 bytes)
-   * Blue zone health (4 bytes)
-   * Ball position (8 bytes)
-   * Player positions, teams, and whether stunned (10 * n bytes)
+   * SnapshotBody: zone healths, ball position, player positions/teams/stunned
    */
-  size_t num_players = players.size();
-  std::vector<char> buf(16 + num_players * 10);
-  auto buf_it = buf.begin();
 
-  serialize_float(red_zone_health, buf_it);
-  std::advance(buf_it, 4);
-  serialize_float(blue_zone_health, buf_it);
-  std::advance(buf_it, 4);
-
-  serialize_float(ball_position.x, buf_it);
-  std::advance(buf_it, 4);
-  serialize_float(ball_position.y, buf_it);
-  std::advance(buf_it, 4);
+  // The shared part is the same for every connection, so encode it once
+  snapshot.tick = tick;
+  snapshot.red_zone_health = red_zone_health;
+  snapshot.blue_zone_health = blue_zone_health;
+  snapshot.ball_position = ball_position;
 
+  snapshot.players.resize(players.size());
+  size_t i = 0;
   for(auto &[unused_c, player] : players) {
     (void)unused_c;
-    serialize_float(player.position.x, buf_it);
-    std::advance(buf_it, 4);
-    serialize_float(player.position.y, buf_it);
-    std::advance(buf_it, 4);
-
-    buf_it[0] = player.team;
-    std::advance(buf_it, 1);
-    buf_it[0] = player.stunned > 0;
-    std::advance(buf_it, 1);
+    SnapshotBody::Player &entry = snapshot.players[i++];
+    entry.position = player.position;
+    entry.team = player.team;
+    entry.stunned = player.stunned > 0;
   }
-  
-  for(auto &[c, player] : players) {
-    c->send('m');
 
-    // 2 bytes can hold up to 2^16 players
-    // If this game had 2^16 players I would probably have enough money to
-    // rewrite this code here
-    c->send(uint8_t((num_players >> 8) % 256));
-    c->send(uint8_t(num_players % 256));
+  snapshot_buffer.resize(encoded_size(snapshot));
+  encode(snapshot, snapshot_buffer.data(), snapshot_buffer.size());
 
-    c->send(player.just_stunned > 0);
+  for(auto &[c, player] : players) {
+    SnapshotHeader header;
+    header.just_stunned = player.just_stunned;
 
-    for(char& i : buf) {
-      c->send(i);
-    }
+    c->send(SnapshotHeader::Type);
+    encode_append(header, &c->send_buffer);
+    c->send_buffer.insert(c->send_buffer.end(), snapshot_buffer.begin(), snapshot_buffer.end());
   }
 }
 
@@ -310,4 +343,8 @@ ServerState::Player::Player(glm::vec2 in_position, uint8_t in_team) {
   down = 0;
   up = 0;
   space = 0;
+  slot = History::NoSlot;
+  seen_tick = 0;
+  seen_received_tick = 0;
+  has_seen = false;
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Connection.hpp"
+#include "Messages.hpp"
+#include "RewindHistory.hpp"
 
 #include <unordered_map>
 #include <glm/glm.hpp>
@@ -14,8 +16,7 @@ struct ServerState {
   void connect(Connection* c);
   void disconnect(Connection* c);
 
-  void received(Connection* c,
-      int in_left, int in_right, int in_down, int in_up, int space);
+  void received(Connection* c, InputMessage const &input);
   void update(float elapsed);
   void broadcast();
 
@@ -44,6 +45,19 @@ struct ServerState {
     uint32_t down;
     uint32_t up;
     uint32_t space;
+
+    // Index into the rewind history (or NoSlot if it was full on connect)
+    uint8_t slot;
+    // Latest snapshot tick this player acknowledged (InputMessage::seen_tick),
+    // and the server tick that input arrived on; see rewind_ticks()
+    uint32_t seen_tick;
+    uint32_t seen_received_tick;
+    bool has_seen;
+
+    // How many ticks behind the server this player's view is at server tick
+    // 'now', or 0 if that isn't known (no input yet, or none for
+    // max_ack_age ticks)
+    uint32_t rewind_ticks(uint32_t now) const;
   };
 
   // Game consts
@@ -63,6 +77,15 @@ struct ServerState {
   // Prevents a player from instantly picking up their shot ball
   static constexpr float shoot_ghosting_time = 1.0f;
 
+  // Lag compensation: steals are also checked against the positions a player
+  // was seeing, up to max_rewind_ticks (~200ms at 60 ticks/s) in the past
+  static constexpr uint32_t max_rewind_ticks = 12;
+  static constexpr uint32_t history_length = 16;
+  static constexpr uint32_t max_history_players = 32;
+  static_assert(max_rewind_ticks < history_length, "rewind window must fit in history");
+  // Acks older than this (~0.5s) are too stale to judge a player's lag by
+  static constexpr uint32_t max_ack_age = 30;
+
   // Game state
   std::unordered_map<Connection*, Player> players;
 
@@ -77,4 +100,12 @@ struct ServerState {
   float blue_zone_health;
 
   float cooldown;
+
+  uint32_t tick;
+  typedef RewindHistory< max_history_players, history_length > History;
+  History history;
+
+  // Reused between broadcasts to avoid reallocating every tick
+  SnapshotBody snapshot;
+  std::vector<char> snapshot_buffer;
 };
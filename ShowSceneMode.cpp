@@ -1,9 +1,20 @@
 #include "ShowSceneMode.hpp"
 #include "DrawLines.hpp"
 
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <sstream>
 
-ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
+ShowSceneMode::ShowSceneMode(Scene &scene_, SceneStreamer *streamer_, bool lod_report) : scene(scene_), streamer(streamer_) {
+	if (lod_report) {
+		report.active = true;
+		set_lod(0);
+		std::cout << "LOD report (" << LODReport::ReportFrames << " frames per setting; draw time is the median of scene drawing between glFinish calls):" << std::endl;
+	} else {
+		set_lod(lod_setting);
+	}
 
 	//Set up camera-only scene:
 	{ //create a single camera:
@@ -19,6 +30,22 @@ ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
 ShowSceneMode::~ShowSceneMode() {
 }
 
+void ShowSceneMode::set_lod(uint32_t setting) {
+	lod_setting = setting % LODSettings;
+	Scene::LODPolicy policy = scene.lod_policy;
+	policy.enabled = (lod_setting != 0);
+	if (policy.enabled) policy.max_error = LODErrors[lod_setting];
+	scene.lod_policy = policy;
+	if (streamer) streamer->lod_policy = policy;
+}
+
+std::string ShowSceneMode::lod_name(uint32_t setting) {
+	if (setting == 0) return "LOD off";
+	std::ostringstream str;
+	str << "LOD max error " << LODErrors[setting];
+	return str.str();
+}
+
 bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
 	//----- trackball-style camera controls -----
 	if (evt.type == SDL_MOUSEBUTTONDOWN) {
@@ -61,6 +88,34 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 			return true;
 		}
 	}
+	//right click: pick the drawable under the mouse
+	if (evt.type == SDL_MOUSEBUTTONDOWN && evt.button.button == SDL_BUTTON_RIGHT) {
+		//ray through the mouse position, in camera space (camera looks down -z):
+		float tan_half = std::tan(0.5f * scene_camera->fovy);
+		glm::vec3 direction = glm::vec3(
+			(2.0f * (evt.button.x + 0.5f) / float(window_size.x) - 1.0f) * tan_half * scene_camera->aspect,
+			(1.0f - 2.0f * (evt.button.y + 0.5f) / float(window_size.y)) * tan_half,
+			-1.0f
+		);
+		glm::mat4x3 camera_to_world = scene_camera->transform->make_local_to_world();
+		float distance = std::numeric_limits< float >::infinity();
+		picked = scene.pick(camera_to_world[3], camera_to_world * glm::vec4(direction, 0.0f), &distance);
+		if (streamer) {
+			float streamed_distance = std::numeric_limits< float >::infinity();
+			Scene::Drawable const *streamed = streamer->pick(camera_to_world[3], camera_to_world * glm::vec4(direction, 0.0f), &streamed_distance);
+			if (streamed && streamed_distance < distance) picked = streamed;
+		}
+		if (picked) std::cout << "Picked '" << picked->transform->name.str() << "'." << std::endl;
+		return true;
+	}
+
+	//'L': next level of detail policy
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_l && !report.active) {
+		set_lod(lod_setting + 1);
+		std::cout << lod_name(lod_setting) << std::endl;
+		return true;
+	}
+
 	//mouse wheel: dolly
 	if (evt.type == SDL_MOUSEWHEEL) {
 		camera.radius *= std::pow(0.5f, 0.1f * evt.wheel.y);
@@ -72,7 +127,23 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 	return false;
 }
 
+void ShowSceneMode::update(float elapsed) {
+	if (report.done) {
+		std::shared_ptr< Mode > keep = shared_from_this(); //(so this isn't deleted while update() is running)
+		Mode::set_current(nullptr);
+	}
+}
+
 void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
+	{ //frame time, for the overlay:
+		auto now = std::chrono::high_resolution_clock::now();
+		if (last_draw != std::chrono::high_resolution_clock::time_point()) {
+			float ms = std::chrono::duration< float, std::milli >(now - last_draw).count();
+			frame_ms = (frame_ms == 0.0f ? ms : 0.9f * frame_ms + 0.1f * ms);
+		}
+		last_draw = now;
+	}
+
 	//--- use camera structure to set up scene camera ---
 
 	scene_camera->transform->rotation =
@@ -91,42 +162,105 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 
-	scene.draw(*scene_camera);
+	if (streamer) {
+		//load the parts of the streamed scene around the camera's target:
+		streamer->update(camera.target);
+		if (picked && !streamer->is_loaded(picked) && scene.drawables.index_of(picked) == Pool< Scene::Drawable >::InvalidIndex) picked = nullptr;
+	}
+
+	//(when reporting, everything queued before the scene is finished first, so only the scene's drawing is timed)
+	if (report.active) glFinish();
+	auto draw_start = std::chrono::high_resolution_clock::now();
+
+	Scene::DrawStats stats = scene.draw(*scene_camera);
+
+	if (streamer) {
+		Scene::DrawStats streamed = streamer->draw(*scene_camera);
+		stats.drawables += streamed.drawables;
+		stats.culled += streamed.culled;
+		stats.drawn += streamed.drawn;
+		stats.simplified += streamed.simplified;
+		stats.elements += streamed.elements;
+		stats.draw_calls += streamed.draw_calls;
+	}
+
+	if (report.active && !report.done) {
+		glFinish();
+		float ms = std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - draw_start).count();
+		report.frame += 1;
+		if (report.frame > LODReport::WarmupFrames) {
+			report.draw_ms.emplace_back(ms);
+			report.elements += stats.elements;
+			report.drawn = stats.drawn;
+			report.simplified = stats.simplified;
+		}
+		if (report.frame == LODReport::WarmupFrames + LODReport::ReportFrames) {
+			std::sort(report.draw_ms.begin(), report.draw_ms.end());
+			std::cout << "  " << std::left << std::setw(20) << lod_name(lod_setting) << std::right
+				<< std::setw(10) << report.elements / 3 / LODReport::ReportFrames << " triangles, "
+				<< report.simplified << " / " << report.drawn << " drawables simplified, "
+				<< report.draw_ms[report.draw_ms.size() / 2] << " ms to draw" << std::endl;
+			report.frame = 0;
+			report.draw_ms.clear();
+			report.elements = 0;
+			if (lod_setting + 1 < LODSettings) set_lod(lod_setting + 1);
+			else report.done = true;
+		}
+	}
 
 	{ //decorate with some lines:
 		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
-		for (auto &transform : scene.transforms) {
-			glm::mat4 local_to_world = transform.make_local_to_world();
-			auto xf = [&local_to_world](glm::vec3 const &vec) {
-				return glm::vec3(local_to_world * glm::vec4(vec, 1.0f));
-			};
-			auto xfd = [&local_to_world](glm::vec3 const &vec) {
-				return glm::vec3(local_to_world * glm::vec4(vec, 0.0f));
-			};
-
-			if (transform.parent) {
-				//connect to parent:
-				glm::vec3 p = glm::vec3(transform.parent->make_local_to_world()[3]);
-				draw_lines.draw(p, xf(glm::vec3(0.0f)), glm::u8vec4(0xff, 0xff, 0x00, 0xff));
-			}
+		//(for the scene and for each loaded part of the streamed scene, if any)
+		auto decorate = [&draw_lines](Scene const &from) {
+			for (auto &transform : from.transforms) {
+				glm::mat4 local_to_world = transform.make_local_to_world();
+				auto xf = [&local_to_world](glm::vec3 const &vec) {
+					return glm::vec3(local_to_world * glm::vec4(vec, 1.0f));
+				};
+				auto xfd = [&local_to_world](glm::vec3 const &vec) {
+					return glm::vec3(local_to_world * glm::vec4(vec, 0.0f));
+				};
+
+				if (transform.parent) {
+					//connect to parent:
+					glm::vec3 p = glm::vec3(transform.parent->make_local_to_world()[3]);
+					draw_lines.draw(p, xf(glm::vec3(0.0f)), glm::u8vec4(0xff, 0xff, 0x00, 0xff));
+				}
 
 
-			//axis:
-			float len = 0.2f;
-			draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(len, 0.0f, 0.0f)), glm::u8vec4(0xff, 0x00, 0x00, 0xff));
-			draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(-len, 0.0f, 0.0f)), glm::u8vec4(0x88, 0x00, 0x00, 0xff));
-			draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, len, 0.0f)), glm::u8vec4(0x00, 0xff, 0x00, 0xff));
-			draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, -len, 0.0f)), glm::u8vec4(0x00, 0x88, 0x00, 0xff));
-			draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, 0.0f, len)), glm::u8vec4(0x00, 0x00, 0xff, 0xff));
-			draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, 0.0f, -len)), glm::u8vec4(0x00, 0x00, 0x88, 0xff));
-
-			//transform name:
-			draw_lines.draw_text("'" + transform.name + "'",
-				xf(glm::vec3(0.05f, 0.0f, 0.05f)),
-				0.15f * xfd(glm::vec3(1.0f, 0.0f, 0.0f)),
-				0.15f * xfd(glm::vec3(0.0f, 0.0f, 1.0f)),
-				glm::u8vec4(0xff, 0xff, 0xff, 0xff)
-			);
+				//axis:
+				float len = 0.2f;
+				draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(len, 0.0f, 0.0f)), glm::u8vec4(0xff, 0x00, 0x00, 0xff));
+				draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(-len, 0.0f, 0.0f)), glm::u8vec4(0x88, 0x00, 0x00, 0xff));
+				draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, len, 0.0f)), glm::u8vec4(0x00, 0xff, 0x00, 0xff));
+				draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, -len, 0.0f)), glm::u8vec4(0x00, 0x88, 0x00, 0xff));
+				draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, 0.0f, len)), glm::u8vec4(0x00, 0x00, 0xff, 0xff));
+				draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, 0.0f, -len)), glm::u8vec4(0x00, 0x00, 0x88, 0xff));
+
+				//transform name:
+				draw_lines.draw_text("'" + std::string(transform.name.str()) + "'",
+					xf(glm::vec3(0.05f, 0.0f, 0.05f)),
+					0.15f * xfd(glm::vec3(1.0f, 0.0f, 0.0f)),
+					0.15f * xfd(glm::vec3(0.0f, 0.0f, 1.0f)),
+					glm::u8vec4(0xff, 0xff, 0xff, 0xff)
+				);
+			}
+		};
+		decorate(scene);
+		if (streamer) {
+			streamer->for_each_loaded(decorate);
+		}
+		if (picked) {
+			//outline picked drawable's bounds:
+			BVH::Box box = picked->make_world_bounds();
+			glm::vec3 center = box.center();
+			glm::vec3 half = box.half();
+			draw_lines.draw_box(glm::mat4x3(
+				glm::vec3(half.x, 0.0f, 0.0f),
+				glm::vec3(0.0f, half.y, 0.0f),
+				glm::vec3(0.0f, 0.0f, half.z),
+				center
+			), glm::u8vec4(0xff, 0x88, 0x00, 0xff));
 		}
 		/*
 		glEnable(GL_LINE_SMOOTH);
@@ -136,4 +270,28 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 		*/
 	}
 
+	{ //overlay draw stats (drawn / culled counts):
+		glDisable(GL_DEPTH_TEST);
+		float aspect = float(drawable_size.x) / float(drawable_size.y);
+		DrawLines lines(glm::mat4(
+			1.0f / aspect, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		));
+		std::string text = "drawn " + std::to_string(stats.drawn) + " / " + std::to_string(stats.drawables)
+			+ " (culled " + std::to_string(stats.culled) + ") in " + std::to_string(stats.draw_calls) + " draw calls"
+			+ ", " + std::to_string(stats.elements / 3) + " triangles (" + std::to_string(stats.simplified) + " simplified)";
+		if (streamer) {
+			text += "; " + std::to_string(streamer->stats.loaded) + " / " + std::to_string(streamer->stats.cells) + " cells loaded"
+				+ " (" + std::to_string(streamer->stats.loading) + " loading, " + std::to_string(streamer->stats.loading_bytes >> 20) + " MB), " + std::to_string(streamer->stats.resident_bytes >> 20) + " MB";
+		}
+		text += "; " + lod_name(lod_setting) + " ('L' to change), " + std::to_string(int32_t(std::round(frame_ms))) + " ms/frame";
+		float H = 0.05f;
+		lines.draw_text(text,
+			glm::vec3(-aspect + 0.05f, 1.0f - 0.05f - H, 0.0f),
+			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+			glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+	}
+
 }
@@ -10,12 +10,19 @@
 #include "Mode.hpp"
 #include "Scene.hpp"
 #include "Mesh.hpp"
+#include "SceneStreamer.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
 
 struct ShowSceneMode : Mode {
-	ShowSceneMode(Scene const &scene);
+	//'lod_report': draw with each of LODSettings in turn, print triangles + draw time for each, then quit
+	ShowSceneMode(Scene &scene, SceneStreamer *streamer = nullptr, bool lod_report = false);
 	virtual ~ShowSceneMode();
 
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
+	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
 	//z-up trackball-style camera controls:
@@ -28,7 +35,37 @@ struct ShowSceneMode : Mode {
 	} camera;
 
 	//Scene being viewed:
-	Scene const &scene;
+	Scene &scene;
+	//...and (optionally) a streamed scene, loaded around the camera's target:
+	SceneStreamer *streamer;
+
+	//right-click picks a drawable (by its bounds), which is then outlined:
+	Scene::Drawable const *picked = nullptr;
+
+	//'L' cycles through level of detail policies (for both the scene and the streamer; see Scene::LODPolicy):
+	// (0 means LODs are off; the rest are max_error values)
+	static constexpr uint32_t LODSettings = 5;
+	static constexpr float LODErrors[LODSettings] = { 0.0f, 0.0005f, 0.001f, 0.002f, 0.004f };
+	uint32_t lod_setting = 2; //(Scene::LODPolicy's default)
+	void set_lod(uint32_t setting);
+	static std::string lod_name(uint32_t setting);
+
+	//time between draw()s (smoothed), for the overlay:
+	float frame_ms = 0.0f;
+	std::chrono::high_resolution_clock::time_point last_draw;
+
+	//--lod-report: each setting is drawn for WarmupFrames, then timed for ReportFrames:
+	struct LODReport {
+		bool active = false;
+		bool done = false;
+		static constexpr uint32_t WarmupFrames = 30;
+		static constexpr uint32_t ReportFrames = 120;
+		uint32_t frame = 0; //frames drawn with the current setting
+		std::vector< float > draw_ms; //scene drawing time (with a glFinish before and after) of each timed frame
+		uint64_t elements = 0; //over the timed frames
+		uint32_t drawn = 0; //drawables, in the last timed frame
+		uint32_t simplified = 0; //...of which this many at a simpler LOD
+	} report;
 
 	//mode uses a secondary Scene to hold a camera:
 	Scene camera_scene;
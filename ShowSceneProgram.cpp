@@ -10,25 +10,56 @@ Load< ShowSceneProgram > show_scene_program(LoadTagEarly, []() -> ShowSceneProgr
 
 	show_scene_program_pipeline.program = ret->program;
 
-	show_scene_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	show_scene_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	show_scene_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	show_scene_program_pipeline.uses_draw_block = true; //(object matrices come from the "Draw" block)
+
+	show_scene_program_pipeline.instanced.program = ret->instanced_program;
+	show_scene_program_pipeline.instanced.base = ret->program;
 
 	return ret;
-});
+}, "show_scene_program");
+
+//(the instanced variant below uses the same fragment shader)
+static char const *fragment_shader =
+	"#version 330\n"
+	"uniform int INSPECT_MODE;\n"
+	"in vec3 position;\n"
+	"in vec3 normal;\n"
+	"in vec4 color;\n"
+	"in vec2 texCoord;\n"
+	"out vec4 fragColor;\n"
+	"vec3 grid(vec3 p) {\n"
+	"	vec3 ret;\n"
+	"	ret.x = fract(p.x);\n"
+	"	ret.y = fract(p.y);\n"
+	"	ret.z = fract(p.z);\n"
+	"	return ret;\n"
+	"}\n"
+	"void main() {\n"
+	"	vec3 n = normalize(normal);\n"
+	"	if (INSPECT_MODE == 1) {\n"
+	"		fragColor = vec4(grid(position), 1.0);\n"
+	"	} else if (INSPECT_MODE == 2) {\n"
+	"		fragColor = vec4((0.5 * n) + 0.5, 1.0);\n"
+	"	} else if (INSPECT_MODE == 3) {\n"
+	"		fragColor = color;\n"
+	"	} else if (INSPECT_MODE == 4) {\n"
+	"		fragColor = vec4(grid(vec3(texCoord,0.0)), 1.0);\n"
+	"	} else {\n"
+	"		vec3 l = vec3(0.0,0.0,1.0);\n"
+	"		fragColor = vec4(mix(vec3(0.5), vec3(1.0), 0.5 * dot(n,l) + 0.5) * color.rgb, color.a);\n"
+	"	}\n"
+	"}\n";
 
 ShowSceneProgram::ShowSceneProgram() {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
+		std::string("#version 330\n")
+		+ Scene::DrawBlockGLSL +
+		"layout(location = 0) in vec4 Position;\n"
+		"layout(location = 1) in vec3 Normal;\n"
+		"layout(location = 2) in vec4 Color;\n"
+		"layout(location = 3) in vec2 TexCoord;\n"
 		"out vec3 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
@@ -42,35 +73,7 @@ ShowSceneProgram::ShowSceneProgram() {
 		"}\n"
 	,
 		//fragment shader:
-		"#version 330\n"
-		"uniform int INSPECT_MODE;\n"
-		"in vec3 position;\n"
-		"in vec3 normal;\n"
-		"in vec4 color;\n"
-		"in vec2 texCoord;\n"
-		"out vec4 fragColor;\n"
-		"vec3 grid(vec3 p) {\n"
-		"	vec3 ret;\n"
-		"	ret.x = fract(p.x);\n"
-		"	ret.y = fract(p.y);\n"
-		"	ret.z = fract(p.z);\n"
-		"	return ret;\n"
-		"}\n"
-		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
-		"	if (INSPECT_MODE == 1) {\n"
-		"		fragColor = vec4(grid(position), 1.0);\n"
-		"	} else if (INSPECT_MODE == 2) {\n"
-		"		fragColor = vec4((0.5 * n) + 0.5, 1.0);\n"
-		"	} else if (INSPECT_MODE == 3) {\n"
-		"		fragColor = color;\n"
-		"	} else if (INSPECT_MODE == 4) {\n"
-		"		fragColor = vec4(grid(vec3(texCoord,0.0)), 1.0);\n"
-		"	} else {\n"
-		"		vec3 l = vec3(0.0,0.0,1.0);\n"
-		"		fragColor = vec4(mix(vec3(0.5), vec3(1.0), 0.5 * dot(n,l) + 0.5) * color.rgb, color.a);\n"
-		"	}\n"
-		"}\n"
+		fragment_shader
 	);
 
 	//look up the locations of vertex attributes:
@@ -79,15 +82,51 @@ ShowSceneProgram::ShowSceneProgram() {
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
-	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	//the object matrices are in the "Draw" uniform block, which Scene::draw fills in:
+	Scene::bind_uniform_blocks(program);
 
+	//look up the locations of uniforms:
 	INSPECT_MODE_int = glGetUniformLocation(program, "INSPECT_MODE");
+
+	//Instanced variant -- the same, but with the object's matrices as per-instance attributes:
+	// (locations must match Scene::Drawable::Pipeline::Instanced::AttribLocation; the mesh attributes
+	//  are at fixed locations in both programs so the same vertex array works for either)
+	instanced_program = gl_compile_program(
+		//vertex shader:
+		std::string("#version 330\n")
+		+ Scene::FrameBlockGLSL +
+		"layout(location = 0) in vec4 Position;\n"
+		"layout(location = 1) in vec3 Normal;\n"
+		"layout(location = 2) in vec4 Color;\n"
+		"layout(location = 3) in vec2 TexCoord;\n"
+		"layout(location = 8) in mat4x3 OBJECT_TO_WORLD;\n"
+		"layout(location = 12) in mat3 NORMAL_TO_WORLD;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec4 color;\n"
+		"out vec2 texCoord;\n"
+		"void main() {\n"
+		"	vec4 world = vec4(OBJECT_TO_WORLD * Position, 1.0);\n"
+		"	gl_Position = WORLD_TO_CLIP * world;\n"
+		"	position = WORLD_TO_LIGHT * world;\n"
+		"	normal = NORMAL_WORLD_TO_LIGHT * (NORMAL_TO_WORLD * Normal);\n"
+		"	color = Color;\n"
+		"	texCoord = TexCoord;\n"
+		"}\n"
+	,
+		//fragment shader:
+		fragment_shader
+	);
+
+	//(camera matrices are in the "Frame" uniform block)
+	Scene::bind_uniform_blocks(instanced_program);
+
+	instanced_INSPECT_MODE_int = glGetUniformLocation(instanced_program, "INSPECT_MODE");
 }
 
 ShowSceneProgram::~ShowSceneProgram() {
+	glDeleteProgram(instanced_program);
+	instanced_program = 0;
 	glDeleteProgram(program);
 	program = 0;
 }
@@ -19,13 +19,17 @@ struct ShowSceneProgram {
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
 
-	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	//Uniform blocks:
+	// "Draw" (at Scene::DrawBlockBinding) has OBJECT_TO_CLIP, OBJECT_TO_LIGHT, NORMAL_TO_LIGHT -- see Scene::DrawBlock
 
+	//Uniform (per-invocation variable) locations:
 	GLuint INSPECT_MODE_int = -1U; //0: basic lighting; 1: position only; 2: normal only; 3: color only; 4: texcoord only
 
+	//Instanced variant (per-instance matrices come from vertex attributes; see Scene::Drawable::Pipeline::Instanced):
+	// (uses the "Frame" block, at Scene::FrameBlockBinding, for camera matrices)
+	GLuint instanced_program = 0;
+	GLuint instanced_INSPECT_MODE_int = -1U;
+
 	//Textures:
 	//no textures used
 };
@@ -1,6 +1,7 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "Trace.hpp"
 
 #include <SDL.h>
 
@@ -312,6 +313,9 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
+	Trace::set_thread_name("audio");
+	TRACE_SCOPE("mix_audio");
+
 	assert(buffer_); //should always have some audio buffer
 
 	struct LR {
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Load.hpp"
+
+//Shader program that draws solid-colored, axis-aligned rectangles from one instance record each:
+// (the vertex shader makes the four corners of a triangle strip from gl_VertexID)
+struct SpriteProgram {
+	SpriteProgram();
+	~SpriteProgram();
+
+	GLuint program = 0;
+	//Attribute (per-instance variable) locations:
+	GLuint Center_vec2 = -1U;
+	GLuint Radius_vec2 = -1U;
+	GLuint Color_vec4 = -1U;
+	//Uniform (per-invocation variable) locations:
+	GLuint OBJECT_TO_CLIP_mat4 = -1U;
+	//Textures:
+	// none
+};
+
+extern Load< SpriteProgram > sprite_program;
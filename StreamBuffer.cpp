@@ -0,0 +1,109 @@
+#include "StreamBuffer.hpp"
+
+#include <cassert>
+#include <stdexcept>
+#include <string>
+
+StreamBuffer::StreamBuffer(GLenum target_, GLsizeiptr capacity_) : target(target_), capacity(capacity_) {
+	assert(capacity > 0);
+}
+
+StreamBuffer::~StreamBuffer() {
+	drop_fences();
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+}
+
+GLuint StreamBuffer::get_buffer() {
+	if (buffer == 0) {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(target, buffer);
+		glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(target, 0);
+	}
+	return buffer;
+}
+
+void StreamBuffer::drop_fences() {
+	for (auto const &fence : fences) {
+		glDeleteSync(fence.sync);
+	}
+	fences.clear();
+}
+
+void StreamBuffer::fence_last() {
+	if (last.size == 0) return;
+	//everything issued so far -- including the draws that used the last span -- is before this fence:
+	fences.emplace_back(Fence{last.offset, last.offset + last.size, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+	last = Span();
+
+	//drop fences the GPU has already passed, so the list stays short:
+	while (!fences.empty()) {
+		GLenum result = glClientWaitSync(fences.front().sync, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) break;
+		glDeleteSync(fences.front().sync);
+		fences.pop_front();
+	}
+}
+
+bool StreamBuffer::reusable(GLintptr begin, GLintptr end) {
+	//fences are passed in order, so the newest overlapping one is the only one that matters:
+	size_t newest = fences.size();
+	for (size_t i = 0; i < fences.size(); ++i) {
+		if (fences[i].begin < end && begin < fences[i].end) newest = i;
+	}
+	if (newest == fences.size()) return true;
+
+	GLenum result = glClientWaitSync(fences[newest].sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) return false;
+
+	for (size_t i = 0; i <= newest; ++i) {
+		glDeleteSync(fences.front().sync);
+		fences.pop_front();
+	}
+	return true;
+}
+
+StreamBuffer::Span StreamBuffer::map(GLsizeiptr size, GLsizeiptr alignment) {
+	assert(size > 0);
+	assert(alignment > 0);
+	fence_last();
+
+	glBindBuffer(target, get_buffer());
+
+	GLintptr offset = (head + alignment - 1) / alignment * alignment;
+	if (offset + size > capacity) offset = 0; //wrap around
+	if (size > capacity || !reusable(offset, offset + size)) {
+		//the GPU is still reading that part of the ring (or the ring is too small):
+		// rather than stall, give the buffer fresh storage and start over at the beginning;
+		// the driver keeps the old storage around until the draws using it are done.
+		while (capacity < size) capacity *= 2;
+		glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+		drop_fences();
+		offset = 0;
+		orphans += 1;
+	}
+
+	last.data = glMapBufferRange(target, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!last.data) throw std::runtime_error("StreamBuffer: failed to map " + std::to_string(size) + " bytes.");
+	last.offset = offset;
+	last.size = size;
+	head = offset + size;
+
+	return last;
+}
+
+void StreamBuffer::unmap() {
+	assert(last.data);
+	glUnmapBuffer(target);
+	last.data = nullptr;
+	glBindBuffer(target, 0);
+}
+
+StreamBuffer &stream_vertex_buffer() {
+	//(never freed -- it's used until exit, which is after the GL context is gone)
+	static StreamBuffer *stream = new StreamBuffer(GL_ARRAY_BUFFER, 4 << 20);
+	return *stream;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * StreamBuffer is a ring of GPU memory for data that is rewritten every frame
+ * (per-draw uniforms, instance attributes, immediate-mode vertices, ...):
+ *
+ * StreamBuffer stream(GL_UNIFORM_BUFFER);
+ * StreamBuffer::Span span = stream.map(sizeof(Block), alignment);
+ * std::memcpy(span.data, &block, sizeof(Block));
+ * stream.unmap();
+ * glBindBufferRange(GL_UNIFORM_BUFFER, binding, stream.buffer, span.offset, sizeof(Block));
+ * ... draw ...
+ *
+ * Spans are handed out front-to-back through one buffer object and mapped
+ * without synchronization; a fence is placed after each span's draws are
+ * issued. When the ring wraps around onto data the GPU hasn't finished with
+ * yet, map() doesn't wait -- it falls back to giving the buffer fresh storage
+ * ("orphaning" it) and starts over. (GL 3.3 has no persistent mapping, so
+ * each span is mapped / unmapped individually.)
+ *
+ * Spans are only valid until the next map() -- draw from a span before
+ * mapping another one. Needs a current OpenGL context; the buffer object is
+ * created on first use.
+ */
+
+#include "GL.hpp"
+
+#include <cstddef>
+#include <deque>
+
+struct StreamBuffer {
+	StreamBuffer(GLenum target, GLsizeiptr capacity = 1 << 20);
+	~StreamBuffer();
+
+	StreamBuffer(StreamBuffer const &) = delete;
+	StreamBuffer &operator=(StreamBuffer const &) = delete;
+
+	struct Span {
+		void *data = nullptr; //write here (write-only memory -- don't read it back)...
+		GLintptr offset = 0; //...and it will show up here in 'buffer'
+		GLsizeiptr size = 0;
+	};
+
+	//map 'size' bytes starting at a multiple of 'alignment' (leaves 'buffer' bound to 'target'):
+	// (for vertex data, use the vertex size as 'alignment'; then offset / size is the first vertex to draw)
+	Span map(GLsizeiptr size, GLsizeiptr alignment = 16);
+	//finish writing the last span (and unbind 'buffer'):
+	void unmap();
+
+	//the buffer object (e.g., for setting up vertex arrays; creates it if needed):
+	GLuint get_buffer();
+
+	GLenum target;
+	GLuint buffer = 0;
+	GLsizeiptr capacity;
+	uint32_t orphans = 0; //times map() had to re-specify the buffer's storage (ideally rare)
+
+	//internals:
+	GLintptr head = 0; //end of the most recent span
+	struct Fence {
+		GLintptr begin, end; //range of a span that draws issued before 'sync' may read
+		GLsync sync;
+	};
+	std::deque< Fence > fences; //oldest first
+	Span last; //most recent span (not fenced yet)
+
+	void fence_last();
+	bool reusable(GLintptr begin, GLintptr end); //has the GPU finished with [begin,end)?
+	void drop_fences();
+};
+
+//A ring shared by everything that streams vertex data (GL_ARRAY_BUFFER):
+StreamBuffer &stream_vertex_buffer();
@@ -0,0 +1,183 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+//One thread's zones. Only the owning thread writes; write_json() may read
+// from any thread while it does, so this works like a seqlock:
+// 'started' is bumped before a slot is (over)written and 'finished' after.
+struct ThreadBuffer {
+	struct Zone {
+		std::atomic< char const * > name{nullptr};
+		std::atomic< uint64_t > start{0};
+		std::atomic< uint64_t > end{0};
+	};
+
+	uint32_t id = 0;
+	std::atomic< char const * > thread_name{nullptr};
+	std::atomic< uint64_t > started{0}; //zones that have begun being written
+	std::atomic< uint64_t > finished{0}; //zones that are completely written
+	std::vector< Zone > zones = std::vector< Zone >(Trace::Capacity);
+};
+
+static_assert((Trace::Capacity & (Trace::Capacity - 1)) == 0, "Capacity should be a power of two");
+
+//All buffers ever created (never freed, so zones from exited threads can still be dumped):
+std::mutex &buffers_mutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+std::list< ThreadBuffer > &buffers() {
+	static std::list< ThreadBuffer > list;
+	return list;
+}
+//...of which these belong to threads that have exited, and can be handed to new threads:
+// (so the number of buffers -- each Capacity zones -- only grows with the number of threads alive at once)
+std::vector< ThreadBuffer * > &free_buffers() {
+	static std::vector< ThreadBuffer * > list;
+	return list;
+}
+uint32_t next_id = 1; //(thread ids in the trace; a reused buffer gets a new one)
+
+//the calling thread's buffer, returned to free_buffers() when the thread exits:
+thread_local ThreadBuffer *current = nullptr;
+thread_local bool exited = false; //(zones recorded during thread exit, after the buffer is returned, are dropped)
+struct ThreadBufferOwner {
+	~ThreadBufferOwner() {
+		std::lock_guard< std::mutex > lock(buffers_mutex());
+		free_buffers().emplace_back(current);
+		current = nullptr;
+		exited = true;
+	}
+};
+
+//(nullptr while the thread is exiting)
+ThreadBuffer *thread_buffer() {
+	if (!current && !exited) {
+		{
+			std::lock_guard< std::mutex > lock(buffers_mutex());
+			if (free_buffers().empty()) {
+				buffers().emplace_back();
+				current = &buffers().back();
+			} else {
+				//(the previous owner is gone, and write_json holds the lock while reading, so this can just be reset)
+				current = free_buffers().back();
+				free_buffers().pop_back();
+				current->thread_name.store(nullptr, std::memory_order_relaxed);
+				current->started.store(0, std::memory_order_relaxed);
+				current->finished.store(0, std::memory_order_relaxed);
+			}
+			current->id = next_id++;
+		}
+		static thread_local ThreadBufferOwner owner; //(constructed here, so its destructor runs when this thread exits)
+		(void)owner;
+	}
+	return current;
+}
+
+//write 'str' as a JSON string:
+void write_string(std::ostream &out, char const *str) {
+	out << '"';
+	for (char const *c = str; *c; ++c) {
+		if (*c == '"' || *c == '\\') out << '\\' << *c;
+		else if (uint8_t(*c) < 0x20) out << ' ';
+		else out << *c;
+	}
+	out << '"';
+}
+
+} //namespace
+
+uint64_t Trace::now() {
+	static auto const epoch = std::chrono::steady_clock::now();
+	return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - epoch).count());
+}
+
+void Trace::record(char const *name, uint64_t start, uint64_t end) {
+	ThreadBuffer *current = thread_buffer();
+	if (!current) return;
+	ThreadBuffer &buffer = *current;
+	uint64_t index = buffer.finished.load(std::memory_order_relaxed);
+	buffer.started.store(index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	ThreadBuffer::Zone &zone = buffer.zones[index & (Capacity - 1)];
+	zone.name.store(name, std::memory_order_relaxed);
+	zone.start.store(start, std::memory_order_relaxed);
+	zone.end.store(end, std::memory_order_relaxed);
+	buffer.finished.store(index + 1, std::memory_order_release);
+}
+
+void Trace::set_thread_name(char const *name) {
+	if (ThreadBuffer *buffer = thread_buffer()) buffer->thread_name.store(name, std::memory_order_relaxed);
+}
+
+bool Trace::write_json(std::string const &path) {
+	std::ofstream out(path, std::ios::binary);
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\":[\n";
+
+	bool first = true;
+	auto separator = [&]() {
+		if (!first) out << ",\n";
+		first = false;
+	};
+
+	std::lock_guard< std::mutex > lock(buffers_mutex());
+	for (ThreadBuffer const &buffer : buffers()) {
+		if (char const *thread_name = buffer.thread_name.load(std::memory_order_relaxed)) {
+			separator();
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.id << ",\"args\":{\"name\":";
+			write_string(out, thread_name);
+			out << "}}";
+		}
+
+		//copy out the most recent zones, then drop any the owning thread may have overwritten meanwhile:
+		uint64_t end = buffer.finished.load(std::memory_order_acquire);
+		uint64_t begin = (end > Capacity ? end - Capacity : 0);
+		struct Copied {
+			char const *name;
+			uint64_t start, end;
+		};
+		std::vector< Copied > copied;
+		copied.reserve(size_t(end - begin));
+		for (uint64_t i = begin; i < end; ++i) {
+			ThreadBuffer::Zone const &zone = buffer.zones[i & (Capacity - 1)];
+			copied.emplace_back(Copied{
+				zone.name.load(std::memory_order_relaxed),
+				zone.start.load(std::memory_order_relaxed),
+				zone.end.load(std::memory_order_relaxed)
+			});
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		//(slot i is only overwritten after 'started' passes i + Capacity)
+		uint64_t started = buffer.started.load(std::memory_order_relaxed);
+		uint64_t valid_begin = (started > Capacity ? started - Capacity : 0);
+
+		for (uint64_t i = std::max(begin, valid_begin); i < end; ++i) {
+			Copied const &zone = copied[size_t(i - begin)];
+			separator();
+			//(chrome trace times are in microseconds)
+			out << "{\"name\":";
+			write_string(out, zone.name);
+			out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.id
+			    << ",\"ts\":" << double(zone.start) / 1000.0
+			    << ",\"dur\":" << double(zone.end - zone.start) / 1000.0 << "}";
+		}
+	}
+
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	if (!out) {
+		std::cerr << "WARNING: failed to write trace to '" << path << "'." << std::endl;
+		return false;
+	}
+	return true;
+}
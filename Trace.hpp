@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+ * Trace records timed zones into per-thread ring buffers, which can be
+ * dumped as Chrome trace JSON (open in chrome://tracing or ui.perfetto.dev):
+ *
+ * void PlayMode::update(float elapsed) {
+ *     TRACE_SCOPE("PlayMode::update");
+ *     ...
+ * }
+ *
+ * //later, from any thread:
+ * Trace::write_json("trace.json");
+ *
+ * Zone names must be string literals (only the pointer is stored).
+ *
+ * Each thread only ever writes to its own buffer, so recording a zone doesn't
+ * take any locks; a buffer keeps the most recent Trace::Capacity zones.
+ * When a thread exits, its buffer (and the zones in it, until then) is handed
+ * on to the next new thread, so short-lived threads don't each keep one.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Trace {
+
+constexpr uint32_t Capacity = 1 << 16; //zones kept per thread (must be a power of two)
+
+//nanoseconds since the first call to now():
+uint64_t now();
+
+//record a zone that ran from 'start' to 'end' (in now() units) on the calling thread:
+void record(char const *name, uint64_t start, uint64_t end);
+
+//label the calling thread in the dumped trace (name must be a string literal):
+void set_thread_name(char const *name);
+
+//write every thread's recorded zones as Chrome trace JSON:
+// (returns false, after printing a warning, on failure)
+bool write_json(std::string const &path);
+
+//records a zone covering its lifetime:
+struct Scope {
+	Scope(char const *name_) : name(name_), start(now()) { }
+	~Scope() { record(name, start, now()); }
+	Scope(Scope const &) = delete;
+	Scope &operator=(Scope const &) = delete;
+
+	char const *name;
+	uint64_t start;
+};
+
+} //namespace Trace
+
+#define TRACE_CONCAT_INNER(A, B) A ## B
+#define TRACE_CONCAT(A, B) TRACE_CONCAT_INNER(A, B)
+
+//time the rest of the enclosing block:
+#define TRACE_SCOPE(NAME) Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(NAME)
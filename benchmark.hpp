@@ -0,0 +1,49 @@
+#pragma once
+
+//Helpers shared by the headless benchmarks (benchmarks.cpp, server-tests.cpp):
+//
+// float ms = Benchmark::median_ms(21, [&]() {
+//     ... //work to time
+//     Benchmark::keep(result); //so the work isn't optimized away
+// });
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace Benchmark {
+
+//results fed here count as used, so the compiler can't skip computing them:
+inline volatile uint32_t sink = 0;
+inline void keep(uint32_t value) {
+	sink = sink + value;
+}
+inline void keep(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, 4);
+	keep(bits);
+}
+
+//median time of 'runs' calls to 'fn', in milliseconds:
+// (with 'setup', called before each run but not timed)
+template< typename Setup, typename F >
+float median_ms(uint32_t runs, Setup const &setup, F const &fn) {
+	std::vector< float > ms;
+	ms.reserve(runs);
+	for (uint32_t run = 0; run < runs; ++run) {
+		setup();
+		auto before = std::chrono::high_resolution_clock::now();
+		fn();
+		ms.emplace_back(std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count());
+	}
+	std::sort(ms.begin(), ms.end());
+	return ms[ms.size() / 2];
+}
+template< typename F >
+float median_ms(uint32_t runs, F const &fn) {
+	return median_ms(runs, [](){}, fn);
+}
+
+} //namespace Benchmark
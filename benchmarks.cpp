@@ -0,0 +1,352 @@
+//benchmarks times parts of the engine on synthetic data, without a window (so no OpenGL calls are made):
+//
+//Usage:
+//	./benchmarks [transforms] [culling] [sprites]  (with no names, runs all of them)
+//	./benchmarks load <path/to/meshes.pnct> [path/to/scene.scene]  (times loading real files)
+//
+//(scenes/Makefile's bench-scene target runs the scene ones, and bench-load the load one)
+
+#include "Scene.hpp"
+#include "DrawList.hpp"
+#include "BVH.hpp"
+#include "DrawSprites.hpp"
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
+#include "benchmark.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+//world matrices of a 10k-transform, depth-8 hierarchy: cached (Scene::update_transforms) vs. recomputed up the parent chain:
+static void transform_benchmark() {
+	std::mt19937 mt(0x7f0a11);
+	auto random = [&mt](float lo, float hi) { return std::uniform_real_distribution< float >(lo, hi)(mt); };
+
+	//eight levels, each transform parented to a random one on the level above:
+	// (parents come before children, as in loaded scenes)
+	Scene scene;
+	uint32_t const level_sizes[8] = { 10, 30, 60, 100, 300, 1000, 2500, 6000 };
+	uint32_t level_begin = 0;
+	for (uint32_t level = 0; level < 8; ++level) {
+		uint32_t begin = uint32_t(scene.transforms.size());
+		for (uint32_t i = 0; i < level_sizes[level]; ++i) {
+			scene.transforms.emplace_back();
+			Scene::Transform &transform = scene.transforms.back();
+			transform.position = glm::vec3(random(-10.0f, 10.0f), random(-10.0f, 10.0f), random(-10.0f, 10.0f));
+			transform.rotation = glm::normalize(glm::quat(random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f)));
+			transform.scale = glm::vec3(random(0.5f, 1.5f));
+			if (level > 0) transform.parent = &scene.transforms[level_begin + mt() % (begin - level_begin)];
+		}
+		level_begin = begin;
+	}
+	uint32_t count = uint32_t(scene.transforms.size());
+
+	//without the cache, every world matrix means multiplying all the way up the parent chain:
+	std::function< glm::mat4x3(Scene::Transform const &) > uncached = [&uncached](Scene::Transform const &transform) {
+		if (!transform.parent) return transform.make_local_to_parent();
+		return glm::mat4x3(glm::mat4(uncached(*transform.parent)) * glm::mat4(transform.make_local_to_parent()));
+	};
+
+	constexpr uint32_t Runs = 51;
+	float recompute = Benchmark::median_ms(Runs, [&]() {
+		float sum = 0.0f;
+		for (auto const &transform : scene.transforms) sum += uncached(transform)[3].x;
+		Benchmark::keep(sum);
+	});
+	scene.update_transforms();
+	float unchanged = Benchmark::median_ms(Runs, [&]() {
+		scene.update_transforms();
+	});
+	//move 1% of the transforms (each moves its subtree, too):
+	float some_moved = Benchmark::median_ms(Runs, [&]() {
+		for (uint32_t i = 0; i < count / 100; ++i) scene.transforms[mt() % count].position.x += 0.01f;
+		scene.update_transforms();
+	});
+	//move the roots (so everything changes):
+	float all_moved = Benchmark::median_ms(Runs, [&]() {
+		for (uint32_t i = 0; i < level_sizes[0]; ++i) scene.transforms[i].position.x += 0.01f;
+		scene.update_transforms();
+	});
+
+	std::cout << "Transforms (" << count << ", depth 8; median of " << Runs << " frames):\n"
+		<< "  recomputed up the parent chain: " << recompute << " ms\n"
+		<< "  update_transforms(), nothing moved: " << unchanged << " ms\n"
+		<< "  update_transforms(), 1% moved: " << some_moved << " ms\n"
+		<< "  update_transforms(), roots moved: " << all_moved << " ms" << std::endl;
+}
+
+//culling a 100k-drawable city grid: linear (DrawList::add without a BVH) vs. through Scene::build_bvh's BVH,
+// and the cost of building + refitting that BVH:
+static void culling_benchmark() {
+	std::mt19937 mt(0xc171e5);
+	auto random = [&mt](float lo, float hi) { return std::uniform_real_distribution< float >(lo, hi)(mt); };
+
+	//blocks of buildings around a camera at the origin (looking down -z):
+	Scene scene;
+	constexpr uint32_t Side = 320;
+	for (uint32_t z = 0; z < Side; ++z) {
+		for (uint32_t x = 0; x < Side; ++x) {
+			scene.transforms.emplace_back();
+			Scene::Transform *transform = &scene.transforms.back();
+			transform->position = glm::vec3(5.0f * (float(x) - 0.5f * Side), -5.0f, 5.0f * (float(z) - 0.5f * Side));
+			scene.drawables.emplace_back(transform);
+			Scene::Drawable &drawable = scene.drawables.back();
+			drawable.pipeline.program = 1;
+			drawable.pipeline.vao = 1;
+			drawable.pipeline.count = 36;
+			drawable.bounds_min = glm::vec3(-2.0f, 0.0f, -2.0f);
+			drawable.bounds_max = glm::vec3(2.0f, random(2.0f, 20.0f), 2.0f);
+		}
+	}
+	uint32_t count = uint32_t(scene.drawables.size());
+	glm::mat4 world_to_clip = glm::infinitePerspective(glm::radians(60.0f), 1.0f, 0.1f);
+
+	constexpr uint32_t Runs = 21;
+	DrawList draw_list;
+	uint64_t pass = scene.update_transforms();
+	auto cull = [&]() {
+		draw_list.clear();
+		draw_list.add(scene, world_to_clip, pass);
+	};
+	auto visible_set = [&]() {
+		std::vector< Scene::Drawable const * > visible;
+		for (auto const &item : draw_list.items) visible.emplace_back(item.drawable);
+		std::sort(visible.begin(), visible.end());
+		return visible;
+	};
+
+	float linear = Benchmark::median_ms(Runs, cull);
+	std::vector< Scene::Drawable const * > linear_visible = visible_set();
+
+	float build = Benchmark::median_ms(5, [&]() { scene.build_bvh(); });
+	float bvh_cull = Benchmark::median_ms(Runs, cull);
+	std::vector< Scene::Drawable const * > bvh_visible = visible_set();
+
+	//refit only (moving transforms + update_transforms() isn't counted):
+	auto refit_ms = [&](uint32_t moved) {
+		return Benchmark::median_ms(Runs, [&]() {
+			for (uint32_t i = 0; i < moved; ++i) scene.transforms[moved == count ? i : mt() % count].position.y += 0.01f;
+			pass = scene.update_transforms();
+		}, [&]() {
+			scene.update_bvh(pass);
+		});
+	};
+	float refit_some = refit_ms(count / 100);
+	float refit_all = refit_ms(count);
+
+	//the tree itself, over the same boxes:
+	std::vector< BVH::Box > const &boxes = scene.drawable_bvh.boxes;
+	BVH bvh;
+	float tree_build = Benchmark::median_ms(5, [&]() { bvh.build(boxes); });
+	float tree_refit = Benchmark::median_ms(Runs, [&]() { bvh.refit(boxes); });
+
+	std::cout << "Culling (" << count << " drawables, " << linear_visible.size() << " visible; "
+		<< std::thread::hardware_concurrency() << " hardware thread(s); median of " << Runs << " frames):\n"
+		<< "  linear: " << linear << " ms\n"
+		<< "  BVH: " << bvh_cull << " ms" << (bvh_visible == linear_visible ? "" : " (WARNING: visible set differs from linear culling)") << "\n"
+		<< "  Scene::build_bvh(): " << build << " ms (BVH::build() alone: " << tree_build << " ms)\n"
+		<< "  Scene::update_bvh(), 1% moved: " << refit_some << " ms; all moved: " << refit_all << " ms (BVH::refit() alone: " << tree_refit << " ms)" << std::endl;
+}
+
+//CPU cost of building a frame's worth of rectangles for upload: DrawSprites (a 20-byte record per sprite,
+// copied into the stream buffer as submit() does) vs. the six full vertices per rectangle PlayMode used to write:
+// (a plain buffer stands in for mapped stream buffer memory)
+static void sprite_benchmark() {
+	struct Vertex { //(PlayMode's old vertex format)
+		Vertex(glm::vec3 const &Position_, glm::u8vec4 const &Color_, glm::vec2 const &TexCoord_) :
+			Position(Position_), Color(Color_), TexCoord(TexCoord_) { }
+		glm::vec3 Position;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 4*3 + 1*4 + 4*2, "Vertex should be packed");
+
+	constexpr uint32_t Runs = 5;
+	std::cout << "Sprite batch build (median of " << Runs << " runs):" << std::endl;
+	std::mt19937 mt(0x5b417e);
+	std::uniform_real_distribution< float > coord(0.0f, 8.0f), size(0.01f, 0.2f);
+	for (uint32_t count : { 100u, 10000u, 50000u }) {
+		struct Rectangle {
+			glm::vec2 center, radius;
+			glm::u8vec4 color;
+		};
+		std::vector< Rectangle > rectangles(count);
+		for (auto &r : rectangles) {
+			r.center = glm::vec2(coord(mt), coord(mt));
+			r.radius = glm::vec2(size(mt), size(mt));
+			r.color = glm::u8vec4(uint8_t(mt()), uint8_t(mt()), uint8_t(mt()), 0xff);
+		}
+		std::vector< char > mapped(count * 6 * sizeof(Vertex));
+		uint32_t reps = std::max(1u, 2000000u / count);
+
+		auto median_us = [&](auto const &fn) {
+			return 1000.0f * Benchmark::median_ms(Runs, [&]() {
+				for (uint32_t r = 0; r < reps; ++r) fn();
+			}) / reps;
+		};
+
+		float vertices_us = median_us([&]() {
+			Vertex *vertices = reinterpret_cast< Vertex * >(mapped.data());
+			uint32_t vertex_count = 0;
+			for (auto const &r : rectangles) {
+				glm::vec2 const &center = r.center, &size = r.radius;
+				vertices[vertex_count++] = Vertex(glm::vec3(center.x-size.x, center.y-size.y, 0.0f), r.color, glm::vec2(0.5f, 0.5f));
+				vertices[vertex_count++] = Vertex(glm::vec3(center.x+size.x, center.y-size.y, 0.0f), r.color, glm::vec2(0.5f, 0.5f));
+				vertices[vertex_count++] = Vertex(glm::vec3(center.x+size.x, center.y+size.y, 0.0f), r.color, glm::vec2(0.5f, 0.5f));
+				vertices[vertex_count++] = Vertex(glm::vec3(center.x-size.x, center.y-size.y, 0.0f), r.color, glm::vec2(0.5f, 0.5f));
+				vertices[vertex_count++] = Vertex(glm::vec3(center.x+size.x, center.y+size.y, 0.0f), r.color, glm::vec2(0.5f, 0.5f));
+				vertices[vertex_count++] = Vertex(glm::vec3(center.x-size.x, center.y+size.y, 0.0f), r.color, glm::vec2(0.5f, 0.5f));
+			}
+			Benchmark::keep(uint32_t(uint8_t(mapped[vertex_count * sizeof(Vertex) - 1])));
+		});
+
+		float sprites_us = median_us([&]() {
+			DrawSprites sprites(glm::mat4(1.0f));
+			for (auto const &r : rectangles) sprites.draw(r.center, r.radius, r.color);
+			size_t bytes = sprites.sprites.size() * sizeof(DrawSprites::Sprite);
+			std::memcpy(mapped.data(), sprites.sprites.data(), bytes);
+			Benchmark::keep(uint32_t(uint8_t(mapped[bytes - 1])));
+			sprites.sprites.clear(); //(so nothing is submitted)
+		});
+
+		std::cout << "  " << count << " sprites: six vertices " << vertices_us << " us (" << count * 6 * sizeof(Vertex) / 1024 << " KB);"
+			<< " DrawSprites " << sprites_us << " us (" << count * sizeof(DrawSprites::Sprite) / 1024 << " KB)" << std::endl;
+	}
+}
+
+//time the parts of loading a mesh file (and, optionally, a scene that uses it) that don't use OpenGL:
+static void load_benchmark(std::string const &meshes_file, std::string const &scene_file) {
+	constexpr uint32_t Runs = 20;
+
+	//getting every chunk of the file into an upload buffer (a stand-in for glBufferData's copy):
+	// through std::istream into a vector per chunk (as read_chunk does) vs. straight out of a MappedFile:
+	{
+		std::vector< char > upload;
+		float stream_ms = Benchmark::median_ms(Runs, [&]() {
+			std::ifstream file(meshes_file, std::ios::binary);
+			std::vector< char > chunk;
+			upload.clear();
+			char magic[4];
+			while (file.read(magic, 4)) {
+				file.seekg(-4, std::ios::cur);
+				read_chunk(file, std::string(magic, 4), &chunk);
+				upload.insert(upload.end(), chunk.begin(), chunk.end());
+			}
+		});
+		float mapped_ms = Benchmark::median_ms(Runs, [&]() {
+			MappedFile mapped(meshes_file);
+			ChunkReader chunks(mapped.data(), mapped.size(), meshes_file);
+			upload.clear();
+			while (chunks.remaining() >= 8) {
+				ChunkSpan< char > span = chunks.read< char >(std::string(chunks.at, 4));
+				upload.insert(upload.end(), span.begin(), span.end());
+			}
+		});
+		std::cout << "Chunks to upload (" << upload.size() / 1024 << " KB): std::istream + read_chunk " << stream_ms
+			<< " ms; MappedFile + ChunkReader " << mapped_ms << " ms (median of " << Runs << " reads, warm file cache)" << std::endl;
+	}
+
+	float read_ms = 0.0f; //(Full layout, which is what MeshBuffer's constructor uses)
+	for (MeshBuffer::Layout layout : { MeshBuffer::Layout::Full, MeshBuffer::Layout::Compact }) {
+		size_t meshes = 0, bytes = 0;
+		bool bounds_from_file = false;
+		float ms = Benchmark::median_ms(Runs, [&]() {
+			std::unique_ptr< MeshBuffer::Data > data = MeshBuffer::read(meshes_file, layout);
+			meshes = data->meshes.size();
+			bytes = data->vertices_size + data->indices_size;
+			bounds_from_file = data->bounds_from_file;
+		});
+		if (layout == MeshBuffer::Layout::Full) read_ms = ms;
+		std::cout << (layout == MeshBuffer::Layout::Full ? "Full" : "Compact") << " layout: " << meshes << " meshes, "
+			<< bytes / 1024 << " KB to upload, bounds " << (bounds_from_file ? "read from file" : "computed") << "; "
+			<< ms << " ms (median of " << Runs << " reads)" << std::endl;
+	}
+
+	if (scene_file != "") {
+		//Scene::load, with drawables made for the meshes it names (as show-scene does, minus the vertex array):
+		std::unique_ptr< MeshBuffer::Data > data = MeshBuffer::read(meshes_file);
+		size_t transforms = 0, drawables = 0;
+		float load_ms = Benchmark::median_ms(Runs, [&]() {
+			Scene scene;
+			scene.load(scene_file, [&data](Scene &scene, Scene::Transform *transform, std::string const &mesh_name) {
+				auto f = data->meshes.find(mesh_name);
+				if (f == data->meshes.end()) throw std::runtime_error("Mesh '" + mesh_name + "' not found.");
+				scene.drawables.emplace_back(transform);
+				scene.drawables.back().pipeline.start = f->second.start;
+				scene.drawables.back().pipeline.count = f->second.count;
+			});
+			transforms = scene.transforms.size();
+			drawables = scene.drawables.size();
+		});
+		std::cout << "Scene::load: " << transforms << " transforms, " << drawables << " drawables; " << load_ms << " ms (median of " << Runs << " loads)" << std::endl;
+		std::cout << "Startup (mesh read + scene load, before upload): " << read_ms + load_ms << " ms" << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	struct {
+		char const *name;
+		void (*run)();
+	} const benchmarks[] = {
+		{ "transforms", transform_benchmark },
+		{ "culling", culling_benchmark },
+		{ "sprites", sprite_benchmark },
+	};
+
+	std::vector< std::string > names(argv + 1, argv + argc);
+	if (!names.empty() && names[0] == "load") {
+		if (names.size() != 2 && names.size() != 3) {
+			std::cerr << "Usage:\n\t" << argv[0] << " load <path/to/meshes.pnct> [path/to/scene.scene]" << std::endl;
+			return 1;
+		}
+		load_benchmark(names[1], (names.size() == 3 ? names[2] : ""));
+		return 0;
+	}
+	if (names.empty()) {
+		for (auto const &benchmark : benchmarks) names.emplace_back(benchmark.name);
+	}
+	for (auto const &name : names) {
+		bool found = false;
+		for (auto const &benchmark : benchmarks) {
+			if (name == benchmark.name) {
+				benchmark.run();
+				found = true;
+			}
+		}
+		if (!found) {
+			std::cerr << "Unknown benchmark '" << name << "'. Usage:\n\t" << argv[0] << " [";
+			for (auto const &benchmark : benchmarks) std::cerr << (&benchmark == benchmarks ? "" : "|") << benchmark.name;
+			std::cerr << "]...  (with no names, runs all of them)\n\t" << argv[0] << " load <path/to/meshes.pnct> [path/to/scene.scene]" << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -3,9 +3,12 @@
 #include "Connection.hpp"
 #include "Mode.hpp"
 #include "Load.hpp"
+#include "AssetPack.hpp"
+#include "data_path.hpp"
 #include "Sound.hpp"
 #include "GL.hpp"
-#include "load_save_png.hpp"
+#include "FrameCapture.hpp"
+#include "Trace.hpp"
 
 #include <SDL.h>
 
@@ -26,6 +29,8 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 
+	Trace::set_thread_name("main");
+
 	//------------ connect to server --------------
 	Client client(argv[1], argv[2]);
 
@@ -93,6 +98,10 @@ int main(int argc, char **argv) {
 	Sound::init();
 
 	//------------ load assets --------------
+	//(if the data files have been packed -- see scenes/Makefile -- read them from the pack)
+	if (mount_asset_pack(data_path("assets.pack"))) {
+		std::cout << "Reading data from '" << data_path("assets.pack") << "'." << std::endl;
+	}
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
@@ -115,12 +124,17 @@ int main(int argc, char **argv) {
 	};
 	on_resize();
 
+	//screenshots / recording (frames are read back and saved in the background):
+	FrameCapture capture;
+
 	//This will loop until the current mode is set to null:
 	while (Mode::current) {
+		TRACE_SCOPE("frame");
 		//every pass through the game loop creates one frame of output
 		//  by performing three steps:
 
 		{ //(1) process any events that are pending
+			TRACE_SCOPE("events");
 			static SDL_Event evt;
 			while (SDL_PollEvent(&evt) == 1) {
 				//handle resizing:
@@ -137,22 +151,29 @@ int main(int argc, char **argv) {
 					// --- screenshot key ---
 					std::string filename = "screenshot.png";
 					std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
-					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-					glReadBuffer(GL_FRONT);
-					int w,h;
-					SDL_GL_GetDrawableSize(window, &w, &h);
-					std::vector< glm::u8vec4 > data(w*h);
-					glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-					for (auto &px : data) {
-						px.a = 0xff;
+					capture.request(filename);
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_r) {
+					// --- record key ---
+					if (capture.recording()) {
+						std::cout << "Stopped recording." << std::endl;
+						capture.stop_recording();
+					} else {
+						std::string prefix = "recording";
+						std::cout << "Recording every frame to '" << prefix << "-NNNNNN.png' (press 'r' again to stop)." << std::endl;
+						capture.start_recording(prefix);
 					}
-					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_t) {
+					// --- trace key ---
+					std::string filename = "trace.json";
+					std::cout << "Saving trace to '" << filename << "' (open in chrome://tracing or ui.perfetto.dev)." << std::endl;
+					Trace::write_json(filename);
 				}
 			}
 			if (!Mode::current) break;
 		}
 
 		{ //(2) call the current mode's "update" function to deal with elapsed time:
+			TRACE_SCOPE("update");
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
 			float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
@@ -167,16 +188,23 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			TRACE_SCOPE("draw");
 			Mode::current->draw(drawable_size);
 		}
 
+		//save the frame if asked to (before the swap, while it's still in the back buffer):
+		capture.frame_drawn(drawable_size);
+
 		//Wait until the recently-drawn frame is shown before doing it all again:
-		SDL_GL_SwapWindow(window);
+		{
+			TRACE_SCOPE("swap");
+			SDL_GL_SwapWindow(window);
+		}
 	}
 
 
 	//------------  teardown ------------
+	capture.finish();
 	Sound::shutdown();
 
 	SDL_GL_DeleteContext(context);
@@ -0,0 +1,700 @@
+//index-meshes converts a .pnct file (non-indexed triangles, as written by
+// scenes/export-meshes.py) into a .pnci file that MeshBuffer can draw with
+// glDrawElements:
+//  - identical vertices within each mesh are welded together
+//  - triangles are reordered for the post-transform vertex cache
+//    (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation")
+//  - vertices are then reordered by first use, so vertex fetches walk memory in order
+//  - up to three simplified levels of detail are made for each mesh (by quadric error metric
+//    edge collapses onto existing vertices, so they're just more indices over the same vertices)
+//
+//Usage:
+//	./index-meshes [--lods <0-3>] <in.pnct> <out.pnci>
+//
+//.pnci layout:
+// |pnct| vertices (same Vertex as .pnct), each mesh's vertices contiguous
+// |ind0| uint32 indices, relative to their mesh's first vertex
+// |str0| names (copied from the input)
+// |idx1| per mesh: name_begin, name_end, vertex_begin, vertex_end, index_begin, index_end
+// |lod0| (optional) per level of detail, coarsest last: mesh (index in idx1), index_begin, index_end, error (float)
+// |bnd0| per mesh (in idx1 order): min, max (glm::vec3s) of its vertex positions -- so MeshBuffer needn't compute them
+
+#include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+struct IndexedEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+	uint32_t index_begin, index_end;
+};
+static_assert(sizeof(IndexedEntry) == 24, "Indexed entry should be packed");
+
+struct LODEntry {
+	uint32_t mesh;
+	uint32_t index_begin, index_end;
+	float error; //(object space distance)
+};
+static_assert(sizeof(LODEntry) == 16, "LOD entry should be packed");
+
+struct BoundsEntry {
+	glm::vec3 min, max;
+};
+static_assert(sizeof(BoundsEntry) == 24, "Bounds entry should be packed");
+
+//Forsyth's greedy triangle ordering: repeatedly emit the highest-scoring triangle, where vertices
+// score highly if they are recently used (in a simulated LRU cache) or have few triangles left:
+struct ForsythOrder {
+	static constexpr int32_t CacheSize = 32;
+
+	static float vertex_score(int32_t cache_position, uint32_t remaining) {
+		if (remaining == 0) return -1.0f; //(no triangles left to use this vertex)
+		float score = 0.0f;
+		if (cache_position >= 0) {
+			if (cache_position < 3) {
+				//used by the last triangle -- fixed score, so there's no bias towards any particular winding:
+				score = 0.75f;
+			} else {
+				score = std::pow(1.0f - float(cache_position - 3) / float(CacheSize - 3), 1.5f);
+			}
+		}
+		//boost vertices with few triangles left, so meshes don't get left with stray triangles:
+		score += 2.0f / std::sqrt(float(remaining));
+		return score;
+	}
+
+	//returns the triangles of 'indices' (3 per triangle, vertices in [0, vertex_count)) in optimized order:
+	static std::vector< uint32_t > optimize(std::vector< uint32_t > const &indices, uint32_t vertex_count) {
+		uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+		//triangles using each vertex (as ranges of one array); the first 'remaining[v]' are not yet emitted:
+		std::vector< uint32_t > first(vertex_count + 1, 0);
+		for (uint32_t i : indices) first[i + 1] += 1;
+		for (uint32_t v = 0; v < vertex_count; ++v) first[v + 1] += first[v];
+		std::vector< uint32_t > triangles(indices.size());
+		std::vector< uint32_t > remaining(vertex_count, 0);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3 * t + c];
+				triangles[first[v] + remaining[v]++] = t;
+			}
+		}
+
+		std::vector< int32_t > cache_position(vertex_count, -1);
+		std::vector< float > score(vertex_count);
+		for (uint32_t v = 0; v < vertex_count; ++v) {
+			score[v] = vertex_score(-1, remaining[v]);
+		}
+		std::vector< float > triangle_score(triangle_count);
+		std::vector< bool > emitted(triangle_count, false);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			triangle_score[t] = score[indices[3*t+0]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+		}
+
+		std::vector< uint32_t > out;
+		out.reserve(indices.size());
+		std::vector< uint32_t > cache, next_cache;
+		cache.reserve(CacheSize + 3);
+		next_cache.reserve(CacheSize + 3);
+
+		uint32_t best = -1U;
+		uint32_t scan = 0; //fallback when nothing in the cache has triangles left: next unemitted triangle in input order
+		for (uint32_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count) {
+			if (best == -1U) {
+				while (emitted[scan]) ++scan;
+				best = scan;
+			}
+
+			//emit the best triangle:
+			emitted[best] = true;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3 * best + c];
+				out.emplace_back(v);
+				//remove 'best' from v's remaining triangles:
+				uint32_t *list = &triangles[first[v]];
+				uint32_t *end = list + remaining[v];
+				*std::find(list, end, best) = *(end - 1);
+				remaining[v] -= 1;
+			}
+
+			//move its vertices to the front of the cache:
+			next_cache.clear();
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3 * best + c];
+				if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) next_cache.emplace_back(v);
+			}
+			for (uint32_t v : cache) {
+				if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) next_cache.emplace_back(v);
+			}
+
+			//rescore everything that was or is in the cache (and their triangles), picking the next best triangle:
+			for (uint32_t i = 0; i < next_cache.size(); ++i) {
+				uint32_t v = next_cache[i];
+				cache_position[v] = (int32_t(i) < CacheSize ? int32_t(i) : -1);
+				score[v] = vertex_score(cache_position[v], remaining[v]);
+			}
+			best = -1U;
+			float best_score = -1.0f;
+			for (uint32_t v : next_cache) {
+				for (uint32_t j = first[v]; j < first[v] + remaining[v]; ++j) {
+					uint32_t t = triangles[j];
+					triangle_score[t] = score[indices[3*t+0]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+					if (triangle_score[t] > best_score) {
+						best_score = triangle_score[t];
+						best = t;
+					}
+				}
+			}
+
+			if (next_cache.size() > size_t(CacheSize)) next_cache.resize(CacheSize);
+			std::swap(cache, next_cache);
+		}
+		return out;
+	}
+};
+
+//Quadric error metric simplification (Garland and Heckbert, "Surface Simplification Using Quadric Error
+// Metrics"), restricted to collapsing vertices onto their neighbors -- so each level of detail is just
+// another list of triangles over the same vertices.
+//Vertices that share a position (attribute seams) collapse together, as one "group"; a group can only
+// collapse onto a neighbor if each of its vertices has an edge to one of the neighbor's vertices, so
+// seams only slide along themselves and attributes never get stretched across them.
+struct Simplifier {
+	//area-weighted squared distance to a set of planes: Q(p) = p'Ap + 2b'p + c
+	struct Quadric {
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+		double weight = 0.0;
+
+		//plane n.p + d = 0 (n unit length):
+		void add_plane(glm::vec3 const &n, float d, double w) {
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z;
+			a22 += w * n.z * n.z;
+			b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+			c += w * double(d) * d;
+			weight += w;
+		}
+		Quadric &operator+=(Quadric const &o) {
+			a00 += o.a00; a01 += o.a01; a02 += o.a02; a11 += o.a11; a12 += o.a12; a22 += o.a22;
+			b0 += o.b0; b1 += o.b1; b2 += o.b2;
+			c += o.c;
+			weight += o.weight;
+			return *this;
+		}
+		//mean squared distance:
+		double error(glm::vec3 const &p) const {
+			double x = p.x, y = p.y, z = p.z;
+			double q = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z
+			         + a11 * y * y + 2.0 * a12 * y * z
+			         + a22 * z * z
+			         + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			return weight > 0.0 ? std::max(0.0, q) / weight : 0.0;
+		}
+	};
+
+	//how much more open (border) edges resist moving than the surface does:
+	static constexpr double BorderWeight = 10.0;
+
+	std::vector< glm::vec3 > positions; //per vertex
+	std::vector< uint32_t > group; //per vertex
+	std::vector< std::vector< uint32_t > > group_vertices;
+	std::vector< std::vector< uint32_t > > group_triangles; //(may list dead triangles; pruned now and then)
+	std::vector< Quadric > quadrics; //per group
+	std::vector< uint32_t > versions; //per group -- bumped whenever its quadric changes
+	std::vector< bool > group_alive;
+	std::vector< uint32_t > collapsed_into; //per group: the group it was collapsed onto (itself if it's still alive)
+
+	std::vector< uint32_t > triangles; //3 vertices per triangle
+	std::vector< bool > alive; //per triangle
+	uint32_t live = 0;
+
+	struct Candidate {
+		double cost;
+		uint32_t from, to;
+		uint32_t from_version, to_version;
+		bool operator<(Candidate const &o) const { return cost > o.cost; } //(std::priority_queue is a max heap)
+	};
+	std::priority_queue< Candidate > candidates;
+
+	Simplifier(std::vector< Vertex > const &vertices, std::vector< uint32_t > const &indices) : triangles(indices) {
+		positions.reserve(vertices.size());
+		group.reserve(vertices.size());
+		std::unordered_map< std::string_view, uint32_t > lookup;
+		for (Vertex const &v : vertices) {
+			positions.emplace_back(v.Position);
+		}
+		for (uint32_t v = 0; v < positions.size(); ++v) {
+			std::string_view key(reinterpret_cast< char const * >(&positions[v]), sizeof(glm::vec3));
+			auto ret = lookup.emplace(key, uint32_t(group_vertices.size()));
+			if (ret.second) group_vertices.emplace_back();
+			group.emplace_back(ret.first->second);
+			group_vertices[ret.first->second].emplace_back(v);
+		}
+		uint32_t groups = uint32_t(group_vertices.size());
+		group_triangles.resize(groups);
+		quadrics.resize(groups);
+		versions.assign(groups, 0);
+		group_alive.assign(groups, true);
+		collapsed_into.resize(groups);
+		for (uint32_t g = 0; g < groups; ++g) collapsed_into[g] = g;
+
+		uint32_t count = uint32_t(triangles.size() / 3);
+		alive.assign(count, true);
+		live = count;
+		for (uint32_t t = 0; t < count; ++t) {
+			uint32_t g0 = group[triangles[3*t+0]], g1 = group[triangles[3*t+1]], g2 = group[triangles[3*t+2]];
+			if (g0 == g1 || g1 == g2 || g2 == g0) {
+				//(already degenerate -- not worth keeping in a simplified version)
+				alive[t] = false;
+				live -= 1;
+			}
+		}
+
+		//each triangle's plane goes into its corners' quadrics:
+		std::unordered_map< uint64_t, uint32_t > edge_uses; //(group pair -> triangles using that edge)
+		auto edge_key = [](uint32_t a, uint32_t b) {
+			return (uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b));
+		};
+		for (uint32_t t = 0; t < count; ++t) {
+			if (!alive[t]) continue;
+			uint32_t g[3];
+			for (uint32_t c = 0; c < 3; ++c) {
+				g[c] = group[triangles[3*t+c]];
+				group_triangles[g[c]].emplace_back(t);
+			}
+			glm::vec3 n;
+			double area = normal(t, &n);
+			if (area > 0.0) {
+				float d = -glm::dot(n, positions[triangles[3*t]]);
+				for (uint32_t c = 0; c < 3; ++c) quadrics[g[c]].add_plane(n, d, area);
+			}
+			for (uint32_t c = 0; c < 3; ++c) edge_uses[edge_key(g[c], g[(c+1)%3])] += 1;
+		}
+
+		//open edges get a plane through them, perpendicular to their triangle, to hold the border in place:
+		for (uint32_t t = 0; t < count; ++t) {
+			glm::vec3 n;
+			if (!alive[t] || normal(t, &n) == 0.0) continue;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t a = triangles[3*t+c], b = triangles[3*t+(c+1)%3];
+				if (edge_uses[edge_key(group[a], group[b])] != 1) continue;
+				glm::vec3 edge = positions[b] - positions[a];
+				glm::vec3 m = glm::cross(edge, n);
+				float len = glm::length(m);
+				if (!(len > 0.0f)) continue;
+				m /= len;
+				float d = -glm::dot(m, positions[a]);
+				double w = BorderWeight * glm::dot(edge, edge);
+				quadrics[group[a]].add_plane(m, d, w);
+				quadrics[group[b]].add_plane(m, d, w);
+			}
+		}
+
+		for (auto const &edge : edge_uses) {
+			uint32_t a = uint32_t(edge.first >> 32), b = uint32_t(edge.first & 0xffffffff);
+			if (a == b) continue;
+			push(a, b);
+			push(b, a);
+		}
+	}
+
+	//unit normal (in *n) and area of triangle t:
+	double normal(uint32_t t, glm::vec3 *n) const {
+		glm::vec3 const &a = positions[triangles[3*t+0]];
+		glm::vec3 const &b = positions[triangles[3*t+1]];
+		glm::vec3 const &c = positions[triangles[3*t+2]];
+		glm::vec3 cross = glm::cross(b - a, c - a);
+		float len = glm::length(cross);
+		if (!(len > 0.0f)) {
+			*n = glm::vec3(0.0f);
+			return 0.0;
+		}
+		*n = cross / len;
+		return 0.5 * len;
+	}
+
+	void push(uint32_t from, uint32_t to) {
+		Quadric q = quadrics[from];
+		q += quadrics[to];
+		glm::vec3 const &p = positions[group_vertices[to][0]];
+		candidates.push(Candidate{q.error(p), from, to, versions[from], versions[to]});
+	}
+
+	//collapse group 'from' onto group 'to', if that's allowed:
+	bool collapse(uint32_t from, uint32_t to) {
+		//each vertex of 'from' follows an edge to a vertex of 'to':
+		std::unordered_map< uint32_t, uint32_t > target;
+		bool adjacent = false;
+		for (uint32_t t : group_triangles[from]) {
+			if (!alive[t]) continue;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = triangles[3*t+c];
+				if (group[v] != from) continue;
+				for (uint32_t o = 1; o < 3; ++o) {
+					uint32_t w = triangles[3*t+(c+o)%3];
+					if (group[w] == to) {
+						target.emplace(v, w);
+						adjacent = true;
+					}
+				}
+			}
+		}
+		if (!adjacent) return false;
+		for (uint32_t t : group_triangles[from]) {
+			if (!alive[t]) continue;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = triangles[3*t+c];
+				if (group[v] == from && !target.count(v)) return false; //(would drag an attribute across a seam)
+			}
+		}
+
+		//remaining triangles mustn't flip over:
+		glm::vec3 const &to_position = positions[group_vertices[to][0]];
+		for (uint32_t t : group_triangles[from]) {
+			if (!alive[t]) continue;
+			glm::vec3 p[3];
+			bool degenerates = false;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = triangles[3*t+c];
+				if (group[v] == to) degenerates = true;
+				p[c] = (group[v] == from ? to_position : positions[v]);
+			}
+			if (degenerates) continue;
+			glm::vec3 before, after = glm::cross(p[1] - p[0], p[2] - p[0]);
+			normal(t, &before);
+			if (!(glm::dot(before, after) > 0.0f)) return false;
+		}
+
+		//collapse:
+		std::vector< uint32_t > &to_triangles = group_triangles[to];
+		for (uint32_t t : group_triangles[from]) {
+			if (!alive[t]) continue;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t &v = triangles[3*t+c];
+				if (group[v] == from) v = target[v];
+			}
+			uint32_t g0 = group[triangles[3*t+0]], g1 = group[triangles[3*t+1]], g2 = group[triangles[3*t+2]];
+			if (g0 == g1 || g1 == g2 || g2 == g0) {
+				alive[t] = false;
+				live -= 1;
+			} else {
+				to_triangles.emplace_back(t);
+			}
+		}
+		group_triangles[from].clear();
+		group_alive[from] = false;
+		collapsed_into[from] = to;
+		quadrics[to] += quadrics[from];
+		versions[to] += 1;
+
+		//tidy up 'to's triangle list, and re-cost the edges around it:
+		std::sort(to_triangles.begin(), to_triangles.end());
+		to_triangles.erase(std::unique(to_triangles.begin(), to_triangles.end()), to_triangles.end());
+		to_triangles.erase(std::remove_if(to_triangles.begin(), to_triangles.end(), [this](uint32_t t){ return !alive[t]; }), to_triangles.end());
+		std::vector< uint32_t > neighbors;
+		for (uint32_t t : to_triangles) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t g = group[triangles[3*t+c]];
+				if (g != to) neighbors.emplace_back(g);
+			}
+		}
+		std::sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+		for (uint32_t n : neighbors) {
+			push(to, n);
+			push(n, to);
+		}
+		return true;
+	}
+
+	//collapse the cheapest edges until at most 'target' triangles remain (or nothing more can go):
+	void simplify(uint32_t target) {
+		while (live > target && !candidates.empty()) {
+			Candidate candidate = candidates.top();
+			candidates.pop();
+			if (!group_alive[candidate.from] || !group_alive[candidate.to]) continue;
+			if (versions[candidate.from] != candidate.from_version || versions[candidate.to] != candidate.to_version) continue;
+			collapse(candidate.from, candidate.to);
+		}
+	}
+
+	//how far the original surface now strays from the simplified one: the largest distance from an original
+	// vertex position to the simplified surface near the vertex it was collapsed onto (its triangles and
+	// its neighbors' triangles -- on test meshes this matched a brute force search over all triangles)
+	// (quadric costs are mean squared distances, which understate the worst case by quite a bit)
+	float error() {
+		float worst = 0.0f;
+		for (uint32_t g = 0; g < group_vertices.size(); ++g) {
+			uint32_t r = g;
+			while (collapsed_into[r] != r) r = collapsed_into[r];
+			collapsed_into[g] = r; //(shortcut for the next time)
+			if (r == g) continue;
+			glm::vec3 const &p = positions[group_vertices[g][0]];
+			float closest = std::numeric_limits< float >::infinity();
+			auto check_fan = [&](uint32_t fan) {
+				for (uint32_t t : group_triangles[fan]) {
+					if (!alive[t]) continue;
+					closest = std::min(closest, point_triangle_distance(p, positions[triangles[3*t+0]], positions[triangles[3*t+1]], positions[triangles[3*t+2]]));
+				}
+			};
+			//(the triangles around r and around its neighbors)
+			for (uint32_t t : group_triangles[r]) {
+				if (!alive[t]) continue;
+				for (uint32_t c = 0; c < 3; ++c) check_fan(group[triangles[3*t+c]]);
+			}
+			if (closest != std::numeric_limits< float >::infinity()) worst = std::max(worst, closest);
+		}
+		return worst;
+	}
+
+	//(closest point on a triangle, as in Ericson's "Real-Time Collision Detection", section 5.1.5)
+	static float point_triangle_distance(glm::vec3 const &p, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) {
+		glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+		float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) return glm::length(p - a);
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) return glm::length(p - b);
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return glm::length(p - (a + (d1 / (d1 - d3)) * ab));
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) return glm::length(p - c);
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return glm::length(p - (a + (d2 / (d2 - d6)) * ac));
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) return glm::length(p - (b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b)));
+		float denom = 1.0f / (va + vb + vc);
+		return glm::length(p - (a + ab * (vb * denom) + ac * (vc * denom)));
+	}
+
+	//the triangles left:
+	std::vector< uint32_t > indices() const {
+		std::vector< uint32_t > out;
+		out.reserve(3 * live);
+		for (uint32_t t = 0; t < alive.size(); ++t) {
+			if (!alive[t]) continue;
+			out.insert(out.end(), triangles.begin() + 3*t, triangles.begin() + 3*t + 3);
+		}
+		return out;
+	}
+};
+
+//meshes smaller than this aren't worth simplifying:
+constexpr size_t MinLODTriangles = 64;
+
+//average number of vertex shader runs per triangle, for a FIFO post-transform cache of 'size' entries:
+float acmr(std::vector< uint32_t > const &indices, uint32_t size) {
+	if (indices.empty()) return 0.0f;
+	std::vector< uint32_t > fifo;
+	uint32_t misses = 0;
+	for (uint32_t i : indices) {
+		if (std::find(fifo.begin(), fifo.end(), i) != fifo.end()) continue;
+		misses += 1;
+		fifo.emplace_back(i);
+		if (fifo.size() > size) fifo.erase(fifo.begin());
+	}
+	return float(misses) / float(indices.size() / 3);
+}
+
+} //namespace
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+	uint32_t lod_levels = 3;
+	std::vector< std::string > args(argv + 1, argv + argc);
+	if (args.size() == 4 && args[0] == "--lods" && args[1].size() == 1 && args[1][0] >= '0' && args[1][0] <= '3') {
+		lod_levels = uint32_t(args[1][0] - '0');
+		args.erase(args.begin(), args.begin() + 2);
+	}
+	if (args.size() != 2) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--lods <0-3>] <in.pnct> <out.pnci>" << std::endl;
+		return 1;
+	}
+	std::string in_filename = args[0];
+	std::string out_filename = args[1];
+
+	MappedFile file(in_filename);
+	ChunkReader chunks(file.data(), file.size(), in_filename);
+	ChunkSpan< Vertex > vertices = chunks.read< Vertex >("pnct");
+	ChunkSpan< char > strings = chunks.read< char >("str0");
+	ChunkSpan< IndexEntry > index = chunks.read< IndexEntry >("idx0");
+	if (chunks.next_is("bnd0")) {
+		chunks.read< BoundsEntry >("bnd0"); //(recomputed below)
+	}
+	if (chunks.remaining() != 0) {
+		std::cerr << "WARNING: trailing data in mesh file '" << in_filename << "'" << std::endl;
+	}
+
+	std::vector< Vertex > out_vertices;
+	std::vector< uint32_t > out_indices;
+	std::vector< IndexedEntry > out_index;
+	out_index.reserve(index.size());
+	std::vector< LODEntry > out_lods;
+	std::vector< BoundsEntry > out_bounds;
+	out_bounds.reserve(index.size());
+	std::vector< size_t > level_triangles(1 + lod_levels, 0); //(summed over meshes, for the report)
+
+	float acmr_before = 0.0f, acmr_after = 0.0f; //(weighted by triangle count)
+	for (auto const &entry : index) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= vertices.size())) {
+			throw std::runtime_error("index entry has out-of-range vertex start/count");
+		}
+		std::string_view name(strings.data() + entry.name_begin, entry.name_end - entry.name_begin);
+		uint32_t count = entry.vertex_end - entry.vertex_begin;
+		if (count % 3 != 0) {
+			throw std::runtime_error("mesh '" + std::string(name) + "' isn't made of triangles.");
+		}
+
+		//bounds (the same for the welded vertices), checking positions are finite:
+		BoundsEntry bounds;
+		bounds.min = glm::vec3( std::numeric_limits< float >::infinity());
+		bounds.max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+			glm::vec3 const &p = vertices[v].Position;
+			if (!(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z))) {
+				throw std::runtime_error("mesh '" + std::string(name) + "' has a vertex position that isn't a finite number.");
+			}
+			bounds.min = glm::min(bounds.min, p);
+			bounds.max = glm::max(bounds.max, p);
+		}
+		out_bounds.emplace_back(bounds);
+
+		//weld identical vertices (exact bitwise matches -- anything else could change how the mesh looks):
+		std::vector< Vertex > welded;
+		std::vector< uint32_t > indices;
+		indices.reserve(count);
+		std::unordered_map< std::string_view, uint32_t > lookup;
+		lookup.reserve(count);
+		for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+			std::string_view key(reinterpret_cast< char const * >(&vertices[v]), sizeof(Vertex));
+			auto ret = lookup.emplace(key, uint32_t(welded.size()));
+			if (ret.second) welded.emplace_back(vertices[v]);
+			indices.emplace_back(ret.first->second);
+		}
+
+		//simplified levels of detail -- each about half the triangles of the last, stopping once that stops working:
+		// (made before any reordering; they use the same vertices, so get the same remapping below)
+		std::vector< std::pair< std::vector< uint32_t >, float > > lods;
+		if (lod_levels > 0 && indices.size() / 3 >= MinLODTriangles) {
+			Simplifier simplifier(welded, indices);
+			size_t previous = indices.size() / 3;
+			for (uint32_t level = 0; level < lod_levels; ++level) {
+				simplifier.simplify(uint32_t(previous / 2));
+				if (simplifier.live == 0 || simplifier.live > previous * 3 / 4) break;
+				previous = simplifier.live;
+				lods.emplace_back(ForsythOrder::optimize(simplifier.indices(), uint32_t(welded.size())), simplifier.error());
+			}
+		}
+
+		//order triangles for the vertex cache:
+		indices = ForsythOrder::optimize(indices, uint32_t(welded.size()));
+
+		//order vertices by first use:
+		std::vector< uint32_t > remap(welded.size(), -1U);
+		uint32_t used = 0;
+		IndexedEntry out_entry;
+		out_entry.name_begin = entry.name_begin;
+		out_entry.name_end = entry.name_end;
+		out_entry.vertex_begin = uint32_t(out_vertices.size());
+		out_entry.index_begin = uint32_t(out_indices.size());
+		for (uint32_t &i : indices) {
+			if (remap[i] == -1U) {
+				remap[i] = used++;
+				out_vertices.emplace_back(welded[i]);
+			}
+			i = remap[i];
+		}
+		out_indices.insert(out_indices.end(), indices.begin(), indices.end());
+		out_entry.vertex_end = uint32_t(out_vertices.size());
+		out_entry.index_end = uint32_t(out_indices.size());
+		level_triangles[0] += indices.size() / 3;
+
+		//levels of detail follow the full mesh's indices:
+		for (uint32_t l = 0; l < lods.size(); ++l) {
+			LODEntry lod;
+			lod.mesh = uint32_t(out_index.size());
+			lod.index_begin = uint32_t(out_indices.size());
+			for (uint32_t i : lods[l].first) out_indices.emplace_back(remap[i]);
+			lod.index_end = uint32_t(out_indices.size());
+			lod.error = lods[l].second;
+			out_lods.emplace_back(lod);
+			level_triangles[l + 1] += lods[l].first.size() / 3;
+		}
+		out_index.emplace_back(out_entry);
+
+		acmr_before += 3.0f * (count / 3); //(non-indexed: every vertex gets shaded)
+		acmr_after += acmr(indices, 32) * (count / 3);
+	}
+
+	std::ofstream out(out_filename, std::ios::binary);
+	write_chunk("pnct", out_vertices, &out);
+	write_chunk("ind0", out_indices, &out);
+	write_chunk("str0", std::vector< char >(strings.begin(), strings.end()), &out);
+	write_chunk("idx1", out_index, &out);
+	if (!out_lods.empty()) write_chunk("lod0", out_lods, &out);
+	write_chunk("bnd0", out_bounds, &out);
+	if (!out) {
+		throw std::runtime_error("Failed to write '" + out_filename + "'.");
+	}
+
+	size_t triangles = level_triangles[0];
+	size_t bytes_before = vertices.size() * sizeof(Vertex);
+	size_t bytes_after = out_vertices.size() * sizeof(Vertex) + out_indices.size() * sizeof(uint32_t);
+	std::cout << "Wrote " << out_index.size() << " meshes to '" << out_filename << "':\n"
+		<< "  vertices: " << vertices.size() << " -> " << out_vertices.size() << "\n"
+		<< "  vertex + index bytes: " << bytes_before << " -> " << bytes_after << " (indices stored 32-bit; MeshBuffer narrows them to 16-bit where it can)\n"
+		<< "  vertex shader runs per triangle (32-entry FIFO cache): "
+		<< (triangles ? acmr_before / triangles : 0.0f) << " -> " << (triangles ? acmr_after / triangles : 0.0f) << "\n"
+		<< "  triangles at each level of detail:";
+	for (size_t count : level_triangles) std::cout << " " << count;
+	std::cout << " (" << out_lods.size() << " simplified meshes)" << std::endl;
+
+	return 0;
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
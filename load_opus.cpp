@@ -1,4 +1,5 @@
 #include "load_opus.hpp"
+#include "MappedFile.hpp"
 
 #include <opusfile.h>
 
@@ -15,10 +16,13 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 
 	std::cout << "loading '" << filename << "'..."; std::cout.flush();
 
+	//(decoded straight from the mapping -- which may be in a mounted AssetPack -- so it must outlive 'op')
+	MappedFile file(filename);
+
 	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
 	int err = 0;
 	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
-		op_open_file(filename.c_str(), &err), //pointer to hold
+		op_open_memory(reinterpret_cast< unsigned char const * >(file.data()), file.size(), &err), //pointer to hold
 		op_free //deletion function
 	);
 	if (err != 0) {
@@ -1,10 +1,12 @@
 #include "load_save_png.hpp"
+#include "MappedFile.hpp"
 
 #include <png.h>
 
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <streambuf>
 #include <vector>
 
 #define LOG_ERROR( X ) std::cerr << X << std::endl
@@ -17,10 +19,20 @@ void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
 	assert(size);
 
-	std::ifstream file(filename.c_str(), std::ios::binary);
-	if (!file) {
+	//(read through MappedFile, so images in mounted AssetPacks are found)
+	std::unique_ptr< MappedFile > mapped;
+	try {
+		mapped.reset(new MappedFile(filename));
+	} catch (std::runtime_error &) {
 		throw std::runtime_error("Failed to open PNG image file '" + filename + "'.");
 	}
+	struct MappedBuf : std::streambuf {
+		MappedBuf(MappedFile const &mapped) {
+			char *begin = const_cast< char * >(mapped.data()); //(only ever read)
+			setg(begin, begin, begin + mapped.size());
+		}
+	} buf(*mapped);
+	std::istream file(&buf);
 	if (!load_png(file, &size->x, &size->y, data, origin)) {
 		throw std::runtime_error("Failed to read PNG image from '" + filename + "'.");
 	}
@@ -1,4 +1,5 @@
 #include "load_wav.hpp"
+#include "MappedFile.hpp"
 
 #include <SDL.h>
 
@@ -16,7 +17,9 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	Uint8 *audio_buf = nullptr;
 	Uint32 audio_len = 0;
 
-	SDL_AudioSpec *have = SDL_LoadWAV(filename.c_str(), &audio_spec, &audio_buf, &audio_len);
+	//(read through MappedFile, so sounds in mounted AssetPacks are found)
+	MappedFile file(filename);
+	SDL_AudioSpec *have = SDL_LoadWAV_RW(SDL_RWFromConstMem(file.data(), int(file.size())), 1, &audio_spec, &audio_buf, &audio_len);
 	if (!have) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
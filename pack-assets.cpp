@@ -0,0 +1,227 @@
+//pack-assets bundles data files into one AssetPack (see AssetPack.hpp):
+//  - each file's data starts at a multiple of AssetPack::Alignment, so it can be used straight from the mapping
+//  - files that LZ4 shrinks by at least an eighth are stored compressed (unless --store is given);
+//    the rest -- e.g., already-compressed .png and .opus files -- are stored as-is
+//  - files with identical contents are only stored once
+//
+//Usage (from the directory the pack will be in, since names are stored as given):
+//	../scenes/pack-assets [--store] <out.pack> <file> [<file> ...]
+
+#include "AssetPack.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+//LZ4 block format (greedy matching on 4-byte hashes; see AssetPack::decompress_lz4):
+std::vector< char > compress_lz4(char const *data, size_t size) {
+	constexpr size_t MinMatch = 4;
+	constexpr size_t LastLiterals = 5; //the last 5 bytes are always literals...
+	constexpr size_t MatchLimit = 12; //...and the last match starts at least 12 bytes before the end
+	constexpr size_t MaxOffset = 0xffff;
+
+	std::vector< char > out;
+	out.reserve(size + size / 255 + 16);
+
+	auto read32 = [data](size_t at) { uint32_t x; std::memcpy(&x, data + at, 4); return x; };
+	auto length = [&out](size_t len) { //(the part of a length that didn't fit in the token)
+		for (; len >= 255; len -= 255) out.push_back(char(255));
+		out.push_back(char(len));
+	};
+	auto sequence = [&](size_t literal_begin, size_t literal_end, size_t offset, size_t match) {
+		size_t literals = literal_end - literal_begin;
+		uint8_t token = uint8_t(std::min< size_t >(literals, 15) << 4);
+		if (match) token |= uint8_t(std::min< size_t >(match - MinMatch, 15));
+		out.push_back(char(token));
+		if (literals >= 15) length(literals - 15);
+		out.insert(out.end(), data + literal_begin, data + literal_end);
+		if (match) {
+			out.push_back(char(offset & 0xff));
+			out.push_back(char(offset >> 8));
+			if (match - MinMatch >= 15) length(match - MinMatch - 15);
+		}
+	};
+
+	std::vector< uint32_t > table(1 << 16, uint32_t(-1)); //last position of each hashed 4 bytes
+	auto hash = [](uint32_t x) { return (x * 2654435761U) >> 16; };
+
+	size_t anchor = 0; //start of pending literals
+	if (size > MatchLimit) {
+		for (size_t at = 0; at + MatchLimit < size; ) {
+			uint32_t here = read32(at);
+			uint32_t &slot = table[hash(here)];
+			size_t candidate = slot;
+			slot = uint32_t(at);
+			if (candidate != uint32_t(-1) && at - candidate <= MaxOffset && read32(candidate) == here) {
+				size_t match = MinMatch;
+				while (at + match < size - LastLiterals && data[candidate + match] == data[at + match]) ++match;
+				sequence(anchor, at, at - candidate, match);
+				at += match;
+				anchor = at;
+			} else {
+				at += 1 + ((at - anchor) >> 6); //(skip faster through incompressible data)
+			}
+		}
+	}
+	sequence(anchor, size, 0, 0);
+
+	return out;
+}
+
+} //namespace
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+	bool compress = true;
+	std::vector< std::string > args(argv + 1, argv + argc);
+	if (!args.empty() && args[0] == "--store") {
+		compress = false;
+		args.erase(args.begin());
+	}
+	if (args.size() < 2) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--store] <out.pack> <file> [<file> ...]" << std::endl;
+		return 1;
+	}
+	std::string out_filename = args[0];
+	std::vector< std::string > filenames(args.begin() + 1, args.end());
+
+	std::vector< AssetPack::Entry > entries;
+	std::vector< char > names;
+	std::vector< std::vector< char > > blobs; //data to write, in order
+	std::map< std::pair< uint64_t, uint64_t >, size_t > by_contents; //content hash + size -> entry whose data it is
+	std::vector< size_t > same_as; //per entry: earlier entry with the same contents (or -1)
+
+	size_t total_in = 0, total_out = 0;
+	for (auto const &filename : filenames) {
+		MappedFile file(filename, false);
+		AssetPack::Entry entry;
+		std::memset(&entry, 0, sizeof(entry));
+		entry.name_hash = AssetPack::hash_name(filename);
+		entry.name_begin = uint32_t(names.size());
+		names.insert(names.end(), filename.begin(), filename.end());
+		entry.name_end = uint32_t(names.size());
+		entry.content_size = file.size();
+		entry.content_hash = AssetPack::hash_content(file.data(), file.size());
+
+		std::cout << "  " << filename << ": " << file.size() << " bytes";
+		total_in += file.size();
+
+		auto f = by_contents.find(std::make_pair(entry.content_hash, entry.content_size));
+		if (f != by_contents.end()) {
+			//(hashes match; make sure the contents do too)
+			AssetPack::Entry same = entries[f->second];
+			std::vector< char > check = blobs[f->second];
+			if (same.compression == AssetPack::LZ4) {
+				check.assign(same.content_size, '\0');
+				AssetPack::decompress_lz4(blobs[f->second].data(), blobs[f->second].size(), check.data(), check.size());
+			}
+			if (std::equal(check.begin(), check.end(), file.data())) {
+				entry.compression = same.compression;
+				entry.size = same.size;
+				same_as.emplace_back(f->second);
+				entries.emplace_back(entry);
+				blobs.emplace_back(); //(nothing more to write)
+				std::cout << ", same as " << std::string(names.data() + same.name_begin, names.data() + same.name_end) << std::endl;
+				continue;
+			}
+		}
+		by_contents.emplace(std::make_pair(entry.content_hash, entry.content_size), entries.size());
+
+		std::vector< char > blob;
+		entry.compression = AssetPack::Stored;
+		if (compress) {
+			std::vector< char > compressed = compress_lz4(file.data(), file.size());
+			if (compressed.size() <= file.size() - file.size() / 8) {
+				//(check the round trip -- a pack that fails to load is worse than a larger one)
+				std::vector< char > check(file.size());
+				if (!AssetPack::decompress_lz4(compressed.data(), compressed.size(), check.data(), check.size())
+				 || !std::equal(check.begin(), check.end(), file.data())) {
+					throw std::runtime_error("LZ4 round trip failed for '" + filename + "'.");
+				}
+				entry.compression = AssetPack::LZ4;
+				blob = std::move(compressed);
+			}
+		}
+		if (entry.compression == AssetPack::Stored) {
+			blob.assign(file.data(), file.data() + file.size());
+		}
+		entry.size = blob.size();
+		same_as.emplace_back(size_t(-1));
+		entries.emplace_back(entry);
+		blobs.emplace_back(std::move(blob));
+
+		if (entry.compression == AssetPack::LZ4) std::cout << ", compressed to " << entry.size << std::endl;
+		else std::cout << ", stored as-is" << std::endl;
+		total_out += entry.size;
+	}
+
+	//hash table, at most half full:
+	std::vector< uint32_t > slots(1);
+	while (slots.size() < 2 * entries.size()) slots.resize(slots.size() * 2);
+	for (uint32_t i = 0; i < entries.size(); ++i) {
+		std::string_view name(names.data() + entries[i].name_begin, entries[i].name_end - entries[i].name_begin);
+		size_t slot = size_t(entries[i].name_hash % slots.size());
+		while (true) {
+			if (slots[slot] == 0) {
+				slots[slot] = i + 1;
+				break;
+			}
+			AssetPack::Entry const &other = entries[slots[slot] - 1];
+			if (std::string_view(names.data() + other.name_begin, other.name_end - other.name_begin) == name) {
+				throw std::runtime_error("File '" + std::string(name) + "' is listed twice.");
+			}
+			slot = (slot + 1) % slots.size();
+		}
+	}
+
+	//lay out the data after the index chunks:
+	auto align = [](uint64_t at) { return (at + AssetPack::Alignment - 1) / AssetPack::Alignment * AssetPack::Alignment; };
+	uint64_t at = align(8 + entries.size() * sizeof(AssetPack::Entry) + 8 + slots.size() * sizeof(uint32_t) + 8 + names.size());
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (same_as[i] != size_t(-1)) {
+			entries[i].offset = entries[same_as[i]].offset;
+		} else {
+			entries[i].offset = at;
+			at = align(at + blobs[i].size());
+		}
+	}
+
+	std::ofstream out(out_filename, std::ios::binary);
+	write_chunk("pke0", entries, &out);
+	write_chunk("pkh0", slots, &out);
+	write_chunk("str0", names, &out);
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (same_as[i] != size_t(-1)) continue;
+		std::vector< char > padding(size_t(entries[i].offset - uint64_t(out.tellp())), '\0');
+		out.write(padding.data(), padding.size());
+		out.write(blobs[i].data(), blobs[i].size());
+	}
+	if (!out) {
+		throw std::runtime_error("Failed to write '" + out_filename + "'.");
+	}
+	out.close();
+
+	std::cout << "Packed " << entries.size() << " files (" << total_in << " bytes) into '" << out_filename << "' (" << total_out << " bytes of data, "
+		<< std::fixed << std::setprecision(1) << (total_in ? 100.0 * double(total_out) / double(total_in) : 100.0) << "%)." << std::endl;
+
+	return 0;
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -4,6 +4,12 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -41,6 +47,89 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 }
 
 
+//typed, read-only view of the elements of a chunk (see ChunkReader):
+template< typename T >
+struct ChunkSpan {
+	T const *elements = nullptr;
+	size_t count = 0;
+
+	T const *data() const { return elements; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T const &operator[](size_t i) const { assert(i < count); return elements[i]; }
+	T const *begin() const { return elements; }
+	T const *end() const { return elements + count; }
+};
+
+//reads chunks (same format as read_chunk) straight out of memory -- e.g., a MappedFile -- without copying them:
+// ChunkReader chunks(file.data(), file.size(), filename);
+// ChunkSpan< Vertex > vertices = chunks.read< Vertex >("pnct");
+//Spans point into the memory passed to the constructor, so they are only valid as long as it is.
+//(a chunk that isn't suitably aligned for T is copied into storage owned by the reader instead)
+struct ChunkReader {
+	ChunkReader(char const *data, size_t size, std::string const &name_ = "") : at(data), end(data + size), name(name_) { }
+
+	template< typename T >
+	ChunkSpan< T > read(std::string const &magic);
+
+	//bytes left after the last chunk read:
+	size_t remaining() const { return size_t(end - at); }
+
+	//does the next chunk have this magic number? (for optional chunks)
+	bool next_is(std::string const &magic) const {
+		return magic.size() == 4 && remaining() >= 8 && std::memcmp(at, magic.data(), 4) == 0;
+	}
+
+	char const *at;
+	char const *end;
+	std::string name; //for error messages
+	std::vector< std::unique_ptr< char[] > > copies; //misaligned chunks
+};
+
+template< typename T >
+ChunkSpan< T > ChunkReader::read(std::string const &magic) {
+	static_assert(std::is_trivially_copyable< T >::value, "chunks hold plain data");
+	static_assert(alignof(T) <= alignof(std::max_align_t), "chunk copies are only aligned to max_align_t");
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	auto where = [this]() { return name.empty() ? std::string() : " in '" + name + "'"; };
+
+	ChunkHeader header;
+	if (remaining() < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header" + where());
+	}
+	std::memcpy(&header, at, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk" + where());
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size" + where());
+	}
+	if (remaining() - sizeof(header) < header.size) {
+		throw std::runtime_error("Failed to read chunk data" + where() + ".");
+	}
+
+	char const *data = at + sizeof(header);
+	at = data + header.size;
+
+	ChunkSpan< T > span;
+	span.count = header.size / sizeof(T);
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) != 0) {
+		copies.emplace_back(new char[header.size]);
+		std::memcpy(copies.back().get(), data, header.size);
+		data = copies.back().get();
+	}
+	span.elements = reinterpret_cast< T const * >(data);
+	return span;
+}
+
+
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
 void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
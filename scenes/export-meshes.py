@@ -97,6 +97,9 @@ strings = b''
 #index gives offsets into the data (and names) for each mesh:
 index = b''
 
+#bounds gives the min and max of each mesh's vertex positions, in index order (so loading needn't compute them):
+bounds = b''
+
 vertex_count = 0
 for obj in bpy.data.objects:
 	if obj.data in to_write:
@@ -160,6 +163,8 @@ for obj in bpy.data.objects:
 			print("WARNING: object '" + name + "' has multiple texture coordinate layers; only exporting '" + obj.data.uv_layers.active.name + "'")
 
 	local_data = b''
+	lo = [float('inf')] * 3
+	hi = [float('-inf')] * 3
 
 	#write the mesh triangles:
 	for poly in mesh.polygons:
@@ -170,6 +175,8 @@ for obj in bpy.data.objects:
 			vertex = mesh.vertices[loop.vertex_index]
 			for x in vertex.co:
 				local_data += struct.pack('f', x)
+			lo = [min(a, b) for a, b in zip(lo, vertex.co)]
+			hi = [max(a, b) for a, b in zip(hi, vertex.co)]
 			for x in loop.normal:
 				local_data += struct.pack('f', x)
 			if colors != None:
@@ -190,6 +197,7 @@ for obj in bpy.data.objects:
 	data.append(local_data)
 
 	index += struct.pack('I', vertex_count) #vertex_end
+	bounds += struct.pack('ffffff', *lo, *hi)
 
 data = b''.join(data)
 
@@ -210,7 +218,11 @@ blob.write(strings)
 blob.write(struct.pack('4s',b'idx0')) #type
 blob.write(struct.pack('I', len(index))) #length
 blob.write(index)
+#fourth chunk: the bounds
+blob.write(struct.pack('4s',b'bnd0')) #type
+blob.write(struct.pack('I', len(bounds))) #length
+blob.write(bounds)
 wrote = blob.tell()
 blob.close()
 
-print("Wrote " + str(wrote) + " bytes [== " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index] to '" + outfile + "'")
+print("Wrote " + str(wrote) + " bytes [== " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index + " + str(len(bounds)+8) + " bytes of bounds] to '" + outfile + "'")
@@ -0,0 +1,374 @@
+//server-tests checks (and times) the message encoding code the server and client share -- Serialization.hpp's
+// bulk float conversion kernels and Messages.hpp's schemas -- without any networking:
+//
+//Usage:
+//	./server-tests              (runs the checks; exits non-zero if any fail)
+//	./server-tests --benchmark  (times encoding and decoding)
+
+#include "Messages.hpp"
+#include "benchmark.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//------------ bulk float conversion (Serialization.hpp) ------------
+
+//check every bulk float conversion kernel this CPU can run (see Serialization.hpp) against
+// serialize_float / deserialize_float, over random lengths and buffer alignments:
+// returns the number of failed cases
+static uint32_t serialization_selftest() {
+	std::vector< serialization_detail::Swap32Kernel > kernels = serialization_detail::swap32_kernels();
+	//the public functions (which pick a kernel by length) get checked the same way:
+	kernels.push_back(serialization_detail::Swap32Kernel{"serialize_floats", [](char const *in, size_t count, char *out) {
+		std::vector< float > floats(count);
+		if (count) std::memcpy(floats.data(), in, count * 4);
+		serialize_floats(floats.data(), count, out);
+	}});
+	kernels.push_back(serialization_detail::Swap32Kernel{"deserialize_floats", [](char const *in, size_t count, char *out) {
+		std::vector< float > floats(count);
+		deserialize_floats(in, count, floats.data());
+		if (count) std::memcpy(out, floats.data(), count * 4);
+	}});
+
+	constexpr uint32_t Cases = 4000;
+	constexpr size_t Pad = 32; //(guard bytes on each side of the output, and room to misalign both buffers)
+	std::mt19937 mt(0x5e71a1);
+	std::vector< char > in, expected, out;
+	std::vector< uint32_t > failures(kernels.size(), 0);
+	uint32_t round_trip_failures = 0;
+	for (uint32_t c = 0; c < Cases; ++c) {
+		//mostly short arrays (around the vector widths), some long ones:
+		size_t count = (c % 8 == 7 ? mt() % 5000 : mt() % 70);
+		size_t in_offset = mt() % Pad, out_offset = mt() % Pad;
+
+		//random bit patterns (so NaNs, infinities, and denormals show up) at a random alignment:
+		in.assign(count * 4 + 2 * Pad, 0);
+		for (size_t i = 0; i < count * 4; ++i) in[in_offset + i] = char(mt());
+
+		//what one-at-a-time conversion gives:
+		expected.assign(count * 4, 0);
+		for (size_t i = 0; i < count; ++i) {
+			float f;
+			std::memcpy(&f, &in[in_offset + 4 * i], 4);
+			serialize_float(f, &expected[4 * i]);
+			//(...and converting back gives the same bits)
+			float back = deserialize_float(&expected[4 * i]);
+			if (std::memcmp(&back, &f, 4) != 0) round_trip_failures += 1;
+		}
+
+		for (size_t k = 0; k < kernels.size(); ++k) {
+			bool reverse = (std::string(kernels[k].name) == "deserialize_floats");
+			out.assign(count * 4 + 2 * Pad, char(0xa5));
+			kernels[k].fn(in.data() + in_offset, count, out.data() + out_offset);
+			bool ok = true;
+			for (size_t i = 0; i < count; ++i) {
+				//(deserializing swaps the same way, so compare it with the expected bytes as floats)
+				char const *want = &expected[4 * i];
+				float value;
+				if (reverse) {
+					value = deserialize_float(&in[in_offset + 4 * i]);
+					want = reinterpret_cast< char const * >(&value);
+				}
+				if (std::memcmp(&out[out_offset + 4 * i], want, 4) != 0) ok = false;
+			}
+			for (size_t i = 0; i < out.size(); ++i) {
+				if ((i < out_offset || i >= out_offset + count * 4) && out[i] != char(0xa5)) ok = false;
+			}
+			if (!ok) {
+				if (failures[k] == 0) {
+					std::cout << "  FAILED: " << kernels[k].name << " with " << count << " floats (input offset " << in_offset << ", output offset " << out_offset << ")" << std::endl;
+				}
+				failures[k] += 1;
+			}
+		}
+	}
+
+	uint32_t failed = round_trip_failures;
+	std::cout << (round_trip_failures ? "  FAILED: " : "  ok: ") << "deserialize_float(serialize_float(x)) has the bits of x" << std::endl;
+	for (size_t k = 0; k < kernels.size(); ++k) {
+		std::cout << (failures[k] ? "  FAILED: " : "  ok: ") << kernels[k].name << " matches one-at-a-time conversion on " << Cases << " random cases";
+		if (failures[k]) std::cout << " (" << failures[k] << " failed)";
+		std::cout << std::endl;
+		failed += failures[k];
+	}
+	return failed;
+}
+
+//throughput of each bulk float conversion kernel, and of one-at-a-time serialize_float:
+static void serialization_benchmark() {
+	std::vector< serialization_detail::Swap32Kernel > kernels = serialization_detail::swap32_kernels();
+	kernels.insert(kernels.begin(), serialization_detail::Swap32Kernel{"serialize_float loop", [](char const *in, size_t count, char *out) {
+		for (size_t i = 0; i < count; ++i) {
+			float f;
+			std::memcpy(&f, in + 4 * i, 4);
+			serialize_float(f, out + 4 * i);
+		}
+	}});
+
+	std::mt19937 mt(0xbe4c);
+	//a few players' coordinates, a big match's worth, and something that doesn't fit in cache:
+	for (size_t count : { size_t(64), size_t(4096), size_t(1) << 22 }) {
+		std::vector< float > in(count);
+		for (auto &f : in) f = std::uniform_real_distribution< float >(0.0f, 100.0f)(mt);
+		std::vector< char > out(count * 4);
+		//repeat enough to convert about 256MB per timing:
+		size_t reps = std::max< size_t >(1, (size_t(256) << 20) / (count * 4));
+		std::cout << "  " << count << " floats:";
+		for (auto const &kernel : kernels) {
+			float ms = Benchmark::median_ms(5, [&]() {
+				for (size_t r = 0; r < reps; ++r) {
+					kernel.fn(reinterpret_cast< char const * >(in.data()), count, out.data());
+					Benchmark::keep(uint32_t(uint8_t(out[r % out.size()])));
+				}
+			});
+			std::cout << " " << kernel.name << " " << (double(reps) * count * 4) / (ms * 1e-3) / 1e9 << " GB/s;";
+		}
+		std::cout << std::endl;
+	}
+}
+
+//------------ snapshot encoding: schema vs. hand-unrolled ------------
+
+//SnapshotBody written out by hand, byte for byte as its Schema (Messages.hpp) lays it out,
+// to check the generated code against and to time it against:
+namespace hand_unrolled {
+	constexpr float HealthScale = 65535.0f / (1.0f - 0.0f);
+	constexpr float CourtScale = 65535.0f / (CourtRange::max - CourtRange::min);
+
+	static char *put_varint(char *out, uint32_t v) {
+		while (v >= 0x80) {
+			*(out++) = char(uint8_t(v) | 0x80);
+			v >>= 7;
+		}
+		*(out++) = char(uint8_t(v));
+		return out;
+	}
+	static char *put_q16(char *out, float v, float min, float scale) {
+		float t = (v - min) * scale + 0.5f;
+		uint16_t q = uint16_t(std::min(std::max(t, 0.0f), 65535.0f));
+		out[0] = char(q >> 8);
+		out[1] = char(q);
+		return out + 2;
+	}
+
+	static size_t encoded_size(SnapshotBody const &body) {
+		size_t varints = 2;
+		for (uint32_t v : { body.tick, uint32_t(body.players.size()) }) {
+			while (v >= 0x80) { v >>= 7; varints += 1; }
+		}
+		return varints + 2 + 2 + 4 + body.players.size() * 5;
+	}
+
+	//(caller guarantees encoded_size(body) bytes of space)
+	static char *encode(SnapshotBody const &body, char *out) {
+		out = put_varint(out, body.tick);
+		out = put_q16(out, body.red_zone_health, 0.0f, HealthScale);
+		out = put_q16(out, body.blue_zone_health, 0.0f, HealthScale);
+		out = put_q16(out, body.ball_position.x, CourtRange::min, CourtScale);
+		out = put_q16(out, body.ball_position.y, CourtRange::min, CourtScale);
+		out = put_varint(out, uint32_t(body.players.size()));
+		for (auto const &player : body.players) {
+			out = put_q16(out, player.position.x, CourtRange::min, CourtScale);
+			out = put_q16(out, player.position.y, CourtRange::min, CourtScale);
+			*(out++) = char((player.team ? 1 : 0) | (player.stunned ? 2 : 0));
+		}
+		return out;
+	}
+
+	static char const *get_varint(char const *in, char const *end, uint32_t *v) {
+		uint32_t ret = 0;
+		for (uint32_t shift = 0; in < end && shift < 32; shift += 7) {
+			uint8_t b = uint8_t(*(in++));
+			ret |= uint32_t(b & 0x7f) << shift;
+			if (!(b & 0x80)) {
+				*v = ret;
+				return in;
+			}
+		}
+		return nullptr;
+	}
+	static float get_q16(char const *in, float min, float max) {
+		uint16_t q = uint16_t((uint16_t(uint8_t(in[0])) << 8) | uint16_t(uint8_t(in[1])));
+		return min + float(q) * ((max - min) / 65535.0f);
+	}
+
+	//returns the end of the body, or nullptr if [in,end) is too short (or malformed):
+	static char const *decode(char const *in, char const *end, SnapshotBody *body) {
+		in = get_varint(in, end, &body->tick);
+		if (!in || end - in < 8) return nullptr;
+		body->red_zone_health = get_q16(in, 0.0f, 1.0f);
+		body->blue_zone_health = get_q16(in + 2, 0.0f, 1.0f);
+		body->ball_position.x = get_q16(in + 4, CourtRange::min, CourtRange::max);
+		body->ball_position.y = get_q16(in + 6, CourtRange::min, CourtRange::max);
+		uint32_t count = 0;
+		in = get_varint(in + 8, end, &count);
+		if (!in || count > 0xffff || size_t(end - in) < size_t(count) * 5) return nullptr;
+		body->players.resize(count);
+		for (auto &player : body->players) {
+			player.position.x = get_q16(in, CourtRange::min, CourtRange::max);
+			player.position.y = get_q16(in + 2, CourtRange::min, CourtRange::max);
+			player.team = uint8_t(in[4]) & 1;
+			player.stunned = (uint8_t(in[4]) >> 1) & 1;
+			in += 5;
+		}
+		return in;
+	}
+}
+
+static SnapshotBody random_snapshot(std::mt19937 &mt, uint32_t players) {
+	SnapshotBody body;
+	//(ticks of every varint length; values a little outside their ranges, to check clamping)
+	body.tick = uint32_t(mt()) >> (mt() % 32);
+	body.red_zone_health = std::uniform_real_distribution< float >(-0.1f, 1.1f)(mt);
+	body.blue_zone_health = std::uniform_real_distribution< float >(-0.1f, 1.1f)(mt);
+	std::uniform_real_distribution< float > coord(-0.1f, CourtRange::max + 0.1f);
+	body.ball_position = glm::vec2(coord(mt), coord(mt));
+	body.players.resize(players);
+	for (auto &player : body.players) {
+		player.position = glm::vec2(coord(mt), coord(mt));
+		player.team = uint8_t(mt() % 2);
+		player.stunned = uint8_t(mt() % 2);
+	}
+	return body;
+}
+
+static bool same_snapshot(SnapshotBody const &a, SnapshotBody const &b) {
+	if (a.tick != b.tick || a.red_zone_health != b.red_zone_health || a.blue_zone_health != b.blue_zone_health
+	 || a.ball_position != b.ball_position || a.players.size() != b.players.size()) return false;
+	for (size_t i = 0; i < a.players.size(); ++i) {
+		if (a.players[i].position != b.players[i].position || a.players[i].team != b.players[i].team
+		 || a.players[i].stunned != b.players[i].stunned) return false;
+	}
+	return true;
+}
+
+//the schema's SnapshotBody encoding should be byte-for-byte the hand-unrolled one, and decode the same way:
+// returns the number of failed checks
+static uint32_t schema_selftest() {
+	constexpr uint32_t Cases = 2000;
+	std::mt19937 mt(0x5c4e3a);
+	uint32_t size_failures = 0, encode_failures = 0, decode_failures = 0, truncated_failures = 0;
+	std::vector< char > schema_bytes, hand_bytes;
+	SnapshotBody schema_decoded, hand_decoded;
+	for (uint32_t c = 0; c < Cases; ++c) {
+		SnapshotBody body = random_snapshot(mt, (c % 10 == 9 ? mt() % 300 : mt() % 33));
+
+		schema_bytes.assign(encoded_size(body), 0);
+		hand_bytes.assign(hand_unrolled::encoded_size(body), 0);
+		if (schema_bytes.size() != hand_bytes.size()) {
+			size_failures += 1;
+			continue;
+		}
+		size_t used = encode(body, schema_bytes.data(), schema_bytes.size());
+		char *hand_end = hand_unrolled::encode(body, hand_bytes.data());
+		if (used != schema_bytes.size() || hand_end != hand_bytes.data() + hand_bytes.size() || schema_bytes != hand_bytes) {
+			encode_failures += 1;
+			continue;
+		}
+
+		size_t read = decode(schema_bytes.data(), schema_bytes.size(), &schema_decoded);
+		char const *hand_read = hand_unrolled::decode(hand_bytes.data(), hand_bytes.data() + hand_bytes.size(), &hand_decoded);
+		if (read != schema_bytes.size() || hand_read != hand_bytes.data() + hand_bytes.size() || !same_snapshot(schema_decoded, hand_decoded)) {
+			decode_failures += 1;
+		}
+
+		//every truncation of the message asks for more input:
+		size_t cut = mt() % schema_bytes.size();
+		if (decode(schema_bytes.data(), cut, &schema_decoded) != 0) truncated_failures += 1;
+	}
+
+	std::cout << (size_failures ? "  FAILED: " : "  ok: ") << "encoded_size matches the hand-unrolled size" << std::endl;
+	std::cout << (encode_failures ? "  FAILED: " : "  ok: ") << "encode gives the hand-unrolled bytes on " << Cases << " random snapshots" << std::endl;
+	std::cout << (decode_failures ? "  FAILED: " : "  ok: ") << "decode gives the hand-unrolled values" << std::endl;
+	std::cout << (truncated_failures ? "  FAILED: " : "  ok: ") << "decode of a truncated snapshot waits for more input" << std::endl;
+	return size_failures + encode_failures + decode_failures + truncated_failures;
+}
+
+//time (per snapshot) of schema-generated vs. hand-unrolled SnapshotBody encode + decode:
+static void schema_benchmark() {
+	std::mt19937 mt(0xbe4c5c);
+	for (uint32_t players : { 8u, 32u }) {
+		//a rotating set of snapshots, so branch prediction can't memorize one:
+		constexpr uint32_t Snapshots = 64;
+		std::vector< SnapshotBody > bodies;
+		for (uint32_t i = 0; i < Snapshots; ++i) bodies.emplace_back(random_snapshot(mt, players));
+		std::vector< char > buffer(hand_unrolled::encoded_size(bodies[0]) + 16);
+		SnapshotBody decoded;
+		constexpr uint32_t Reps = 200000;
+
+		auto time_ns = [&](auto const &fn) {
+			return 1e6f * Benchmark::median_ms(5, [&]() {
+				for (uint32_t r = 0; r < Reps; ++r) {
+					fn(bodies[r % Snapshots]);
+				}
+			}) / Reps;
+		};
+
+		float schema_encode = time_ns([&](SnapshotBody const &body) {
+			size_t used = encode(body, buffer.data(), buffer.size());
+			Benchmark::keep(uint32_t(uint8_t(buffer[used - 1])));
+		});
+		float hand_encode = time_ns([&](SnapshotBody const &body) {
+			char *end = hand_unrolled::encode(body, buffer.data());
+			Benchmark::keep(uint32_t(uint8_t(end[-1])));
+		});
+		//(decoding always reads the same bytes, so encode the one message first)
+		size_t used = encode(bodies[0], buffer.data(), buffer.size());
+		float schema_decode = time_ns([&](SnapshotBody const &) {
+			Benchmark::keep(uint32_t(decode(buffer.data(), used, &decoded)) + decoded.players.back().team);
+		});
+		float hand_decode = time_ns([&](SnapshotBody const &) {
+			Benchmark::keep(uint32_t(hand_unrolled::decode(buffer.data(), buffer.data() + used, &decoded) - buffer.data()) + decoded.players.back().team);
+		});
+
+		std::cout << "  " << players << " players (" << used << " bytes): encode " << schema_encode << " ns (schema) vs " << hand_encode << " ns (hand-unrolled);"
+			<< " decode " << schema_decode << " ns (schema) vs " << hand_decode << " ns (hand-unrolled)" << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	if (argc == 2 && std::string(argv[1]) == "--benchmark") {
+		std::cout << "Bulk float serialization (median of 5 runs):" << std::endl;
+		serialization_benchmark();
+		std::cout << "Snapshot encode / decode (median of 5 runs):" << std::endl;
+		schema_benchmark();
+		return 0;
+	}
+	if (argc != 1) {
+		std::cerr << "Usage:\n\t" << argv[0] << "\n\t" << argv[0] << " --benchmark" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Bulk float serialization (kernels vs one-at-a-time conversion):" << std::endl;
+	uint32_t failed = serialization_selftest();
+	std::cout << "Snapshot schema (generated vs hand-unrolled encoding):" << std::endl;
+	failed += schema_selftest();
+	if (failed) {
+		std::cout << failed << " check(s) FAILED." << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
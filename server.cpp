@@ -1,16 +1,23 @@
 
 #include "Connection.hpp"
 #include "ServerState.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 
 #include "hex_dump.hpp"
 
 #include <glm/glm.hpp>
 #include <chrono>
+#include <csignal>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
+#include <string>
 #include <unordered_map>
 
+//set by SIGUSR1 to ask the main loop to write out a trace:
+static volatile std::sig_atomic_t dump_trace = 0;
+
 int main(int argc, char **argv) {
 #ifdef _WIN32
 	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
@@ -19,23 +26,87 @@ int main(int argc, char **argv) {
 
 	//------------ argument parsing ------------
 
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./server <port>" << std::endl;
+	if (argc != 2 && argc != 3) {
+		std::cerr << "Usage:\n\t./server <port> [metrics-file]" << std::endl;
 		return 1;
 	}
 
+	//if given, metrics are written (in Prometheus text format) to this file every second:
+	std::string metrics_path = (argc == 3 ? argv[2] : "");
+
 	//------------ initialization ------------
 
+	Trace::set_thread_name("main");
+	#ifndef _WIN32
+	//'kill -USR1 <pid>' writes recent ticks to server-trace.json:
+	std::signal(SIGUSR1, [](int){ dump_trace = 1; });
+	#endif
+
 	Server server(argv[1]);
   ServerState state;
 
+	//------------ metrics ------------
+
+	Metrics metrics;
+
+	//durations are recorded in nanoseconds and exported in seconds:
+	auto duration_histogram = [&metrics](std::string const &name, std::string const &help, std::string const &labels) -> Metrics::Histogram & {
+		return metrics.histogram(name, help, labels, 1e-9, 1000, 100000000);
+	};
+	auto ns_since = [](std::chrono::steady_clock::time_point const &start) -> uint64_t {
+		return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count());
+	};
+
+	char const *StageHelp = "Time spent in each stage of a server tick (wait is time in poll() not spent handling messages).";
+	Metrics::Histogram &wait_time = duration_histogram("server_tick_stage_seconds", StageHelp, "stage=\"wait\"");
+	Metrics::Histogram &handle_time = duration_histogram("server_tick_stage_seconds", StageHelp, "stage=\"handle\"");
+	Metrics::Histogram &update_time = duration_histogram("server_tick_stage_seconds", StageHelp, "stage=\"update\"");
+	Metrics::Histogram &broadcast_time = duration_histogram("server_tick_stage_seconds", StageHelp, "stage=\"broadcast\"");
+	Metrics::Histogram &tick_time = duration_histogram("server_tick_seconds", "Total duration of each server tick.", "");
+	Metrics::Histogram &snapshot_bytes = metrics.histogram("server_snapshot_bytes", "Size of the shared part of each snapshot.", "", 1.0, 1, 65536);
+	Metrics::Counter &ticks = metrics.counter("server_ticks_total", "Server ticks run.");
+	Metrics::Gauge &player_count = metrics.gauge("server_players", "Connected players.");
+	Metrics::Gauge &send_queue = metrics.gauge("server_send_queue_bytes", "Bytes waiting to be sent, over all connections.");
+	Metrics::Gauge &recv_queue = metrics.gauge("server_recv_queue_bytes", "Bytes received but not yet handled, over all connections.");
+
+	//per-connection byte counts (taken from the connection's running totals once per tick):
+	struct ConnectionMetrics {
+		Metrics::Counter *received;
+		Metrics::Counter *sent;
+		uint64_t last_received = 0;
+		uint64_t last_sent = 0;
+	};
+	std::unordered_map< Connection *, ConnectionMetrics > connection_metrics;
+	uint32_t next_connection_id = 0;
+
+	auto on_open = [&](Connection *c) {
+		std::string labels = "connection=\"" + std::to_string(next_connection_id++) + "\"";
+		ConnectionMetrics &m = connection_metrics[c];
+		m.received = &metrics.counter("server_connection_received_bytes_total", "Bytes received from each connection.", labels);
+		m.sent = &metrics.counter("server_connection_sent_bytes_total", "Bytes sent to each connection.", labels);
+		state.connect(c);
+	};
+	auto on_close = [&](Connection *c) {
+		auto f = connection_metrics.find(c);
+		assert(f != connection_metrics.end());
+		metrics.remove(f->second.received);
+		metrics.remove(f->second.sent);
+		connection_metrics.erase(f);
+		state.disconnect(c);
+	};
+
+	auto next_export = std::chrono::steady_clock::now();
+
 
 	//------------ main loop ------------
 	constexpr float ServerTick = 1.0f / 60.0f;
 
 	while (true) {
 		static auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration< double >(ServerTick);
+		TRACE_SCOPE("tick");
     auto tick_start = std::chrono::steady_clock::now();
+		uint64_t handle_ns = 0;
+		uint64_t poll_start = Trace::now();
 		//process incoming data from clients until a tick has elapsed:
 		while (true) {
 			auto now = std::chrono::steady_clock::now();
@@ -45,48 +116,90 @@ int main(int argc, char **argv) {
 				break;
 			}
 			server.poll([&](Connection *c, Connection::Event evt){
+				TRACE_SCOPE("handle");
+				auto handle_start = std::chrono::steady_clock::now();
 				if (evt == Connection::OnOpen) {
 					//client connected:
-          state.connect(c);
+					on_open(c);
 
 				} else if (evt == Connection::OnClose) {
 					//client disconnected:
-          state.disconnect(c);
+					on_close(c);
 
 				} else { assert(evt == Connection::OnRecv);
 					//got data from client:
 					std::cout << "got bytes:\n" << hex_dump(c->recv_buffer); std::cout.flush();
 
 					//handle messages from client:
-					while (c->recv_buffer.size() >= 6) {
-						//expecting 6-byte messages 'b' (left count) (right count) (down count) (up count)
+					while (!c->recv_buffer.empty()) {
+						//expecting 'b' messages followed by an InputMessage (see Messages.hpp)
 						char type = c->recv_buffer[0];
-						if (type != 'b') {
+						if (type != InputMessage::Type) {
 							std::cout << " message of non-'b' type received from client!" << std::endl;
 							//shut down client connection:
+							// (close() doesn't generate an OnClose event, so clean up here)
+							on_close(c);
 							c->close();
-							return;
+							break;
 						}
-						uint8_t left = c->recv_buffer[1];
-						uint8_t right = c->recv_buffer[2];
-						uint8_t down = c->recv_buffer[3];
-						uint8_t up = c->recv_buffer[4];
-						uint8_t space = c->recv_buffer[5];
+						InputMessage input;
+						size_t used = decode(c->recv_buffer.data() + 1, c->recv_buffer.size() - 1, &input);
+						if (used == 0) break; //wait for the rest of the message
 
-            state.received(c, left, right, down, up, space);
+            state.received(c, input);
 
-						c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 6);
+						c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 1 + used);
 					}
 				}
+				handle_ns += ns_since(handle_start);
 			}, remain);
 		}
+		Trace::record("poll", poll_start, Trace::now());
+		uint64_t poll_ns = ns_since(tick_start);
+		wait_time.record(poll_ns > handle_ns ? poll_ns - handle_ns : 0);
+		handle_time.record(handle_ns);
 
 		//update current game state
-    std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - tick_start;
+    auto update_start = std::chrono::steady_clock::now();
+    std::chrono::duration<float> elapsed = update_start - tick_start;
     state.update(elapsed.count());
+		update_time.record(ns_since(update_start));
 
 		//send updated game state to all clients
+    auto broadcast_start = std::chrono::steady_clock::now();
     state.broadcast();
+		broadcast_time.record(ns_since(broadcast_start));
+		snapshot_bytes.record(state.snapshot_buffer.size());
+
+		//sample per-connection totals and queue depths:
+		int64_t send_total = 0;
+		int64_t recv_total = 0;
+		for (auto &[c, m] : connection_metrics) {
+			m.received->add(c->bytes_received - m.last_received);
+			m.last_received = c->bytes_received;
+			m.sent->add(c->bytes_sent - m.last_sent);
+			m.last_sent = c->bytes_sent;
+			send_total += int64_t(c->send_buffer.size());
+			recv_total += int64_t(c->recv_buffer.size());
+		}
+		send_queue.set(send_total);
+		recv_queue.set(recv_total);
+		player_count.set(int64_t(state.players.size()));
+
+		ticks.add();
+		tick_time.record(ns_since(tick_start));
+
+		if (!metrics_path.empty() && std::chrono::steady_clock::now() >= next_export) {
+			TRACE_SCOPE("export metrics");
+			metrics.write_file(metrics_path);
+			next_export = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		}
+
+		if (dump_trace) {
+			dump_trace = 0;
+			std::cout << "Saving trace to 'server-trace.json'." << std::endl;
+			Trace::write_json("server-trace.json");
+		}
 	}
 
 
@@ -4,6 +4,8 @@
 #include "GL.hpp"
 #include "load_save_png.hpp"
 #include "ShowSceneProgram.hpp"
+#include "SceneStreamer.hpp"
+#include "DrawList.hpp"
 
 #include <SDL.h>
 
@@ -12,6 +14,146 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <random>
+#include <set>
+#include <tuple>
+
+//------------ headless checks (no window) ------------
+
+//sort + submit a synthetic scene through a CountingDrawBackend and check that the state cache
+// only binds what changes -- returns the number of failed checks:
+static uint32_t draw_list_selftest() {
+	uint32_t failed = 0;
+	auto check = [&failed](bool ok, std::string const &what) {
+		std::cout << (ok ? "  ok: " : "  FAILED: ") << what << std::endl;
+		if (!ok) failed += 1;
+	};
+
+	//(nothing is culled, so any matrices will do)
+	glm::mat4 world_to_clip = glm::mat4(1.0f);
+	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
+
+	{ //drawables with a random mix of programs / vertex arrays / textures:
+		std::mt19937 mt(0x5e1f7e57);
+		Scene scene;
+		GLuint const programs[] = { 1, 2, 3 };
+		GLuint const vaos[] = { 10, 11, 12, 13 };
+		GLuint const unit0[] = { 0, 100, 101 };
+		GLuint const unit1[] = { 0, 200 };
+		constexpr uint32_t Count = 1000;
+		for (uint32_t i = 0; i < Count; ++i) {
+			scene.transforms.emplace_back();
+			Scene::Transform *transform = &scene.transforms.back();
+			transform->position = glm::vec3(float(mt() % 40) - 20.0f, float(mt() % 40), 0.0f);
+			scene.drawables.emplace_back(transform);
+			Scene::Drawable::Pipeline &pipeline = scene.drawables.back().pipeline;
+			pipeline.program = programs[mt() % 3];
+			pipeline.vao = vaos[mt() % 4];
+			pipeline.start = (mt() % 8) * 36;
+			pipeline.count = 36;
+			pipeline.textures[0].texture = unit0[mt() % 3];
+			pipeline.textures[1].texture = unit1[mt() % 2];
+			if (mt() % 2) pipeline.uses_draw_block = true;
+			else pipeline.OBJECT_TO_CLIP_mat4 = 0;
+		}
+		uint64_t pass = scene.update_transforms();
+
+		DrawList list;
+		list.add(scene, world_to_clip, pass, false);
+		list.sort();
+
+		//what an ideal submit binds, working from the distinct states in the sorted list:
+		std::set< GLuint > distinct_programs;
+		std::set< std::pair< GLuint, GLuint > > distinct_vaos;
+		std::set< std::tuple< GLuint, GLuint, GLuint, GLuint > > distinct_states;
+		uint32_t state_runs = 0; //runs of items with the same program / vertex array / textures
+		uint32_t texture_changes = 0; //changes of texture on some unit between consecutive items
+		Scene::Drawable::Pipeline const *prev = nullptr;
+		for (auto const &item : list.items) {
+			Scene::Drawable::Pipeline const &p = item.drawable->pipeline;
+			distinct_programs.emplace(p.program);
+			distinct_vaos.emplace(p.program, p.vao);
+			distinct_states.emplace(p.program, p.vao, p.textures[0].texture, p.textures[1].texture);
+			if (!prev || prev->program != p.program || prev->vao != p.vao
+			 || prev->textures[0].texture != p.textures[0].texture || prev->textures[1].texture != p.textures[1].texture) {
+				state_runs += 1;
+			}
+			for (uint32_t u = 0; u < 2; ++u) {
+				if ((prev ? prev->textures[u].texture : 0) != p.textures[u].texture) texture_changes += 1;
+			}
+			prev = &p;
+		}
+		check(state_runs == distinct_states.size(), "sort groups each of the " + std::to_string(distinct_states.size()) + " program / vertex array / texture states into one run (got " + std::to_string(state_runs) + " runs)");
+
+		CountingDrawBackend backend;
+		DrawStateCache state(backend);
+		list.submit(world_to_clip, world_to_light, state);
+		CountingDrawBackend::Counts counts = backend.counts;
+		check(counts.use_program == distinct_programs.size(), "program binds (" + std::to_string(counts.use_program) + ") == distinct programs (" + std::to_string(distinct_programs.size()) + ")");
+		check(counts.bind_vertex_array == distinct_vaos.size(), "vertex array binds (" + std::to_string(counts.bind_vertex_array) + ") == distinct program + vertex array pairs (" + std::to_string(distinct_vaos.size()) + ")");
+		check(counts.bind_texture == texture_changes, "texture binds (" + std::to_string(counts.bind_texture) + ") == texture changes between consecutive draws (" + std::to_string(texture_changes) + ")");
+		check(state.stats.program_changes == counts.use_program && state.stats.vao_changes == counts.bind_vertex_array
+			&& state.stats.texture_changes == counts.bind_texture, "state cache stats match the backend's counts");
+		check(counts.draws == Count && list.stats.draw_calls == Count, "one draw per drawable");
+		uint32_t block_drawables = 0;
+		for (auto const &drawable : scene.drawables) block_drawables += (drawable.pipeline.uses_draw_block ? 1 : 0);
+		check(counts.bind_draw_block == block_drawables && counts.uniforms == Count - block_drawables, "draw block binds for draw-block pipelines, uniforms for the rest");
+		check(counts.upload_frame_block == 1 && counts.upload_draw_blocks == 1, "one frame block and one batch of draw blocks uploaded");
+
+		//submitting again with the same matrices (as SceneStreamer::draw does after Scene::draw) re-uploads the draw blocks, but not the frame block:
+		list.submit(world_to_clip, world_to_light, state);
+		check(backend.counts.upload_frame_block == 1 && backend.counts.upload_draw_blocks == 2, "an unchanged frame block isn't uploaded again");
+		glm::mat4 moved = world_to_clip;
+		moved[3].x += 1.0f;
+		list.submit(moved, world_to_light, state);
+		check(backend.counts.upload_frame_block == 2, "...but a changed one is");
+
+		state.reset();
+		check(backend.program == 0 && backend.vao == 0 && state.textures[0].texture == 0 && state.textures[1].texture == 0, "reset() returns to the default state");
+
+		//for comparison, the same drawables in scene order:
+		DrawList unsorted;
+		unsorted.add(scene, world_to_clip, pass, false);
+		CountingDrawBackend unsorted_backend;
+		DrawStateCache unsorted_state(unsorted_backend);
+		unsorted.submit(world_to_clip, world_to_light, unsorted_state);
+		std::cout << "  (" << Count << " drawables: sorted, " << counts.use_program << " program / " << counts.bind_vertex_array << " vertex array / "
+			<< counts.bind_texture << " texture binds; in scene order, " << unsorted_backend.counts.use_program << " / "
+			<< unsorted_backend.counts.bind_vertex_array << " / " << unsorted_backend.counts.bind_texture << ")" << std::endl;
+	}
+
+	{ //copies of one mesh with an instanced program become one instanced draw:
+		Scene scene;
+		constexpr uint32_t Count = 64;
+		for (uint32_t i = 0; i < Count; ++i) {
+			scene.transforms.emplace_back();
+			scene.transforms.back().position = glm::vec3(float(i % 8), float(i / 8), 0.0f);
+			scene.drawables.emplace_back(&scene.transforms.back());
+			Scene::Drawable::Pipeline &pipeline = scene.drawables.back().pipeline;
+			pipeline.program = 1;
+			pipeline.vao = 10;
+			pipeline.count = 36;
+			pipeline.instanced.program = 2;
+			pipeline.instanced.base = 1;
+			pipeline.textures[0].texture = 100;
+		}
+		uint64_t pass = scene.update_transforms();
+
+		DrawList list;
+		list.add(scene, world_to_clip, pass, false);
+		list.sort();
+		CountingDrawBackend backend;
+		DrawStateCache state(backend);
+		list.submit(world_to_clip, world_to_light, state);
+		auto const &counts = backend.counts;
+		check(counts.instanced_draws == 1 && counts.instances == Count && counts.draws == 0 && counts.upload_instances == 1,
+			std::to_string(Count) + " copies of a mesh are drawn with one instanced draw");
+		check(counts.use_program == 1 && counts.bind_vertex_array == 1 && counts.bind_texture == 1, "...with one program, vertex array, and texture bind");
+		check(counts.upload_draw_blocks == 0, "...and no draw block upload (there are none)");
+	}
+
+	return failed;
+}
 
 int main(int argc, char **argv) {
 #ifdef _WIN32
@@ -19,6 +161,17 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	if (argc == 2 && std::string(argv[1]) == "--selftest") {
+		std::cout << "DrawList sort + state cache (counting backend):" << std::endl;
+		uint32_t failed = draw_list_selftest();
+		if (failed) {
+			std::cout << failed << " check(s) FAILED." << std::endl;
+			return 1;
+		}
+		std::cout << "All checks passed." << std::endl;
+		return 0;
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -83,17 +236,65 @@ int main(int argc, char **argv) {
 	bool usage = false;
 	std::string scene_file;
 	std::string meshes_file;
-	if (argc == 2) {
-		scene_file = argv[1];
-	} else if (argc == 3) {
-		scene_file = argv[1];
-		meshes_file = argv[2];
+	bool stream = false; //--stream: load only the part of the scene near the camera (see SceneStreamer)
+	bool lod_report = false; //--lod-report: print triangles and draw time for each LOD setting, then quit (see ShowSceneMode)
+	std::vector< std::string > args(argv + 1, argv + argc);
+	while (!args.empty() && (args[0] == "--stream" || args[0] == "--lod-report")) {
+		if (args[0] == "--stream") stream = true;
+		else lod_report = true;
+		args.erase(args.begin());
+	}
+	if (args.size() == 1 && !stream) {
+		scene_file = args[0];
+	} else if (args.size() == 2) {
+		scene_file = args[0];
+		meshes_file = args[1];
 	} else {
 		usage = true;
 	}
+
+	//point a drawable at a mesh:
+	auto make_drawable = [](Scene &scene, Scene::Transform *transform, Mesh const &mesh, GLuint vao) {
+		scene.drawables.emplace_back(transform);
+		Scene::Drawable &drawable = scene.drawables.back();
+
+		drawable.pipeline = show_scene_program_pipeline;
+
+		drawable.pipeline.vao = vao;
+		drawable.pipeline.type = mesh.type;
+		drawable.pipeline.start = mesh.start;
+		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.base_vertex = mesh.base_vertex;
+		drawable.pipeline.position_scale = mesh.position_scale;
+		drawable.pipeline.position_offset = mesh.position_offset;
+		drawable.pipeline.lod_levels = mesh.lod_levels;
+		for (uint32_t l = 0; l < mesh.lod_levels; ++l) {
+			drawable.pipeline.lods[l].start = mesh.lods[l].start;
+			drawable.pipeline.lods[l].count = mesh.lods[l].count;
+			drawable.pipeline.lods[l].error = mesh.lods[l].error;
+		}
+
+		drawable.bounds_min = mesh.min;
+		drawable.bounds_max = mesh.max;
+	};
+
+	SceneStreamer *streamer = nullptr;
+	if (stream && !usage) {
+		try {
+			SceneStreamer::Settings settings;
+			settings.program = show_scene_program->program;
+			streamer = new SceneStreamer(scene_file, meshes_file, settings, make_drawable);
+		} catch (std::exception &e) {
+			std::cerr << "ERROR streaming scene '" << scene_file << "' with meshes from '" << meshes_file << "': " << e.what() << std::endl;
+			usage = true;
+			streamer = nullptr;
+		}
+	}
+
 	MeshBuffer *buffer = nullptr;
 	GLuint buffer_vao = 0;
-	if (meshes_file != "") {
+	if (meshes_file != "" && !stream) {
 		try {
 			buffer = new MeshBuffer(meshes_file);
 			buffer_vao = buffer->make_vao_for_program(show_scene_program->program);
@@ -103,24 +304,13 @@ int main(int argc, char **argv) {
 			buffer = nullptr;
 		}
 	}
-	Scene *scene = nullptr;
-	if (scene_file != "") {
+	Scene *scene = (streamer ? new Scene() : nullptr); //(streamed scenes are shown alongside an empty one)
+	if (scene_file != "" && !stream) {
 		try {
 			scene = new Scene();
-			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+			scene->load(scene_file, [&buffer,&buffer_vao,&make_drawable](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 				if (!buffer_vao) return;
-				Mesh const &mesh = buffer->lookup(mesh_name);
-
-				scene.drawables.emplace_back(transform);
-				Scene::Drawable &drawable = scene.drawables.back();
-
-				drawable.pipeline = show_scene_program_pipeline;
-
-				drawable.pipeline.vao = buffer_vao;
-				drawable.pipeline.type = mesh.type;
-				drawable.pipeline.start = mesh.start;
-				drawable.pipeline.count = mesh.count;
-
+				make_drawable(scene, transform, buffer->lookup(mesh_name), buffer_vao);
 			});
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;
@@ -132,16 +322,22 @@ int main(int argc, char **argv) {
 		usage = true;
 	}
 	if (usage) {
-		std::cerr << "Usage:\n\t" << argv[0] << " <path/to/scene.scene> [path/to/meshes.pnct]" << std::endl;
+		std::cerr << "Usage:\n\t" << argv[0] << " [--lod-report] <path/to/scene.scene> [path/to/meshes.pnct]" << std::endl;
+		std::cerr << "\t" << argv[0] << " [--lod-report] --stream <path/to/scene.scene> <path/to/meshes.pnct>" << std::endl;
+		std::cerr << "\t" << argv[0] << " --selftest" << std::endl;
 		return 1;
 	}
-	std::cout << "Showing scene from '" << scene_file << "' with";
+	std::cout << (streamer ? "Streaming" : "Showing") << " scene from '" << scene_file << "' with";
 	if (meshes_file != "") {
 		std::cout << " meshes from '" << meshes_file << "'" << std::endl;
 	} else {
 		std::cout << " no meshes -- consider passing a '.pnct' file as the second argument." << std::endl;
 	}
-	Mode::set_current(std::make_shared< ShowSceneMode >(*scene));
+
+	//build a bounding volume hierarchy for culling and picking:
+	scene->build_bvh();
+
+	Mode::set_current(std::make_shared< ShowSceneMode >(*scene, streamer, lod_report));
 
 	//------------ main loop ------------
 